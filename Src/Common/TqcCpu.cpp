@@ -0,0 +1,151 @@
+/**
+@ TqcCpu.cpp
+@ CPU feature detection for runtime kernel dispatch.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define TQC_CPU_X86
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#define TQC_CPU_X86
+#endif
+
+#include "TqcLog.h"
+#include "TqcCpu.h"
+
+static const char *g_cpuLevelNames[TQC_CPU_LEVEL_COUNT] = { "generic", "sse2", "sse4.1", "avx2", "avx512" };
+
+// -1 until the first TqcCpuGetLevel().
+static std::atomic<int> g_nCpuLevel(-1);
+
+#ifdef TQC_CPU_X86
+static void CpuId(int nLeaf, int nSubLeaf, unsigned int regs[4])
+{
+#if defined(_MSC_VER)
+    __cpuidex((int*)regs, nLeaf, nSubLeaf);
+#else
+    __cpuid_count(nLeaf, nSubLeaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// Register state the OS saves on a context switch, XCR0.
+static unsigned long long GetXcr0()
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    unsigned int eax, edx;
+
+    __asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((unsigned long long)edx << 32) | eax;
+#endif
+}
+#endif
+
+// AVX levels also need the OS to save the wider registers, not only the CPUID bits.
+enTqcCpuLevel TqcCpuDetectLevel()
+{
+#ifdef TQC_CPU_X86
+    unsigned int       regs[4];
+    unsigned int       nMaxLeaf, ecx1, edx1, ebx7 = 0;
+    unsigned long long xcr0 = 0;
+
+    CpuId(0, 0, regs);
+    nMaxLeaf = regs[0];
+
+    CpuId(1, 0, regs);
+    ecx1 = regs[2];
+    edx1 = regs[3];
+
+    if (nMaxLeaf >= 7)
+    {
+        CpuId(7, 0, regs);
+        ebx7 = regs[1];
+    }
+
+    if (ecx1 & (1u << 27))
+    {
+        xcr0 = GetXcr0();
+    }
+
+    if (!(edx1 & (1u << 26)))
+    {
+        return TQC_CPU_GENERIC;
+    }
+
+    if (!(ecx1 & (1u << 19)) || !(ecx1 & (1u << 23)))
+    {
+        return TQC_CPU_SSE2;
+    }
+
+    if (!(ecx1 & (1u << 28)) || (xcr0 & 0x06) != 0x06 || !(ebx7 & (1u << 5)))
+    {
+        return TQC_CPU_SSE41;
+    }
+
+    if (!(ebx7 & (1u << 16)) || !(ebx7 & (1u << 30)) || (xcr0 & 0xE6) != 0xE6)
+    {
+        return TQC_CPU_AVX2;
+    }
+
+    return TQC_CPU_AVX512;
+#else
+    return TQC_CPU_GENERIC;
+#endif
+}
+
+// Detected level, lowered by TQC_CPU_LEVEL_ENV. A level above the detected one is refused, the
+// kernels would fault on the first unsupported instruction.
+enTqcCpuLevel TqcCpuGetLevel()
+{
+    int nLevel = g_nCpuLevel.load();
+
+    if (nLevel >= 0)
+    {
+        return (enTqcCpuLevel)nLevel;
+    }
+
+    const char *strForce = getenv(TQC_CPU_LEVEL_ENV);
+
+    nLevel = TqcCpuDetectLevel();
+
+    if (strForce && strForce[0])
+    {
+        int nForce = -1;
+
+        for (int i = 0; i < TQC_CPU_LEVEL_COUNT; i++)
+        {
+            if (strcmp(strForce, g_cpuLevelNames[i]) == 0 || (strlen(strForce) == 1 && strForce[0] == '0' + i))
+            {
+                nForce = i;
+            }
+        }
+
+        if (nForce < 0)
+        {
+            LOGE("%s(%d): unknown %s \"%s\", ignored.", __FUNCTION__, __LINE__, TQC_CPU_LEVEL_ENV, strForce);
+        }
+        else if (nForce > nLevel)
+        {
+            LOGE("%s(%d): %s=%s is above what this CPU supports (%s), ignored.", __FUNCTION__, __LINE__,
+                 TQC_CPU_LEVEL_ENV, strForce, g_cpuLevelNames[nLevel]);
+        }
+        else
+        {
+            nLevel = nForce;
+        }
+    }
+
+    g_nCpuLevel.store(nLevel);
+    return (enTqcCpuLevel)nLevel;
+}
+
+const char* TqcCpuLevelName(enTqcCpuLevel level)
+{
+    return (level >= 0 && level < TQC_CPU_LEVEL_COUNT) ? g_cpuLevelNames[level] : "unknown";
+}
\ No newline at end of file
@@ -0,0 +1,29 @@
+/**
+@ TqcCpu.h
+@ CPU feature detection for runtime kernel dispatch.
+*/
+
+#ifndef __TQC_CPU_H
+#define __TQC_CPU_H
+
+// Forces a lower level than the detected one, by name ("sse2", "avx2", ...) or number.
+#define TQC_CPU_LEVEL_ENV   "TQC_CPU_LEVEL"
+
+// Kernel ISA levels, each one implies all levels below it.
+typedef enum _enTqcCpuLevel
+{
+    TQC_CPU_GENERIC = 0,    // Whatever the compiler targets by default (NEON on Android).
+    TQC_CPU_SSE2    = 1,
+    TQC_CPU_SSE41   = 2,    // SSE4.1 + POPCNT.
+    TQC_CPU_AVX2    = 3,
+    TQC_CPU_AVX512  = 4,    // AVX-512 F + BW.
+    TQC_CPU_LEVEL_COUNT
+} enTqcCpuLevel;
+
+
+// Function declaration
+enTqcCpuLevel TqcCpuDetectLevel();
+enTqcCpuLevel TqcCpuGetLevel();
+const char* TqcCpuLevelName(enTqcCpuLevel level);
+
+#endif /* __TQC_CPU_H */
\ No newline at end of file
@@ -0,0 +1,135 @@
+/**
+@ TqcRingBuffer.h
+@ bounded single-producer/single-consumer ring buffer.
+*/
+
+#ifndef __TQC_RING_BUFFER_H
+#define __TQC_RING_BUFFER_H
+
+#include <cstddef>
+#include <vector>
+#include <atomic>
+#include "TqcOs.h"
+
+// Queue between exactly one producer thread and one consumer thread. The slots are lock-free, two
+// semaphores count the items and the free slots so that a blocked side sleeps until the other one
+// posts instead of polling. One slot is kept empty to tell "full" from "empty", so nCapacity items fit.
+template <typename T>
+class CRingBuffer
+{
+public:
+    explicit CRingBuffer(unsigned int nCapacity)
+        : m_items(nCapacity + 1), m_nHead(0), m_nTail(0), m_hData(NULL), m_hSpace(NULL)
+    {
+        Reset();
+    }
+
+    ~CRingBuffer()
+    {
+        TqcOsDeleteSemaphore(m_hData);
+        TqcOsDeleteSemaphore(m_hSpace);
+    }
+
+public:
+    // Producer side, blocks while the buffer is full. Returns false once *pbQuit is true.
+    bool Push(const T &item, const std::atomic<bool> *pbQuit)
+    {
+        TqcOsWaitSemaphore(m_hSpace);
+
+        if (pbQuit && pbQuit->load())
+        {
+            TqcOsPostSemaphore(m_hSpace, 1);    // Pass the wake-up on to the next call.
+            return false;
+        }
+
+        TryPush(item);
+        TqcOsPostSemaphore(m_hData, 1);
+        return true;
+    }
+
+    // Consumer side, blocks while the buffer is empty. Returns false when woken by Wake() with
+    // nothing left to pop, items pushed before still come out first.
+    bool Pop(T &item)
+    {
+        TqcOsWaitSemaphore(m_hData);
+
+        if (!TryPop(item))
+        {
+            TqcOsPostSemaphore(m_hData, 1);     // Only Wake() posts without an item, keep it for the next call.
+            return false;
+        }
+
+        TqcOsPostSemaphore(m_hSpace, 1);
+        return true;
+    }
+
+    // Wake both sides for shutdown, after the quit flag of Push() was set. The buffer needs a
+    // Reset() before it is used again.
+    void Wake()
+    {
+        TqcOsPostSemaphore(m_hSpace, 1);
+        TqcOsPostSemaphore(m_hData, 1);
+    }
+
+    // Empty the buffer. No thread may use it at the same time.
+    void Reset()
+    {
+        T item;
+
+        while (TryPop(item))
+            ;
+
+        if (m_hData)
+            TqcOsDeleteSemaphore(m_hData);
+        if (m_hSpace)
+            TqcOsDeleteSemaphore(m_hSpace);
+
+        m_hData  = TqcOsCreateSemaphore(0);
+        m_hSpace = TqcOsCreateSemaphore((int)m_items.size() - 1);
+    }
+
+protected:
+    // Lock-free slot updates, the semaphores guarantee there is room/data.
+    bool TryPush(const T &item)
+    {
+        unsigned int nTail = m_nTail.load(std::memory_order_relaxed);
+        unsigned int nNext = Next(nTail);
+
+        if (nNext == m_nHead.load(std::memory_order_acquire))
+            return false;
+
+        m_items[nTail] = item;
+        m_nTail.store(nNext, std::memory_order_release);
+        return true;
+    }
+
+    bool TryPop(T &item)
+    {
+        unsigned int nHead = m_nHead.load(std::memory_order_relaxed);
+
+        if (nHead == m_nTail.load(std::memory_order_acquire))
+            return false;
+
+        item = m_items[nHead];
+        m_items[nHead] = T();   // Drop references held by the slot (e.g. Mat data) right away.
+        m_nHead.store(Next(nHead), std::memory_order_release);
+        return true;
+    }
+
+    unsigned int Next(unsigned int nIndex) const
+    {
+        return (nIndex + 1 == m_items.size()) ? 0 : nIndex + 1;
+    }
+
+private:
+    CRingBuffer(const CRingBuffer&);
+    CRingBuffer& operator=(const CRingBuffer&);
+
+    std::vector<T>              m_items;
+    std::atomic<unsigned int>   m_nHead;    // Next slot to read, owned by the consumer.
+    std::atomic<unsigned int>   m_nTail;    // Next slot to write, owned by the producer.
+    SemaphoreHandle             m_hData;    // One count per item, plus one per Wake().
+    SemaphoreHandle             m_hSpace;   // One count per free slot, plus one per Wake().
+};
+
+#endif /* __TQC_RING_BUFFER_H */
\ No newline at end of file
@@ -0,0 +1,338 @@
+/**
+@ TqcScheduler.cpp
+@ task scheduler: worker threads with their own deques, work stealing, parallel-for and task groups.
+*/
+
+#include <algorithm>
+
+#include "TqcLog.h"
+#include "TqcScheduler.h"
+
+// Queue of the calling thread: its own deque on a worker of g_pWorkerScheduler, [0] anywhere else.
+static TQC_THREAD_LOCAL CTaskScheduler  *g_pWorkerScheduler = NULL;
+static TQC_THREAD_LOCAL int             g_nWorkerQueue      = 0;
+
+static CTaskScheduler g_scheduler;
+
+// One piece of a ParallelFor() range.
+typedef struct _stRangeChunk
+{
+    pfnTqcRangeTask pfnTask;
+    void            *pParam;
+    int             nBegin;
+    int             nEnd;
+} stRangeChunk;
+
+static void RunRangeChunk(void *pParam)
+{
+    stRangeChunk *pChunk = (stRangeChunk*)pParam;
+    pChunk->pfnTask(pChunk->pParam, pChunk->nBegin, pChunk->nEnd);
+}
+
+CTaskGroup::CTaskGroup(CTaskScheduler *pScheduler)
+    : m_pScheduler(pScheduler ? pScheduler : &TqcGetScheduler()), m_nPending(0)
+{
+}
+
+CTaskGroup::~CTaskGroup()
+{
+    Wait();
+}
+
+void CTaskGroup::Run(pfnTqcTask pfnTask, void *pParam)
+{
+    stTqcTask task;
+
+    task.pfnTask = pfnTask;
+    task.pParam  = pParam;
+    task.pGroup  = this;
+
+    m_nPending.fetch_add(1);
+    m_pScheduler->Spawn(task);
+}
+
+void CTaskGroup::Wait()
+{
+    while (m_nPending.load(std::memory_order_acquire) > 0)
+    {
+        if (!m_pScheduler->RunPending())
+        {
+            TqcOsSleep(0);
+        }
+    }
+}
+
+CTaskScheduler::CTaskScheduler()
+{
+    m_nWorkers  = 0;
+    m_bAffinity = false;
+    m_hWake     = NULL;
+    m_bQuit     = false;
+
+    m_queues.push_back(new stTaskQueue);
+    m_queues[0]->hThread    = NULL;
+    m_queues[0]->nIndex     = 0;
+    m_queues[0]->pScheduler = this;
+}
+
+CTaskScheduler::~CTaskScheduler()
+{
+    Stop();
+
+    while (RunPending())
+    {
+    }
+
+    delete m_queues[0];
+}
+
+// nWorkers <= 0: one worker per CPU besides the calling thread. With bAffinity worker k is pinned to
+// CPU k, CPU 0 is left to the calling thread.
+bool CTaskScheduler::Start(int nWorkers, bool bAffinity)
+{
+    int nCpus = TqcOsGetCpuCount();
+
+    if (m_nWorkers > 0)
+    {
+        LOGE("%s(%d): scheduler already runs %d workers.", __FUNCTION__, __LINE__, m_nWorkers);
+        return false;
+    }
+
+    nWorkers = nWorkers > 0 ? nWorkers : nCpus - 1;
+    if (nWorkers <= 0)
+    {
+        return true;
+    }
+
+    m_hWake = TqcOsCreateSemaphore(0);
+    if (!m_hWake)
+    {
+        LOGE("%s(%d): cannot create the wake-up semaphore.", __FUNCTION__, __LINE__);
+        return false;
+    }
+
+    m_bAffinity = bAffinity && nCpus > 1;
+    m_bQuit     = false;
+
+    // Every deque exists before the first worker can try to steal from it.
+    for (int i = 1; i <= nWorkers; i++)
+    {
+        stTaskQueue *pQueue = new stTaskQueue;
+
+        pQueue->hThread    = NULL;
+        pQueue->nIndex     = i;
+        pQueue->pScheduler = this;
+        m_queues.push_back(pQueue);
+    }
+
+    m_nWorkers = nWorkers;
+
+    for (int i = 1; i <= nWorkers; i++)
+    {
+        m_queues[i]->hThread = TqcOsCreateThread((void*)WorkerThread, m_queues[i]);
+        if (!m_queues[i]->hThread)
+        {
+            LOGE("%s(%d): cannot create worker %d.", __FUNCTION__, __LINE__, i);
+            Stop();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Joins the workers. Tasks still queued are run on the calling thread, so no group waits forever.
+void CTaskScheduler::Stop()
+{
+    if (m_nWorkers == 0)
+    {
+        return;
+    }
+
+    m_bQuit = true;
+    TqcOsPostSemaphore(m_hWake, m_nWorkers);
+
+    for (int i = 1; i <= m_nWorkers; i++)
+    {
+        if (m_queues[i]->hThread)
+        {
+            TqcOsJoinThread(m_queues[i]->hThread);
+        }
+    }
+
+    while (RunPending())
+    {
+    }
+
+    for (int i = 1; i <= m_nWorkers; i++)
+    {
+        delete m_queues[i];
+    }
+
+    m_queues.resize(1);
+    m_nWorkers = 0;
+
+    TqcOsDeleteSemaphore(m_hWake);
+    m_hWake = NULL;
+}
+
+void CTaskScheduler::Spawn(const stTqcTask &task)
+{
+    stTaskQueue *pQueue = m_queues[GetQueueIndex()];
+
+    pQueue->lock.Lock();
+    pQueue->tasks.push_back(task);
+    pQueue->lock.UnLock();
+
+    if (m_hWake)
+    {
+        TqcOsPostSemaphore(m_hWake, 1);
+    }
+}
+
+// Run one queued task on the calling thread: its own newest task first, otherwise the oldest
+// task of another queue. Returns false when every queue is empty.
+bool CTaskScheduler::RunPending()
+{
+    stTqcTask task;
+    int       nQueue = GetQueueIndex();
+
+    if (!Pop(nQueue, task) && !Steal(nQueue, task))
+    {
+        return false;
+    }
+
+    Execute(task);
+    return true;
+}
+
+// Split [nBegin, nEnd) into chunks of at least nGrain items, a few per thread so a late worker can
+// still steal some. The calling thread runs the first chunk itself and returns once all are done.
+void CTaskScheduler::ParallelFor(int nBegin, int nEnd, int nGrain, pfnTqcRangeTask pfnTask, void *pParam)
+{
+    int nCount  = nEnd - nBegin;
+    int nChunks = 0;
+
+    if (nCount <= 0)
+    {
+        return;
+    }
+
+    nGrain  = std::max(nGrain, 1);
+    nChunks = std::min((nCount + nGrain - 1) / nGrain, (m_nWorkers + 1) * 4);
+
+    if (m_nWorkers == 0 || nChunks <= 1)
+    {
+        pfnTask(pParam, nBegin, nEnd);
+        return;
+    }
+
+    std::vector<stRangeChunk> chunks(nChunks);
+    CTaskGroup                group(this);
+
+    for (int i = 0; i < nChunks; i++)
+    {
+        chunks[i].pfnTask = pfnTask;
+        chunks[i].pParam  = pParam;
+        chunks[i].nBegin  = nBegin + (int)((long long)nCount * i / nChunks);
+        chunks[i].nEnd    = nBegin + (int)((long long)nCount * (i + 1) / nChunks);
+    }
+
+    for (int i = 1; i < nChunks; i++)
+    {
+        group.Run(RunRangeChunk, &chunks[i]);
+    }
+
+    RunRangeChunk(&chunks[0]);
+    group.Wait();
+}
+
+int CTaskScheduler::GetQueueIndex() const
+{
+    return g_pWorkerScheduler == this ? g_nWorkerQueue : 0;
+}
+
+bool CTaskScheduler::Pop(int nQueue, stTqcTask &task)
+{
+    stTaskQueue *pQueue = m_queues[nQueue];
+    bool        bFound  = false;
+
+    pQueue->lock.Lock();
+    if (!pQueue->tasks.empty())
+    {
+        task   = pQueue->tasks.back();
+        bFound = true;
+        pQueue->tasks.pop_back();
+    }
+    pQueue->lock.UnLock();
+
+    return bFound;
+}
+
+bool CTaskScheduler::Steal(int nThief, stTqcTask &task)
+{
+    int nQueues = (int)m_queues.size();
+
+    for (int i = 1; i < nQueues; i++)
+    {
+        stTaskQueue *pQueue = m_queues[(nThief + i) % nQueues];
+        bool        bFound  = false;
+
+        pQueue->lock.Lock();
+        if (!pQueue->tasks.empty())
+        {
+            task   = pQueue->tasks.front();
+            bFound = true;
+            pQueue->tasks.pop_front();
+        }
+        pQueue->lock.UnLock();
+
+        if (bFound)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void CTaskScheduler::Execute(const stTqcTask &task)
+{
+    task.pfnTask(task.pParam);
+
+    if (task.pGroup)
+    {
+        task.pGroup->m_nPending.fetch_sub(1, std::memory_order_release);
+    }
+}
+
+// Spawn() posts once per task, so a worker only sleeps while there may be nothing to run. A wake-up
+// for a task that was already stolen just sends it back to sleep.
+void* CTaskScheduler::WorkerThread(void *pParam)
+{
+    stTaskQueue    *pQueue     = (stTaskQueue*)pParam;
+    CTaskScheduler *pScheduler = pQueue->pScheduler;
+
+    g_pWorkerScheduler = pScheduler;
+    g_nWorkerQueue     = pQueue->nIndex;
+
+    if (pScheduler->m_bAffinity)
+    {
+        TqcOsSetThreadAffinity(pQueue->nIndex % TqcOsGetCpuCount());
+    }
+
+    while (!pScheduler->m_bQuit)
+    {
+        if (!pScheduler->RunPending())
+        {
+            TqcOsWaitSemaphore(pScheduler->m_hWake);
+        }
+    }
+
+    return NULL;
+}
+
+CTaskScheduler& TqcGetScheduler()
+{
+    return g_scheduler;
+}
\ No newline at end of file
@@ -0,0 +1,102 @@
+/**
+@ TqcScheduler.h
+@ task scheduler: worker threads with their own deques, work stealing, parallel-for and task groups.
+*/
+
+#ifndef __TQC_SCHEDULER_H
+#define __TQC_SCHEDULER_H
+
+#include <cstddef>
+#include <deque>
+#include <vector>
+#include <atomic>
+#include "TqcOs.h"
+#include "TqcUtils.h"
+
+typedef void (*pfnTqcTask)(void *pParam);
+typedef void (*pfnTqcRangeTask)(void *pParam, int nBegin, int nEnd);  // Runs [nBegin, nEnd).
+
+class CTaskGroup;
+class CTaskScheduler;
+
+typedef struct _stTqcTask
+{
+    pfnTqcTask  pfnTask;
+    void        *pParam;
+    CTaskGroup  *pGroup;    // Counted down when the task finishes, may be NULL.
+} stTqcTask;
+
+// One deque per worker. The owner pushes and pops at the back (LIFO, cache-warm), thieves take
+// from the front (FIFO, the oldest and usually biggest piece of work).
+typedef struct _stTaskQueue
+{
+    CLock                   lock;
+    std::deque<stTqcTask>   tasks;
+    void                    *hThread;
+    int                     nIndex;
+    CTaskScheduler          *pScheduler;
+} stTaskQueue;
+
+
+// Tasks that are waited for together. Wait() runs queued tasks on the calling thread while it waits,
+// so a task can start and wait for its own group without tying up a worker.
+class CTaskGroup
+{
+public:
+    explicit CTaskGroup(CTaskScheduler *pScheduler = NULL);     // NULL: TqcGetScheduler().
+    ~CTaskGroup();
+
+public:
+    void    Run(pfnTqcTask pfnTask, void *pParam);
+    void    Wait();
+
+private:
+    CTaskGroup(const CTaskGroup&);
+    CTaskGroup& operator=(const CTaskGroup&);
+
+    friend class CTaskScheduler;
+
+    CTaskScheduler      *m_pScheduler;
+    std::atomic<int>    m_nPending;
+};
+
+
+// Without Start() every task simply runs on the thread that waits for it.
+class CTaskScheduler
+{
+public:
+    CTaskScheduler();
+    ~CTaskScheduler();
+
+public:
+    bool    Start(int nWorkers, bool bAffinity);
+    void    Stop();
+    void    Spawn(const stTqcTask &task);
+    bool    RunPending();
+    void    ParallelFor(int nBegin, int nEnd, int nGrain, pfnTqcRangeTask pfnTask, void *pParam);
+    int     GetWorkerCount() const { return m_nWorkers; }
+
+protected:
+    int     GetQueueIndex() const;
+    bool    Pop(int nQueue, stTqcTask &task);
+    bool    Steal(int nThief, stTqcTask &task);
+    void    Execute(const stTqcTask &task);
+
+    static void* WorkerThread(void *pParam);
+
+private:
+    CTaskScheduler(const CTaskScheduler&);
+    CTaskScheduler& operator=(const CTaskScheduler&);
+
+    int                         m_nWorkers;
+    bool                        m_bAffinity;
+    std::vector<stTaskQueue*>   m_queues;       // [0] is shared by outside threads, then one per worker.
+    SemaphoreHandle             m_hWake;        // One count per spawned task, idle workers sleep on it.
+    std::atomic<bool>           m_bQuit;
+};
+
+
+// Function declaration
+CTaskScheduler& TqcGetScheduler();
+
+#endif /* __TQC_SCHEDULER_H */
\ No newline at end of file
@@ -0,0 +1,211 @@
+/**
+@ TqcTrace.cpp
+@ scoped stage timers with Chrome trace export.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <algorithm>
+#include <opencv2/core/utility.hpp>
+
+#include "TqcLog.h"
+#include "TqcUtils.h"
+#include "TqcTrace.h"
+
+// One buffer per thread. Only the owning thread writes events, the dump reads up to nCount.
+typedef struct _stTraceBuffer
+{
+    int                 tid;
+    stTraceEvent        *pEvents;
+    std::atomic<int>    nCount;
+    std::atomic<int>    nDropped;
+} stTraceBuffer;
+
+bool g_bTraceEnabled = false;
+
+static TQC_THREAD_LOCAL stTraceBuffer   *g_pThreadBuffer = NULL;
+static std::vector<stTraceBuffer*>      g_traceBuffers;
+static CLock                            g_traceLock;
+
+void TqcTraceEnable(bool bEnable)
+{
+    g_bTraceEnabled = bEnable;
+}
+
+TqcTick TqcTraceNow()
+{
+    return cv::getTickCount();
+}
+
+// Registering a new thread takes the lock once, every later event is lock-free.
+static stTraceBuffer* GetThreadBuffer()
+{
+    if (!g_pThreadBuffer)
+    {
+        stTraceBuffer *pBuffer = new stTraceBuffer;
+
+        pBuffer->pEvents  = new stTraceEvent[TQC_TRACE_BUFFER_SIZE];
+        pBuffer->nCount   = 0;
+        pBuffer->nDropped = 0;
+
+        g_traceLock.Lock();
+        pBuffer->tid = (int)g_traceBuffers.size() + 1;
+        g_traceBuffers.push_back(pBuffer);
+        g_traceLock.UnLock();
+
+        g_pThreadBuffer = pBuffer;
+    }
+
+    return g_pThreadBuffer;
+}
+
+void TqcTraceRecord(const char *name, TqcTick tStart, TqcTick tEnd)
+{
+    stTraceBuffer *pBuffer = GetThreadBuffer();
+    int           n        = pBuffer->nCount.load(std::memory_order_relaxed);
+
+    if (n >= TQC_TRACE_BUFFER_SIZE)
+    {
+        pBuffer->nDropped++;
+        return;
+    }
+
+    pBuffer->pEvents[n].name   = name;
+    pBuffer->pEvents[n].tStart = tStart;
+    pBuffer->pEvents[n].tEnd   = tEnd;
+    pBuffer->nCount.store(n + 1, std::memory_order_release);
+}
+
+static double TickToMicroSeconds(TqcTick t)
+{
+    return t * 1000000. / cv::getTickFrequency();
+}
+
+// Chrome trace_event JSON, open it in chrome://tracing or Perfetto.
+bool TqcTraceDump(const char *strJsonFile)
+{
+    FILE    *fp     = fopen(strJsonFile, "w");
+    bool    bFirst  = true;
+    TqcTick tOrigin = 0;
+
+    if (!fp)
+    {
+        LOGE("%s(%d): cannot open file %s", __FUNCTION__, __LINE__, strJsonFile);
+        return false;
+    }
+
+    g_traceLock.Lock();
+
+    // Timestamps start at the earliest event so they stay readable. Events are stored when their
+    // scope ends, so the first one of a buffer is not necessarily the one that started first.
+    for (size_t i = 0; i < g_traceBuffers.size(); i++)
+    {
+        stTraceBuffer *pBuffer = g_traceBuffers[i];
+        int           nCount   = pBuffer->nCount.load(std::memory_order_acquire);
+
+        for (int k = 0; k < nCount; k++)
+        {
+            if (!tOrigin || pBuffer->pEvents[k].tStart < tOrigin)
+                tOrigin = pBuffer->pEvents[k].tStart;
+        }
+    }
+
+    fprintf(fp, "{\"traceEvents\":[\n");
+    for (size_t i = 0; i < g_traceBuffers.size(); i++)
+    {
+        stTraceBuffer *pBuffer = g_traceBuffers[i];
+        int           nCount   = pBuffer->nCount.load(std::memory_order_acquire);
+
+        for (int k = 0; k < nCount; k++)
+        {
+            const stTraceEvent &e = pBuffer->pEvents[k];
+
+            fprintf(fp, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    bFirst ? "" : ",\n", e.name, pBuffer->tid,
+                    TickToMicroSeconds(e.tStart - tOrigin), TickToMicroSeconds(e.tEnd - e.tStart));
+            bFirst = false;
+        }
+
+        if (pBuffer->nDropped > 0)
+        {
+            LOGE("%s(%d): thread %d dropped %d events.", __FUNCTION__, __LINE__, pBuffer->tid, (int)pBuffer->nDropped);
+        }
+    }
+    fprintf(fp, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+    g_traceLock.UnLock();
+
+    fclose(fp);
+
+    return true;
+}
+
+// Drop every recorded event, e.g. after a warm-up. No thread may be recording at the same time.
+void TqcTraceReset()
+{
+    g_traceLock.Lock();
+    for (size_t i = 0; i < g_traceBuffers.size(); i++)
+    {
+        g_traceBuffers[i]->nCount   = 0;
+        g_traceBuffers[i]->nDropped = 0;
+    }
+    g_traceLock.UnLock();
+}
+
+// Durations in ms of every stage, sorted ascending.
+void TqcTraceCollect(TqcTraceStages &stages)
+{
+    g_traceLock.Lock();
+    for (size_t i = 0; i < g_traceBuffers.size(); i++)
+    {
+        stTraceBuffer *pBuffer = g_traceBuffers[i];
+        int           nCount   = pBuffer->nCount.load(std::memory_order_acquire);
+
+        for (int k = 0; k < nCount; k++)
+        {
+            const stTraceEvent &e = pBuffer->pEvents[k];
+            stages[e.name].push_back(TickToMicroSeconds(e.tEnd - e.tStart) / 1000.);
+        }
+    }
+    g_traceLock.UnLock();
+
+    for (TqcTraceStages::iterator it = stages.begin(); it != stages.end(); ++it)
+    {
+        std::sort(it->second.begin(), it->second.end());
+    }
+}
+
+// min/avg/p50/p99 of every stage in ms, on the log and, if strFile is given, appended to it.
+void TqcTraceSummary(const char *strFile)
+{
+    TqcTraceStages stages;
+    FILE *fp = strFile ? fopen(strFile, "a+") : NULL;
+
+    TqcTraceCollect(stages);
+
+    for (TqcTraceStages::iterator it = stages.begin(); it != stages.end(); ++it)
+    {
+        std::vector<double> &v = it->second;
+        double              sum = 0;
+
+        for (size_t k = 0; k < v.size(); k++)
+            sum += v[k];
+
+        double p50 = v[(v.size() - 1) * 50 / 100];
+        double p99 = v[(v.size() - 1) * 99 / 100];
+
+        LOGE("%-20s n=%6d min=%8.3fms avg=%8.3fms p50=%8.3fms p99=%8.3fms",
+             it->first.c_str(), (int)v.size(), v.front(), sum / v.size(), p50, p99);
+        if (fp)
+        {
+            fprintf(fp, "%-20s n=%6d min=%8.3fms avg=%8.3fms p50=%8.3fms p99=%8.3fms\n",
+                    it->first.c_str(), (int)v.size(), v.front(), sum / v.size(), p50, p99);
+        }
+    }
+
+    if (fp)
+    {
+        fclose(fp);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,73 @@
+/**
+@ TqcTrace.h
+@ scoped stage timers with Chrome trace export.
+*/
+
+#ifndef __TQC_TRACE_H
+#define __TQC_TRACE_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+// Compile the timers in. They still do nothing until TqcTraceEnable(true) is called.
+#ifndef TQC_TRACE
+#define TQC_TRACE 1
+#endif
+
+// Events kept per thread. Once a buffer is full new events are counted as dropped.
+#define TQC_TRACE_BUFFER_SIZE 65536
+
+typedef long long TqcTick;
+
+typedef struct _stTraceEvent
+{
+    const char *name;   // Must be a string literal, only the pointer is stored.
+    TqcTick    tStart;
+    TqcTick    tEnd;
+} stTraceEvent;
+
+// Stage name -> durations in ms.
+typedef std::map<std::string, std::vector<double> > TqcTraceStages;
+
+extern bool g_bTraceEnabled;
+
+void    TqcTraceEnable(bool bEnable);
+TqcTick TqcTraceNow();
+void    TqcTraceRecord(const char *name, TqcTick tStart, TqcTick tEnd);
+void    TqcTraceReset();
+void    TqcTraceCollect(TqcTraceStages &stages);
+bool    TqcTraceDump(const char *strJsonFile);
+void    TqcTraceSummary(const char *strFile);
+
+
+// Records the time between construction and destruction as one trace event.
+class CTqcScopedTrace
+{
+public:
+    explicit CTqcScopedTrace(const char *name)
+        : m_name(name), m_tStart(g_bTraceEnabled ? TqcTraceNow() : 0)
+    {
+    }
+
+    ~CTqcScopedTrace()
+    {
+        if (m_tStart)
+            TqcTraceRecord(m_name, m_tStart, TqcTraceNow());
+    }
+
+private:
+    const char *m_name;
+    TqcTick    m_tStart;
+};
+
+#define TQC_TRACE_CONCAT2(a, b) a##b
+#define TQC_TRACE_CONCAT(a, b)  TQC_TRACE_CONCAT2(a, b)
+
+#if TQC_TRACE
+#define TQC_TRACE_SCOPE(name)   CTqcScopedTrace TQC_TRACE_CONCAT(tqcTrace_, __LINE__)(name)
+#else
+#define TQC_TRACE_SCOPE(name)
+#endif
+
+#endif /* __TQC_TRACE_H */
\ No newline at end of file
@@ -0,0 +1,17 @@
+/**
+@ TqcLinuxOs.cpp
+@ OS API wrapper, POSIX backend for desktop Linux and Linux boards.
+*/
+
+#include <time.h>
+
+#include "TqcPosixOs.h"
+
+unsigned int TqcOsGetMicroSeconds(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (unsigned int)(ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000);
+}
\ No newline at end of file
@@ -7,14 +7,31 @@
 #ifndef __OS_H
 #define __OS_H
 
+#if defined(_MSC_VER)
+#define TQC_THREAD_LOCAL __declspec(thread)
+#else
+#define TQC_THREAD_LOCAL __thread
+#endif
+
 typedef void* LockerHandle;
+typedef void* SemaphoreHandle;
 
 void*           TqcOsCreateThread(void *threadMain, void *pThread);
+void            TqcOsJoinThread(void *handle);
 void            TqcOsSleep(int millisecond);
 LockerHandle    TqcOsCreateMutex();
 void            TqcOsDeleteMutex(LockerHandle handle);
 bool            TqcOsAcquireMutex(LockerHandle handle);
 void            TqcOsReleaseMutex(LockerHandle handle);
+SemaphoreHandle TqcOsCreateSemaphore(int nInitialCount);
+void            TqcOsDeleteSemaphore(SemaphoreHandle handle);
+void            TqcOsWaitSemaphore(SemaphoreHandle handle);
+void            TqcOsPostSemaphore(SemaphoreHandle handle, int nCount);
+int             TqcOsGetCpuCount(void);
+bool            TqcOsSetThreadAffinity(int nCpu);
 unsigned int    TqcOsGetMicroSeconds(void);
+void*           TqcOsMapFile(const char *strFile, long long *pSize);
+void            TqcOsUnmapFile(void *pData, long long size);
+long long       TqcOsGetPeakMemory(void);
 
 #endif /* __OS_H */
\ No newline at end of file
@@ -0,0 +1,166 @@
+/**
+@ TqcPosixOs.h
+@ OS API wrapper, the part shared by the POSIX backends (Linux, Android). Each backend includes it
+@ once and adds what differs, e.g. the clock of TqcOsGetMicroSeconds().
+*/
+
+#ifndef __TQC_POSIX_OS_H
+#define __TQC_POSIX_OS_H
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <fcntl.h>
+
+#include "TqcOs.h"
+
+typedef void* (*pfnPosixThreadDecl)(void*);
+
+void* TqcOsCreateThread(void *threadMain, void *pThread)
+{
+    pthread_t handle;
+    if (pthread_create(&handle, NULL, (pfnPosixThreadDecl)threadMain, (void*)pThread) != 0)
+        return NULL;
+
+    return (void*)handle;
+}
+
+void TqcOsJoinThread(void *handle)
+{
+    if (!handle)
+        return;
+
+    pthread_join((pthread_t)handle, NULL);
+}
+
+void TqcOsSleep(int millisecond)
+{
+    usleep(1000 * millisecond);
+}
+
+LockerHandle TqcOsCreateMutex()
+{
+    pthread_mutex_t *mutex = new pthread_mutex_t;
+    if (pthread_mutex_init(mutex, NULL) != 0)
+    {
+        delete mutex;
+        return 0;
+    }
+
+    return (LockerHandle)mutex;
+}
+
+void TqcOsDeleteMutex(LockerHandle handle)
+{
+    pthread_mutex_destroy((pthread_mutex_t*)handle);
+    delete (pthread_mutex_t*)handle;
+}
+
+bool TqcOsAcquireMutex(LockerHandle handle)
+{
+    pthread_mutex_lock((pthread_mutex_t*)handle);
+    return true;
+}
+
+void TqcOsReleaseMutex(LockerHandle handle)
+{
+    pthread_mutex_unlock((pthread_mutex_t*)handle);
+}
+
+SemaphoreHandle TqcOsCreateSemaphore(int nInitialCount)
+{
+    sem_t *sem = new sem_t;
+    if (sem_init(sem, 0, nInitialCount) != 0)
+    {
+        delete sem;
+        return 0;
+    }
+
+    return (SemaphoreHandle)sem;
+}
+
+void TqcOsDeleteSemaphore(SemaphoreHandle handle)
+{
+    sem_destroy((sem_t*)handle);
+    delete (sem_t*)handle;
+}
+
+void TqcOsWaitSemaphore(SemaphoreHandle handle)
+{
+    while (sem_wait((sem_t*)handle) != 0 && errno == EINTR)
+        ;
+}
+
+void TqcOsPostSemaphore(SemaphoreHandle handle, int nCount)
+{
+    for (int i = 0; i < nCount; i++)
+        sem_post((sem_t*)handle);
+}
+
+int TqcOsGetCpuCount(void)
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+}
+
+// Pin the calling thread to one CPU, pid 0 is the calling thread for sched_setaffinity().
+bool TqcOsSetThreadAffinity(int nCpu)
+{
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(nCpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+void* TqcOsMapFile(const char *strFile, long long *pSize)
+{
+    struct stat st;
+    void        *pData;
+    int         fd = open(strFile, O_RDONLY);
+
+    if (fd < 0)
+        return NULL;
+
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    pData = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (pData == MAP_FAILED)
+        return NULL;
+
+    if (pSize)
+        *pSize = st.st_size;
+
+    return pData;
+}
+
+void TqcOsUnmapFile(void *pData, long long size)
+{
+    if (pData)
+        munmap(pData, size);
+}
+
+// Peak resident set of the process in bytes, ru_maxrss is in KB on Linux.
+long long TqcOsGetPeakMemory(void)
+{
+    struct rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+
+    return (long long)usage.ru_maxrss * 1024;
+}
+
+#endif /* __TQC_POSIX_OS_H */
\ No newline at end of file
@@ -5,14 +5,26 @@
 */
 
 #include <Windows.h>
+#include <Psapi.h>
 #include "TqcOs.h"
 
+#pragma comment(lib, "psapi.lib")
+
 void* TqcOsCreateThread(void *threadMain, void *pThread)
 {
     HANDLE handle = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)threadMain, (void*)pThread, 0, NULL);
     return handle;
 }
 
+void TqcOsJoinThread(void *handle)
+{
+    if (!handle)
+        return;
+
+    WaitForSingleObject((HANDLE)handle, INFINITE);
+    CloseHandle((HANDLE)handle);
+}
+
 void TqcOsSleep(int millisecond)
 {
     Sleep(millisecond);
@@ -42,6 +54,41 @@ void TqcOsReleaseMutex(LockerHandle handle)
     LeaveCriticalSection(LPCRITICAL_SECTION(handle));
 }
 
+SemaphoreHandle TqcOsCreateSemaphore(int nInitialCount)
+{
+    return (SemaphoreHandle)CreateSemaphore(NULL, nInitialCount, LONG_MAX, NULL);
+}
+
+void TqcOsDeleteSemaphore(SemaphoreHandle handle)
+{
+    if (handle)
+        CloseHandle((HANDLE)handle);
+}
+
+void TqcOsWaitSemaphore(SemaphoreHandle handle)
+{
+    WaitForSingleObject((HANDLE)handle, INFINITE);
+}
+
+void TqcOsPostSemaphore(SemaphoreHandle handle, int nCount)
+{
+    ReleaseSemaphore((HANDLE)handle, nCount, NULL);
+}
+
+int TqcOsGetCpuCount(void)
+{
+    SYSTEM_INFO info;
+
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+}
+
+// Pin the calling thread to one logical CPU.
+bool TqcOsSetThreadAffinity(int nCpu)
+{
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << nCpu) != 0;
+}
+
 unsigned int TqcOsGetMicroSeconds(void)
 {
     LARGE_INTEGER   t1;
@@ -54,4 +101,53 @@ unsigned int TqcOsGetMicroSeconds(void)
     time = (unsigned int)(((double)t1.QuadPart / (double)tc.QuadPart) * 1000000);
 
     return time;
+}
+
+// Map a whole file read-only. The view keeps the mapping alive, so both handles can be closed.
+void* TqcOsMapFile(const char *strFile, long long *pSize)
+{
+    HANDLE          hFile;
+    HANDLE          hMap;
+    LARGE_INTEGER   size;
+    void            *pData = NULL;
+
+    hFile = CreateFileA(strFile, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return NULL;
+
+    if (!GetFileSizeEx(hFile, &size) || size.QuadPart == 0)
+    {
+        CloseHandle(hFile);
+        return NULL;
+    }
+
+    hMap = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (hMap)
+    {
+        pData = MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(hMap);
+    }
+    CloseHandle(hFile);
+
+    if (pData && pSize)
+        *pSize = size.QuadPart;
+
+    return pData;
+}
+
+void TqcOsUnmapFile(void *pData, long long size)
+{
+    if (pData)
+        UnmapViewOfFile(pData);
+}
+
+// Peak working set of the process in bytes.
+long long TqcOsGetPeakMemory(void)
+{
+    PROCESS_MEMORY_COUNTERS pmc;
+
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+        return 0;
+
+    return (long long)pmc.PeakWorkingSetSize;
 }
\ No newline at end of file
@@ -11,6 +11,55 @@
 #define TQC_SAD_WINDOW_SIZE 5
 #endif
 
+// Number of aggregation paths of the census SGM matcher, 4 or 8.
+#ifndef TQC_CENSUS_SGM_PATHS
+#define TQC_CENSUS_SGM_PATHS 8
+#endif
+
+// Pyramid matcher: levels below full resolution, the coarsest one is matched over the full range.
+#ifndef TQC_PYRAMID_LEVELS
+#define TQC_PYRAMID_LEVELS 2
+#endif
+
+// Pyramid matcher: finer levels search +-radius pixels around the upsampled coarse disparity.
+#ifndef TQC_PYRAMID_REFINE_RADIUS
+#define TQC_PYRAMID_REFINE_RADIUS 2
+#endif
+
+// Temporal mode: full match every this many frames, the frames between search around the previous one.
+#ifndef TQC_TEMPORAL_REFRESH
+#define TQC_TEMPORAL_REFRESH 30
+#endif
+
+// Temporal mode: pixels search +-radius around their previous disparity.
+#ifndef TQC_TEMPORAL_RADIUS
+#define TQC_TEMPORAL_RADIUS 2
+#endif
+
+// Temporal mode: a frame where more than this percentage of the pixels lose track gets a full match.
+#ifndef TQC_TEMPORAL_MAX_FALLBACK
+#define TQC_TEMPORAL_MAX_FALLBACK 10
+#endif
+
+// Smallest row band of the parallel rectification.
+#ifndef TQC_REMAP_BAND_ROWS
+#define TQC_REMAP_BAND_ROWS 16
+#endif
+
+// Tiled SGBM: rows every strip matches above and below its own rows, on top of half the block size.
+#ifndef TQC_SGBM_TILE_OVERLAP
+#define TQC_SGBM_TILE_OVERLAP 16
+#endif
+
+// Cache rectification maps on disk, keyed by a hash of the calibration files, scale and size.
+#ifndef TQC_CAM_PARAM_CACHE
+#define TQC_CAM_PARAM_CACHE 1
+#endif
+
+#ifndef TQC_CAM_PARAM_CACHE_DIR
+#define TQC_CAM_PARAM_CACHE_DIR "."
+#endif
+
 // Image scale, 1.0 means no scale.
 #ifndef TQC_IMAGE_SCALE
 #define TQC_IMAGE_SCALE 1.0f
@@ -21,6 +70,16 @@
 #define TQC_STEREO_CULL 1
 #endif
 
+// Integer-only resize, depth and copter grid (--fixed-point). On by default on Android, whose
+// boards are slow at double math.
+#ifndef TQC_FIXED_POINT
+#ifdef ANDROID
+#define TQC_FIXED_POINT 1
+#else
+#define TQC_FIXED_POINT 0
+#endif
+#endif
+
 // Enable filter depth value if value > some value.
 #ifndef TQC_FILTER_DEPTH_VALUE
 #define TQC_FILTER_DEPTH_VALUE 0
@@ -47,6 +106,11 @@
 #endif
 #endif
 
+// Add the rectified left image's color to every point of the PLY point cloud.
+#ifndef TQC_PLY_WITH_COLOR
+#define TQC_PLY_WITH_COLOR 1
+#endif
+
 // Save disparity values as gray image file and color file.
 #ifndef TQC_OUTPUT_DISP_TO_IMAGE
 #define TQC_OUTPUT_DISP_TO_IMAGE 1
@@ -104,6 +168,22 @@
 #define TQC_VIRTUAL_COPTER_BOTTOM (TQC_STEREO_CAMERA_HEIGHT / 2 + TQC_VIRTUAL_COPTER_Y_SIZE / 2)
 #endif
 
+// Extra rows/columns rectified and matched around the virtual copter window in ROI-only mode,
+// so the block window and the aggregation paths see some context.
+#ifndef TQC_VIRTUAL_COPTER_ROI_MARGIN
+#define TQC_VIRTUAL_COPTER_ROI_MARGIN 8
+#endif
+
+// Obstacle check: anything closer than this (mm) in a copter cell is reported as a hit.
+#ifndef TQC_OBSTACLE_DEPTH
+#define TQC_OBSTACLE_DEPTH 2000.0
+#endif
+
+// Pixels inside the disparity band a copter cell needs before it counts as hit.
+#ifndef TQC_OBSTACLE_MIN_PIXELS
+#define TQC_OBSTACLE_MIN_PIXELS 8
+#endif
+
 #define TQC_VIRTUAL_COPTER_X_SPLITE 3
 #define TQC_VIRTUAL_COPTER_Y_SPLITE TQC_VIRTUAL_COPTER_X_SPLITE
 #define TQC_VIRTUAL_COPTER_SUB_X    TQC_VIRTUAL_COPTER_X_SIZE / 3
@@ -0,0 +1,658 @@
+/**
+@ StereoBench.cpp
+@ matcher benchmark over the bundled or synthetic data sets, writes a JSON report to compare releases.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <new>
+#include <vector>
+#include <atomic>
+
+#include "opencv2/imgproc/imgproc.hpp"
+#include "opencv2/imgcodecs.hpp"
+#include "opencv2/core/utility.hpp"
+
+#include "TqcLog.h"
+#include "TqcUtils.h"
+#include "TqcOs.h"
+#include "TqcTrace.h"
+#include "Config.h"
+#include "StereoCamera.h"
+#include "StereoMatchAlgorithm.h"
+#include "StereoKernels.h"
+#include "StereoUtils.h"
+#include "StereoDispFile.h"
+#include "StereoSynth.h"
+
+using namespace cv;
+using namespace std;
+
+// Defaults when --data/--report= are not given, relative to Windows/<project> like StereoVisionCmd.txt.
+#define TQC_BENCH_DATA_PATH     "../../Data"
+#define TQC_BENCH_REPORT_FILE   "StereoBench.json"
+
+
+// One calibrated data set of videoLeft_*/videoRight_* pairs. The recordings are split into
+// scene directories, a StereoSynth output is flat and has a ground-truth disparity file.
+typedef struct _stBenchDataSet
+{
+    const char *strDir;
+    const char *strIntrinsicFile;
+    const char *strExtrinsicFile;
+    const char *strGroundTruthFile;
+} stBenchDataSet;
+
+// Decoded pair, both layouts are kept so no conversion is timed.
+typedef struct _stBenchPair
+{
+    Mat color1, color2;
+    Mat gray1, gray2;
+    Mat gt;                 // CV_16S x16, empty without ground truth.
+} stBenchPair;
+
+typedef struct _stBenchSet
+{
+    const stBenchDataSet *pDataSet;
+    char                 strRoot[TQC_MAX_PATH];
+    Size                 imgSize;
+    stCamParam           camParam;
+    vector<stBenchPair>  pairs;
+} stBenchSet;
+
+
+static const stBenchDataSet g_dataSets[] =
+{
+    { "new_320x240_20160622", "Logitech_intrinsics_320x240.yml", "Logitech_extrinsics_320x240.yml", NULL },
+    { "old_640x480",          "Logitech_intrinsics_640x480.yml", "Logitech_extrinsics_640x480.yml", NULL },
+};
+
+static const stBenchDataSet g_synthDataSet =
+{
+    "synthetic", TQC_SYNTH_INTRINSIC_FILE, TQC_SYNTH_EXTRINSIC_FILE, TQC_SYNTH_GT_FILE
+};
+
+static const char *g_scenes[] = { "outdoor", "room" };
+
+static const enAlgorithm g_algorithms[] =
+{
+    TQC_STEREO_BM, TQC_STEREO_SGBM, TQC_STEREO_HH, TQC_STEREO_CENSUS_SGM, TQC_STEREO_PYRAMID,
+    TQC_STEREO_STREAM_SGM, TQC_STEREO_SAD, TQC_STEREO_ZSAD
+};
+
+static const char *g_algorithmNames[] =
+{
+    TQC_ALGORITHM_NAME_BM, TQC_ALGORITHM_NAME_SGBM, TQC_ALGORITHM_NAME_HH, TQC_ALGORITHM_NAME_CENSUS, TQC_ALGORITHM_NAME_PYRAMID,
+    TQC_ALGORITHM_NAME_STREAM, TQC_ALGORITHM_NAME_SAD, TQC_ALGORITHM_NAME_ZSAD
+};
+
+// Heap allocations made through operator new. OpenCV allocates Mat buffers with its own
+// fastMalloc, those are not seen here, so the count covers the STL containers of our code.
+static std::atomic<long long> g_nAllocations(0);
+
+void* operator new(size_t size)
+{
+    void *p = malloc(size ? size : 1);
+
+    if (!p)
+        throw std::bad_alloc();
+
+    g_nAllocations++;
+    return p;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *p) throw()
+{
+    free(p);
+}
+
+void operator delete[](void *p) throw()
+{
+    free(p);
+}
+
+
+static void LoadPairs(const char *strDir, stBenchSet &set)
+{
+    char           pattern[TQC_MAX_PATH];
+    vector<String> leftFiles;
+
+    sprintf(pattern, "%s/videoLeft_*", strDir);
+    glob(pattern, leftFiles, false);
+
+    for (size_t k = 0; k < leftFiles.size(); k++)
+    {
+        String      rightFile = leftFiles[k];
+        size_t      pos       = rightFile.rfind("videoLeft_");
+        stBenchPair pair;
+
+        rightFile = rightFile.substr(0, pos) + "videoRight_" + rightFile.substr(pos + strlen("videoLeft_"));
+
+        pair.color1 = imread(leftFiles[k], IMREAD_COLOR);
+        pair.color2 = imread(rightFile, IMREAD_COLOR);
+        if (set.pairs.empty() && !pair.color1.empty())
+        {
+            set.imgSize = pair.color1.size();
+        }
+
+        if (pair.color1.empty() || pair.color2.empty() || pair.color1.size() != set.imgSize || pair.color2.size() != set.imgSize)
+        {
+            LOGE("%s(%d): skip pair %s.", __FUNCTION__, __LINE__, leftFiles[k].c_str());
+            continue;
+        }
+
+        cvtColor(pair.color1, pair.gray1, COLOR_BGR2GRAY);
+        cvtColor(pair.color2, pair.gray2, COLOR_BGR2GRAY);
+        set.pairs.push_back(pair);
+    }
+}
+
+// Ground-truth frames are stored in pair order, see StereoSynth.
+static bool LoadGroundTruth(stBenchSet &set)
+{
+    CDispFileReader reader;
+    char            buf[TQC_MAX_PATH];
+
+    sprintf(buf, "%s/%s", set.strRoot, set.pDataSet->strGroundTruthFile);
+    if (!reader.Open(buf) || reader.GetFrameCount() != (int)set.pairs.size())
+    {
+        LOGE("%s(%d): %s doesn't match the %d pairs.", __FUNCTION__, __LINE__, buf, (int)set.pairs.size());
+        return false;
+    }
+
+    for (size_t k = 0; k < set.pairs.size(); k++)
+    {
+        Mat gt;
+
+        if (!reader.GetFrame((int)k, gt))
+        {
+            return false;
+        }
+        set.pairs[k].gt = gt.clone();
+    }
+
+    return true;
+}
+
+static bool LoadDataSet(stBenchSet &set)
+{
+    const stBenchDataSet &dataSet = *set.pDataSet;
+    char                 intrinsicFile[TQC_MAX_PATH];
+    char                 extrinsicFile[TQC_MAX_PATH];
+
+    if (dataSet.strGroundTruthFile)
+    {
+        LoadPairs(set.strRoot, set);
+    }
+    else
+    {
+        for (size_t i = 0; i < sizeof(g_scenes) / sizeof(g_scenes[0]); i++)
+        {
+            char strDir[TQC_MAX_PATH];
+
+            sprintf(strDir, "%s/%s", set.strRoot, g_scenes[i]);
+            LoadPairs(strDir, set);
+        }
+    }
+
+    if (set.pairs.empty())
+    {
+        LOGE("%s(%d): no stereo pair under %s.", __FUNCTION__, __LINE__, set.strRoot);
+        return false;
+    }
+
+    if (dataSet.strGroundTruthFile && !LoadGroundTruth(set))
+    {
+        return false;
+    }
+
+    sprintf(intrinsicFile, "%s/%s", set.strRoot, dataSet.strIntrinsicFile);
+    sprintf(extrinsicFile, "%s/%s", set.strRoot, dataSet.strExtrinsicFile);
+
+    if (!StereoLoadCamParam(intrinsicFile, extrinsicFile, g_option.fScale, set.imgSize, set.imgSize, &set.camParam))
+    {
+        LOGE("%s(%d): cannot load camera's parameters(%s, %s).", __FUNCTION__, __LINE__, intrinsicFile, extrinsicFile);
+        return false;
+    }
+
+    return true;
+}
+
+// Same per-frame work as StereoMatch, without decoding and file output.
+static bool MatchFrame(CStereoMatcher &matcher, const stCamParam &camParam, const Mat &left, const Mat &right, Mat &disp)
+{
+    double d[3][3];
+
+    bool bMatched = g_option.bRoiOnly ?
+                    matcher.MatchRoi(left, right, g_option.fScale, disp) :
+                    matcher.Match(left, right, g_option.fScale, disp);
+    if (!bMatched)
+    {
+        return false;
+    }
+
+#if TQC_FILTER_DEPTH_VALUE
+    StereoFilterDisp(disp, camParam.depthLut, matcher.IsFixedPoint());
+#endif
+
+    StereoGetDisp8FromDisp(disp, matcher.GetParam().selector, matcher.GetParam().nNumDisparities);
+    StereoCalcDepthOfVirtualCopter(disp, camParam.depthLut, d, matcher.IsFixedPoint());
+
+    return true;
+}
+
+// Pixels off by more than one disparity, and pixels the matcher left invalid, over the pixels
+// with a valid ground truth.
+static void ScoreDisp(const Mat &disp, const Mat &gt, long long &nValid, long long &nBad, long long &nInvalid)
+{
+    for (int y = 0; y < gt.rows; y++)
+    {
+        const short *pDisp = disp.ptr<short>(y);
+        const short *pGt   = gt.ptr<short>(y);
+
+        for (int x = 0; x < gt.cols; x++)
+        {
+            if (pGt[x] < 0)
+                continue;
+
+            nValid++;
+            if (pDisp[x] < 0)
+                nInvalid++;
+            else if (abs(pDisp[x] - pGt[x]) > 16)
+                nBad++;
+        }
+    }
+}
+
+// Pixels where the tiled map and the whole-frame map disagree: valid in only one of them, or off by
+// more than one disparity.
+static void CompareDisp(const Mat &disp, const Mat &ref, long long &nPixels, long long &nMismatch)
+{
+    for (int y = 0; y < ref.rows; y++)
+    {
+        const short *pDisp = disp.ptr<short>(y);
+        const short *pRef  = ref.ptr<short>(y);
+
+        for (int x = 0; x < ref.cols; x++)
+        {
+            nPixels++;
+            if ((pDisp[x] < 0) != (pRef[x] < 0) || (pRef[x] >= 0 && abs(pDisp[x] - pRef[x]) > 16))
+                nMismatch++;
+        }
+    }
+}
+
+// Copter grid of the integer path against the float one on the same disparity. Every cell has to
+// be the float cell rounded half up, anything else is counted in nGridMismatch.
+static void CompareGrid(const Mat &disp, const stDepthLut &lut, double &dMaxError, long long &nGridMismatch)
+{
+    double d[3][3];
+    double ref[3][3];
+
+    StereoCalcDepthOfVirtualCopter(disp, lut, d, true);
+    StereoCalcDepthOfVirtualCopter(disp, lut, ref, false);
+
+    for (int j = 0; j < TQC_VIRTUAL_COPTER_Y_SPLITE; j++)
+    {
+        for (int i = 0; i < TQC_VIRTUAL_COPTER_X_SPLITE; i++)
+        {
+            dMaxError = max(dMaxError, fabs(d[j][i] - ref[j][i]));
+            if (d[j][i] != (int)(ref[j][i] + 0.5))
+                nGridMismatch++;
+        }
+    }
+}
+
+static void WriteStages(FILE *fp, TqcTraceStages &stages)
+{
+    bool bFirst = true;
+
+    fprintf(fp, "      \"stages\": {\n");
+    for (TqcTraceStages::iterator it = stages.begin(); it != stages.end(); ++it)
+    {
+        const vector<double> &v  = it->second;
+        double               sum = 0;
+
+        for (size_t k = 0; k < v.size(); k++)
+            sum += v[k];
+
+        fprintf(fp, "%s        \"%s\": {\"n\": %d, \"min\": %.3f, \"avg\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f}",
+                bFirst ? "" : ",\n", it->first.c_str(), (int)v.size(), v.front(), sum / v.size(),
+                v[(v.size() - 1) * 50 / 100], v[(v.size() - 1) * 90 / 100], v[(v.size() - 1) * 99 / 100], v.back());
+        bFirst = false;
+    }
+    fprintf(fp, "\n      }\n");
+}
+
+// Warm up, then time nIterations passes over every pair of the set. Stage times are in ms.
+static bool RunBench(FILE *fp, bool bFirst, stBenchSet &set, enAlgorithm algorithm, const char *strAlgorithmName)
+{
+    CStereoMatcher matcher;
+    TqcTraceStages stages;
+    Mat            disp;
+    bool           bGray      = (algorithm == TQC_STEREO_BM || algorithm == TQC_STEREO_CENSUS_SGM || algorithm == TQC_STEREO_PYRAMID ||
+                                 algorithm == TQC_STEREO_STREAM_SGM || algorithm == TQC_STEREO_SAD || algorithm == TQC_STEREO_ZSAD);
+    bool           bGrayRemap = g_option.bGrayRemap && (algorithm == TQC_STEREO_SGBM || algorithm == TQC_STEREO_HH);
+    int            nChannels  = bGray || bGrayRemap ? 1 : 3;
+    int            nFrames    = 0;
+
+    if (!matcher.Init(nChannels,
+                      set.camParam.roi1,
+                      set.camParam.roi2,
+                      g_option.nNumDisparities,
+                      g_option.nSADWindowSize,
+                      set.imgSize.width,
+                      algorithm))
+    {
+        LOGE("%s(%d): cannot init %s.", __FUNCTION__, __LINE__, strAlgorithmName);
+        return false;
+    }
+
+    matcher.SetCamParam(set.camParam);
+    matcher.SetTiles(g_option.nTiles);
+    matcher.SetFixedPoint(g_option.bFixedPoint);
+
+    TqcTraceEnable(false);
+    for (int n = 0; n < g_option.nWarmup; n++)
+    {
+        for (size_t k = 0; k < set.pairs.size(); k++)
+        {
+            const stBenchPair &pair = set.pairs[k];
+
+            if (!MatchFrame(matcher, set.camParam, bGray ? pair.gray1 : pair.color1, bGray ? pair.gray2 : pair.color2, disp))
+            {
+                LOGE("%s(%d): %s failed on %s.", __FUNCTION__, __LINE__, strAlgorithmName, set.pDataSet->strDir);
+                return false;
+            }
+        }
+    }
+
+    TqcTraceReset();
+    TqcTraceEnable(true);
+
+    long long nAllocations = g_nAllocations;
+    int64     t            = getTickCount();
+
+    for (int n = 0; n < g_option.nIterations; n++)
+    {
+        for (size_t k = 0; k < set.pairs.size(); k++)
+        {
+            const stBenchPair &pair = set.pairs[k];
+            TQC_TRACE_SCOPE("frame");
+
+            // A failed frame would time nothing, stop the run rather than report it.
+            if (!MatchFrame(matcher, set.camParam, bGray ? pair.gray1 : pair.color1, bGray ? pair.gray2 : pair.color2, disp))
+            {
+                LOGE("%s(%d): %s failed on %s.", __FUNCTION__, __LINE__, strAlgorithmName, set.pDataSet->strDir);
+                TqcTraceEnable(false);
+                return false;
+            }
+            nFrames++;
+        }
+    }
+
+    double seconds = (getTickCount() - t) / getTickFrequency();
+
+    nAllocations = g_nAllocations - nAllocations;
+    TqcTraceEnable(false);
+    TqcTraceCollect(stages);
+
+    // Accuracy against the ground truth, outside the timed loop. The filter is skipped here,
+    // it would count far pixels as invalid.
+    long long nValid   = 0;
+    long long nBad     = 0;
+    long long nInvalid = 0;
+
+    for (size_t k = 0; k < set.pairs.size(); k++)
+    {
+        const stBenchPair &pair  = set.pairs[k];
+        const Mat         &left  = bGray ? pair.gray1 : pair.color1;
+        const Mat         &right = bGray ? pair.gray2 : pair.color2;
+
+        if (pair.gt.empty())
+            continue;
+
+        if (!(g_option.bRoiOnly ? matcher.MatchRoi(left, right, g_option.fScale, disp) : matcher.Match(left, right, g_option.fScale, disp)) ||
+            disp.size() != pair.gt.size())
+        {
+            LOGE("%s(%d): %s output doesn't match the ground truth, only --scale=1 can be scored.", __FUNCTION__, __LINE__, strAlgorithmName);
+            nValid = 0;
+            break;
+        }
+
+        ScoreDisp(disp, pair.gt, nValid, nBad, nInvalid);
+    }
+
+    // Tiled SGBM against one whole-frame StereoSGBM on the same pairs.
+    long long nPixels   = 0;
+    long long nMismatch = 0;
+
+    if (g_option.nTiles > 1 && (algorithm == TQC_STEREO_SGBM || algorithm == TQC_STEREO_HH))
+    {
+        CStereoMatcher reference;
+        Mat            refDisp;
+
+        reference.Init(nChannels, set.camParam.roi1, set.camParam.roi2, g_option.nNumDisparities, g_option.nSADWindowSize, set.imgSize.width, algorithm);
+        reference.SetCamParam(set.camParam);
+        reference.SetFixedPoint(g_option.bFixedPoint);
+
+        for (size_t k = 0; k < set.pairs.size(); k++)
+        {
+            const stBenchPair &pair = set.pairs[k];
+
+            if (MatchFrame(matcher, set.camParam, pair.color1, pair.color2, disp) &&
+                MatchFrame(reference, set.camParam, pair.color1, pair.color2, refDisp))
+            {
+                CompareDisp(disp, refDisp, nPixels, nMismatch);
+            }
+        }
+
+        LOGE("%-22s %-7s %d tiles: %.5f of the pixels differ from the whole frame", set.pDataSet->strDir, strAlgorithmName,
+             g_option.nTiles, nPixels ? (double)nMismatch / nPixels : 0.0);
+    }
+
+    // Fixed-point path against the float one: disparity (differs only through the resize of
+    // non-fused scales) and the copter grid.
+    long long nFixedPixels   = 0;
+    long long nFixedMismatch = 0;
+    long long nGridMismatch  = 0;
+    double    dGridMaxError  = 0;
+
+    if (g_option.bFixedPoint)
+    {
+        CStereoMatcher reference;
+        Mat            refDisp;
+
+        reference.Init(nChannels, set.camParam.roi1, set.camParam.roi2, g_option.nNumDisparities, g_option.nSADWindowSize, set.imgSize.width, algorithm);
+        reference.SetCamParam(set.camParam);
+        reference.SetTiles(g_option.nTiles);
+        reference.SetFixedPoint(false);
+
+        for (size_t k = 0; k < set.pairs.size(); k++)
+        {
+            const stBenchPair &pair  = set.pairs[k];
+            const Mat         &left  = bGray ? pair.gray1 : pair.color1;
+            const Mat         &right = bGray ? pair.gray2 : pair.color2;
+
+            if (MatchFrame(matcher, set.camParam, left, right, disp) &&
+                MatchFrame(reference, set.camParam, left, right, refDisp))
+            {
+                CompareDisp(disp, refDisp, nFixedPixels, nFixedMismatch);
+                CompareGrid(disp, set.camParam.depthLut, dGridMaxError, nGridMismatch);
+            }
+        }
+
+        LOGE("%-22s %-7s fixed point: %.5f of the pixels differ, grid within %.3f mm, %lld cells not the rounded float depth",
+             set.pDataSet->strDir, strAlgorithmName, nFixedPixels ? (double)nFixedMismatch / nFixedPixels : 0.0, dGridMaxError, nGridMismatch);
+    }
+
+    // Gray SGBM/HH against the same algorithm on color. Speed: run once with and once without --gray.
+    long long nGrayPixels   = 0;
+    long long nGrayMismatch = 0;
+
+    if (bGrayRemap)
+    {
+        CStereoMatcher reference;
+        Mat            refDisp;
+
+        reference.Init(3, set.camParam.roi1, set.camParam.roi2, g_option.nNumDisparities, g_option.nSADWindowSize, set.imgSize.width, algorithm);
+        reference.SetCamParam(set.camParam);
+        reference.SetTiles(g_option.nTiles);
+        reference.SetFixedPoint(g_option.bFixedPoint);
+
+        for (size_t k = 0; k < set.pairs.size(); k++)
+        {
+            const stBenchPair &pair = set.pairs[k];
+
+            if (MatchFrame(matcher, set.camParam, pair.color1, pair.color2, disp) &&
+                MatchFrame(reference, set.camParam, pair.color1, pair.color2, refDisp))
+            {
+                CompareDisp(disp, refDisp, nGrayPixels, nGrayMismatch);
+            }
+        }
+
+        LOGE("%-22s %-7s gray: %.5f of the pixels differ from the color match", set.pDataSet->strDir, strAlgorithmName,
+             nGrayPixels ? (double)nGrayMismatch / nGrayPixels : 0.0);
+    }
+
+    LOGE("%-22s %-7s %5d frames %8.2f fps", set.pDataSet->strDir, strAlgorithmName, nFrames, nFrames / seconds);
+
+    fprintf(fp, "%s    {\n", bFirst ? "" : ",\n");
+    fprintf(fp, "      \"dataset\": \"%s\",\n", set.pDataSet->strDir);
+    fprintf(fp, "      \"algorithm\": \"%s\",\n", strAlgorithmName);
+    fprintf(fp, "      \"channels\": %d,\n", nChannels);
+    fprintf(fp, "      \"width\": %d,\n", set.imgSize.width);
+    fprintf(fp, "      \"height\": %d,\n", set.imgSize.height);
+    fprintf(fp, "      \"pairs\": %d,\n", (int)set.pairs.size());
+    fprintf(fp, "      \"frames\": %d,\n", nFrames);
+    fprintf(fp, "      \"seconds\": %.3f,\n", seconds);
+    fprintf(fp, "      \"fps\": %.2f,\n", nFrames / seconds);
+    fprintf(fp, "      \"allocs_per_frame\": %.2f,\n", (double)nAllocations / nFrames);
+    if (nValid > 0)
+    {
+        fprintf(fp, "      \"bad_1px\": %.5f,\n", (double)(nBad + nInvalid) / nValid);
+        fprintf(fp, "      \"invalid\": %.5f,\n", (double)nInvalid / nValid);
+    }
+    if (nPixels > 0)
+    {
+        fprintf(fp, "      \"tiles\": %d,\n", g_option.nTiles);
+        fprintf(fp, "      \"tile_mismatch\": %.5f,\n", (double)nMismatch / nPixels);
+    }
+    if (nGrayPixels > 0)
+    {
+        fprintf(fp, "      \"gray_mismatch\": %.5f,\n", (double)nGrayMismatch / nGrayPixels);
+    }
+    if (nFixedPixels > 0)
+    {
+        fprintf(fp, "      \"fixed_point_mismatch\": %.5f,\n", (double)nFixedMismatch / nFixedPixels);
+        fprintf(fp, "      \"fixed_point_grid_error_mm\": %.3f,\n", dGridMaxError);
+        fprintf(fp, "      \"fixed_point_grid_mismatch\": %lld,\n", nGridMismatch);
+    }
+    WriteStages(fp, stages);
+    fprintf(fp, "    }");
+
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    vector<stBenchSet> sets;
+    const char         *strDataPath;
+    const char         *strReportFile;
+    FILE               *fp;
+    bool               bFirst = true;
+    int                nRet   = 0;
+
+    if (argc > 1 && !ParseCmd(argc, argv, g_option))
+    {
+        LOGE("\nUsage: StereoBench [--data <Data directory> | --synthetic <StereoSynth output>] [--report=StereoBench.json]\n"
+             "[--algorithm=bm|sgbm|hh|census|pyramid|stream|sad|zsad]"
+             "[--max-disparity=<max_disparity>] [--blocksize=<block_size>] [--scale=<scale_factor>] [--roi-only]\n"
+             "[--iterations=N] [--warmup=N] [--threads=N] [--affinity] [--tiles=N] [--fixed-point] [--gray]");
+        return -1;
+    }
+
+    if (!StartScheduler(g_option))
+    {
+        return -1;
+    }
+
+    strDataPath   = g_option.strDataPath ? g_option.strDataPath : TQC_BENCH_DATA_PATH;
+    strReportFile = g_option.strReportFile ? g_option.strReportFile : TQC_BENCH_REPORT_FILE;
+
+    // Decode everything once, the timed loops only see pixels in memory.
+    // A synthetic set replaces the recordings, it is meant for resolution/disparity sweeps.
+    for (size_t i = 0; i < (g_option.strSynthPath ? 1 : sizeof(g_dataSets) / sizeof(g_dataSets[0])); i++)
+    {
+        stBenchSet set;
+
+        if (g_option.strSynthPath)
+        {
+            set.pDataSet = &g_synthDataSet;
+            sprintf(set.strRoot, "%s", g_option.strSynthPath);
+        }
+        else
+        {
+            set.pDataSet = &g_dataSets[i];
+            sprintf(set.strRoot, "%s/%s", strDataPath, g_dataSets[i].strDir);
+        }
+
+        if (!LoadDataSet(set))
+        {
+            return -1;
+        }
+        sets.push_back(set);
+    }
+
+    fp = fopen(strReportFile, "w");
+    if (!fp)
+    {
+        LOGE("%s(%d): cannot open file %s", __FUNCTION__, __LINE__, strReportFile);
+        return -1;
+    }
+
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"build\": \"%s %s\",\n", __DATE__, __TIME__);
+    fprintf(fp, "  \"kernels\": \"%s\",\n", TqcCpuLevelName(StereoGetKernels().level));
+    fprintf(fp, "  \"iterations\": %d,\n", g_option.nIterations);
+    fprintf(fp, "  \"warmup\": %d,\n", g_option.nWarmup);
+    fprintf(fp, "  \"max_disparity\": %d,\n", g_option.nNumDisparities);
+    fprintf(fp, "  \"blocksize\": %d,\n", g_option.nSADWindowSize);
+    fprintf(fp, "  \"scale\": %.3f,\n", g_option.fScale);
+    fprintf(fp, "  \"roi_only\": %s,\n", g_option.bRoiOnly ? "true" : "false");
+    fprintf(fp, "  \"runs\": [\n");
+
+    for (size_t i = 0; i < sets.size(); i++)
+    {
+        for (size_t k = 0; k < sizeof(g_algorithms) / sizeof(g_algorithms[0]); k++)
+        {
+            // --algorithm= picks one, otherwise every algorithm is measured.
+            if (g_option.strAlgorithmName && g_option.algorithm != g_algorithms[k])
+                continue;
+
+            if (!RunBench(fp, bFirst, sets[i], g_algorithms[k], g_algorithmNames[k]))
+            {
+                nRet = -1;
+                continue;
+            }
+            bFirst = false;
+        }
+    }
+
+    // Peak RSS is process-wide and only grows, one value for all the runs.
+    fprintf(fp, "\n  ],\n");
+    fprintf(fp, "  \"peak_rss_kb\": %lld\n", TqcOsGetPeakMemory() / 1024);
+    fprintf(fp, "}\n");
+    fclose(fp);
+
+    LOGE("report written to %s", strReportFile);
+
+    return nRet;
+}
\ No newline at end of file
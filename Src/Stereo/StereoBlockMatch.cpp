@@ -0,0 +1,156 @@
+#include <algorithm>
+
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
+
+#include "TqcLog.h"
+#include "StereoBlockMatch.h"
+#include "StereoKernels.h"
+
+// Kernel of the CPU level for the pair, the generic one when none was compiled for it.
+static const stBlockMatchKernel *FindKernel(int nBlock, int nNumDisparities)
+{
+    const stBlockMatchKernel *pKernel = StereoGetKernels().pBlockMatch;
+
+    while (pKernel->nBlock != 0 && (pKernel->nBlock != nBlock || pKernel->nNumDisparities != nNumDisparities))
+    {
+        pKernel++;
+    }
+
+    return pKernel;
+}
+
+CBlockMatcher::CBlockMatcher()
+{
+    m_nNumDisparities    = 16;
+    m_nSADWindowSize     = 5;
+    m_bZeroMean          = false;
+    m_nUniquenessRatio   = 15;
+    m_nSpeckleWindowSize = 100;
+    m_nSpeckleRange      = 32;
+    m_bSpecialized       = false;
+    m_pfnKernel          = NULL;
+}
+
+CBlockMatcher::~CBlockMatcher()
+{
+}
+
+bool CBlockMatcher::Init(int nNumDisparities,
+                         int nSADWindowSize,
+                         bool bZeroMean,
+                         int nUniquenessRatio,
+                         int nSpeckleWindowSize,
+                         int nSpeckleRange)
+{
+    if (nNumDisparities <= 0 || nNumDisparities % 16 != 0)
+    {
+        LOGE("%s(%d): number of disparities(%d) must be a positive multiple of 16.", __FUNCTION__, __LINE__, nNumDisparities);
+        return false;
+    }
+
+    if (nSADWindowSize < 3 || nSADWindowSize > TQC_BLOCK_MATCH_MAX_SIZE || nSADWindowSize % 2 == 0)
+    {
+        LOGE("%s(%d): block size(%d) must be odd and in [3, %d].", __FUNCTION__, __LINE__, nSADWindowSize, TQC_BLOCK_MATCH_MAX_SIZE);
+        return false;
+    }
+
+    m_nNumDisparities    = nNumDisparities;
+    m_nSADWindowSize     = nSADWindowSize;
+    m_bZeroMean          = bZeroMean;
+    m_nUniquenessRatio   = nUniquenessRatio;
+    m_nSpeckleWindowSize = nSpeckleWindowSize;
+    m_nSpeckleRange      = nSpeckleRange;
+
+    const stBlockMatchKernel *pKernel = FindKernel(nSADWindowSize, nNumDisparities);
+
+    m_pfnKernel    = pKernel->pfnKernel;
+    m_bSpecialized = pKernel->nBlock != 0;
+
+    if (!m_bSpecialized)
+    {
+        LOGW("%s(%d): no kernel for block size %d x %d disparities, using the generic one.", __FUNCTION__, __LINE__,
+             nSADWindowSize, nNumDisparities);
+    }
+
+    return true;
+}
+
+bool CBlockMatcher::Compute(const Mat &left, const Mat &right, Mat &disp)
+{
+    if (left.empty() || left.size() != right.size() || left.type() != right.type() || left.depth() != CV_8U)
+    {
+        LOGE("%s(%d): left and right images must be non-empty 8-bit images of the same size.", __FUNCTION__, __LINE__);
+        return false;
+    }
+
+    if (m_pfnKernel == NULL)
+    {
+        LOGE("%s(%d): block matcher is not initialized.", __FUNCTION__, __LINE__);
+        return false;
+    }
+
+    stBlockMatchRows rows;
+    const int        nPadWidth = left.cols + m_nSADWindowSize - 1;
+
+    Prepare(left, m_padLeft);
+    Prepare(right, m_padRight);
+    disp.create(left.size(), CV_16S);
+
+    rows.pLeft            = m_padLeft.ptr<uchar>(0);
+    rows.pRight           = m_padRight.ptr<uchar>(0);
+    rows.nStep            = m_padLeft.step;
+    rows.pDisp            = disp.ptr<short>(0);
+    rows.nDispStep        = disp.step / sizeof(short);
+    rows.nWidth           = left.cols;
+    rows.nHeight          = left.rows;
+    rows.nBlock           = m_nSADWindowSize;
+    rows.nNumDisparities  = m_nNumDisparities;
+    rows.nUniquenessRatio = m_nUniquenessRatio;
+
+    // Every band rebuilds the column sums of its first window, a band should be well above the block height.
+    rows.nBands           = std::max(1, std::min(left.rows / (m_nSADWindowSize * 4), (TqcGetScheduler().GetWorkerCount() + 1) * 2));
+    rows.nBandBuf         = (size_t)m_nNumDisparities * (nPadWidth + left.cols) + (size_t)left.cols * 3;
+
+    if (m_bandBuf.size() < rows.nBandBuf * rows.nBands)
+    {
+        m_bandBuf.resize(rows.nBandBuf * rows.nBands);
+    }
+
+    rows.pBuf             = &m_bandBuf[0];
+
+    TqcGetScheduler().ParallelFor(0, rows.nBands, 1, m_pfnKernel, &rows);
+
+    if (m_nSpeckleWindowSize > 0)
+    {
+        filterSpeckles(disp, TQC_BLOCK_MATCH_INVALID_DISP, m_nSpeckleWindowSize, 16 * m_nSpeckleRange, m_speckleBuf);
+    }
+
+    return true;
+}
+
+// Gray, mean-removed for ZSAD, then padded by block / 2 on every side.
+void CBlockMatcher::Prepare(const Mat &img, Mat &padded)
+{
+    const int hw   = m_nSADWindowSize / 2;
+    Mat       gray = img;
+
+    // m_gray is only ever written, never shares the caller's image.
+    if (img.channels() == 3)
+    {
+        cvtColor(img, m_gray, COLOR_BGR2GRAY);
+        gray = m_gray;
+    }
+
+    // Offset by 128 and saturated to 8 bits like the StereoBM prefilter, so the SAD bound still holds.
+    if (m_bZeroMean)
+    {
+        blur(gray, m_mean, Size(m_nSADWindowSize, m_nSADWindowSize), Point(-1, -1), BORDER_REPLICATE);
+        gray.convertTo(m_zeroMean, CV_16S);
+        subtract(m_zeroMean, m_mean, m_zeroMean, noArray(), CV_16S);
+        m_zeroMean.convertTo(m_gray, CV_8U, 1, 128);
+        gray = m_gray;
+    }
+
+    copyMakeBorder(gray, padded, hw, hw, hw, hw, BORDER_REPLICATE);
+}
\ No newline at end of file
@@ -0,0 +1,59 @@
+#ifndef __STEREO_BLOCK_MATCH_H
+#define __STEREO_BLOCK_MATCH_H
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+#include "TqcScheduler.h"
+#include "StereoKernels.h"
+
+using namespace cv;
+
+// Largest block whose SAD still fits the 16-bit cost buffers: 255 x 15 x 15 < 65536.
+#define TQC_BLOCK_MATCH_MAX_SIZE    15
+
+
+// SAD/ZSAD block matcher of gray images. Init() picks the kernel of the CPU level compiled for the
+// exact (block size, number of disparities) pair when there is one, see g_blockMatchKernels, and
+// the generic kernel otherwise. ZSAD matches images with the local block mean removed.
+// Output is CV_16S with 4 fractional bits, the same convention as StereoBM/StereoSGBM.
+class CBlockMatcher
+{
+public:
+    CBlockMatcher();
+    ~CBlockMatcher();
+
+public:
+    bool    Init(int nNumDisparities,
+                 int nSADWindowSize,
+                 bool bZeroMean,
+                 int nUniquenessRatio,
+                 int nSpeckleWindowSize,
+                 int nSpeckleRange);
+    bool    Compute(const Mat &left, const Mat &right, Mat &disp);
+    bool    IsSpecialized() const { return m_bSpecialized; }
+    int     GetUniquenessRatio() const { return m_nUniquenessRatio; }
+
+protected:
+    void    Prepare(const Mat &img, Mat &padded);
+
+private:
+    int                 m_nNumDisparities;
+    int                 m_nSADWindowSize;
+    bool                m_bZeroMean;
+    int                 m_nUniquenessRatio;
+    int                 m_nSpeckleWindowSize;
+    int                 m_nSpeckleRange;
+    bool                m_bSpecialized;
+    pfnTqcRangeTask     m_pfnKernel;        // Matches a band of rows, selected by Init().
+
+    Mat                 m_gray;
+    Mat                 m_mean;
+    Mat                 m_zeroMean;
+    Mat                 m_padLeft;          // Matcher input with a block / 2 border on every side.
+    Mat                 m_padRight;
+    Mat                 m_speckleBuf;
+    std::vector<ushort> m_bandBuf;          // Column sums and costs of every band, kept across frames.
+};
+
+#endif /* __STEREO_BLOCK_MATCH_H */
\ No newline at end of file
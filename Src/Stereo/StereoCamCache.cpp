@@ -0,0 +1,233 @@
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "TqcLog.h"
+#include "TqcOs.h"
+#include "TqcUtils.h"
+#include "Config.h"
+#include "StereoCamCache.h"
+
+#define TQC_FNV_OFFSET_BASIS    0xcbf29ce484222325ULL
+#define TQC_FNV_PRIME           0x100000001b3ULL
+
+// Mapped caches are never unmapped, the Mats in stCamParam point into them for the whole run.
+static std::vector<void*> g_mappedCaches;
+
+static uint64 Fnv1a(uint64 hash, const void *pData, size_t size)
+{
+    const uchar *p = (const uchar*)pData;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= p[i];
+        hash *= TQC_FNV_PRIME;
+    }
+
+    return hash;
+}
+
+static bool HashFile(const char *strFile, uint64 *pHash)
+{
+    uchar buf[4096];
+    size_t n;
+    FILE  *fp = fopen(strFile, "rb");
+
+    if (!fp)
+    {
+        LOGE("Failed to open file %s\n", strFile);
+        return false;
+    }
+
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+    {
+        *pHash = Fnv1a(*pHash, buf, n);
+    }
+
+    fclose(fp);
+
+    return true;
+}
+
+// Everything StereoLoadCamParam()'s output depends on: both files, scale, sizes and the cull borders.
+bool StereoGetCamParamKey(const char *strIntrinsicFile,
+                          const char *strExtrinsicFile,
+                          float fScale,
+                          Size imgSize,
+                          Size camCalibrateSize,
+                          uint64 *pKey)
+{
+    uint64 hash = TQC_FNV_OFFSET_BASIS;
+    int    param[8];
+
+    if (!HashFile(strIntrinsicFile, &hash) || !HashFile(strExtrinsicFile, &hash))
+    {
+        return false;
+    }
+
+    param[0] = imgSize.width;
+    param[1] = imgSize.height;
+    param[2] = camCalibrateSize.width;
+    param[3] = camCalibrateSize.height;
+    param[4] = TQC_STEREO_CULL;
+    param[5] = TQC_STEREO_CAMERA_X_BORDER;
+    param[6] = TQC_STEREO_CAMERA_Y_BORDER;
+    param[7] = TQC_CAM_CACHE_VERSION;
+
+    hash = Fnv1a(hash, &fScale, sizeof(fScale));
+    hash = Fnv1a(hash, param, sizeof(param));
+
+    *pKey = hash;
+
+    return true;
+}
+
+// The key is part of the name, so a changed calibration simply misses and writes a new cache.
+void StereoGetCamParamCacheFile(uint64 key, char *strFile)
+{
+    memset(strFile, 0, TQC_MAX_PATH);
+    sprintf(strFile, "%s/stereo_cam_%08x%08x.cache", TQC_CAM_PARAM_CACHE_DIR,
+            (unsigned int)(key >> 32), (unsigned int)(key & 0xffffffff));
+}
+
+static void GetCacheMats(stCamParam *pCamParam, Mat *pMats[13])
+{
+    Mat *mats[13] =
+    {
+        &pCamParam->R1, &pCamParam->P1, &pCamParam->R2, &pCamParam->P2, &pCamParam->Q,
+        &pCamParam->map11, &pCamParam->map12, &pCamParam->map21, &pCamParam->map22,
+        &pCamParam->fusedMap11, &pCamParam->fusedMap12, &pCamParam->fusedMap21, &pCamParam->fusedMap22
+    };
+
+    memcpy(pMats, mats, sizeof(mats));
+}
+
+bool StereoLoadCamParamCache(const char *strFile, uint64 key, stCamParam *pOutCamParam)
+{
+    long long size  = 0;
+    uchar     *pData = (uchar*)TqcOsMapFile(strFile, &size);
+    Mat       *mats[13];
+
+    if (!pData)
+    {
+        return false;
+    }
+
+    const stCamCacheHeader *pHeader = (const stCamCacheHeader*)pData;
+    if (size < (long long)sizeof(stCamCacheHeader) ||
+        memcmp(pHeader->magic, TQC_CAM_CACHE_MAGIC, 4) != 0 ||
+        pHeader->version != TQC_CAM_CACHE_VERSION ||
+        pHeader->key != key ||
+        pHeader->nMats != 13 ||
+        size < (long long)(sizeof(stCamCacheHeader) + 13 * sizeof(stCamCacheMat)))
+    {
+        LOGE("%s(%d): %s is not a valid cache.\n", __FUNCTION__, __LINE__, strFile);
+        TqcOsUnmapFile(pData, size);
+        return false;
+    }
+
+    const stCamCacheMat *pMat = (const stCamCacheMat*)(pHeader + 1);
+    for (int i = 0; i < 13; i++)
+    {
+        int64 bytes = (int64)pMat[i].rows * pMat[i].cols * CV_ELEM_SIZE(pMat[i].type);
+        if (pMat[i].rows < 0 || pMat[i].cols < 0 || pMat[i].offset < 0 || pMat[i].offset + bytes > size)
+        {
+            LOGE("%s(%d): %s is truncated.\n", __FUNCTION__, __LINE__, strFile);
+            TqcOsUnmapFile(pData, size);
+            return false;
+        }
+    }
+
+    // Mats are headers over the mapping, pages are only read when they are first touched.
+    GetCacheMats(pOutCamParam, mats);
+    for (int i = 0; i < 13; i++)
+    {
+        if (pMat[i].rows == 0 || pMat[i].cols == 0)
+            mats[i]->release();
+        else
+            *mats[i] = Mat(pMat[i].rows, pMat[i].cols, pMat[i].type, pData + pMat[i].offset);
+    }
+
+    pOutCamParam->roi1        = Rect(pHeader->roi1[0], pHeader->roi1[1], pHeader->roi1[2], pHeader->roi1[3]);
+    pOutCamParam->roi2        = Rect(pHeader->roi2[0], pHeader->roi2[1], pHeader->roi2[2], pHeader->roi2[3]);
+    pOutCamParam->fFusedScale = pHeader->fFusedScale;
+
+    g_mappedCaches.push_back(pData);
+
+    return true;
+}
+
+bool StereoSaveCamParamCache(const char *strFile, uint64 key, const stCamParam &camParam)
+{
+    stCamCacheHeader header;
+    stCamCacheMat    matHeader[13];
+    stCamParam       camParamCopy = camParam;
+    Mat              *mats[13];
+    Mat              continuous[13];
+    int64            offset;
+    FILE             *fp;
+    static const char zero[TQC_CAM_CACHE_ALIGN] = { 0 };
+
+    GetCacheMats(&camParamCopy, mats);
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TQC_CAM_CACHE_MAGIC, 4);
+    header.version     = TQC_CAM_CACHE_VERSION;
+    header.key         = key;
+    header.nMats       = 13;
+    header.roi1[0]     = camParam.roi1.x;
+    header.roi1[1]     = camParam.roi1.y;
+    header.roi1[2]     = camParam.roi1.width;
+    header.roi1[3]     = camParam.roi1.height;
+    header.roi2[0]     = camParam.roi2.x;
+    header.roi2[1]     = camParam.roi2.y;
+    header.roi2[2]     = camParam.roi2.width;
+    header.roi2[3]     = camParam.roi2.height;
+    header.fFusedScale = camParam.fFusedScale;
+
+    // Lay out the data after the headers, every Mat aligned for SIMD loads.
+    offset = sizeof(header) + sizeof(matHeader);
+    for (int i = 0; i < 13; i++)
+    {
+        continuous[i] = mats[i]->isContinuous() ? *mats[i] : mats[i]->clone();
+        offset = (offset + TQC_CAM_CACHE_ALIGN - 1) & ~(int64)(TQC_CAM_CACHE_ALIGN - 1);
+
+        memset(&matHeader[i], 0, sizeof(stCamCacheMat));
+        matHeader[i].rows   = continuous[i].rows;
+        matHeader[i].cols   = continuous[i].cols;
+        matHeader[i].type   = continuous[i].type();
+        matHeader[i].offset = offset;
+
+        offset += (int64)continuous[i].total() * continuous[i].elemSize();
+    }
+
+    fp = fopen(strFile, "wb");
+    if (!fp)
+    {
+        LOGE("%s(%d): cannot open file %s", __FUNCTION__, __LINE__, strFile);
+        return false;
+    }
+
+    bool bOk = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+               fwrite(matHeader, sizeof(matHeader), 1, fp) == 1;
+
+    offset = sizeof(header) + sizeof(matHeader);
+    for (int i = 0; bOk && i < 13; i++)
+    {
+        size_t bytes = continuous[i].total() * continuous[i].elemSize();
+
+        bOk = fwrite(zero, 1, (size_t)(matHeader[i].offset - offset), fp) == (size_t)(matHeader[i].offset - offset);
+        bOk = bOk && (bytes == 0 || fwrite(continuous[i].data, 1, bytes, fp) == bytes);
+        offset = matHeader[i].offset + bytes;
+    }
+
+    fclose(fp);
+
+    if (!bOk)
+    {
+        LOGE("%s(%d): cannot write cache %s", __FUNCTION__, __LINE__, strFile);
+        remove(strFile);
+    }
+
+    return bOk;
+}
\ No newline at end of file
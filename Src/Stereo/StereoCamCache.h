@@ -0,0 +1,46 @@
+#ifndef __STEREO_CAM_CACHE_H
+#define __STEREO_CAM_CACHE_H
+
+#include "StereoCamera.h"
+
+#define TQC_CAM_CACHE_MAGIC     "TQCC"
+#define TQC_CAM_CACHE_VERSION   1
+
+// Mat data in the cache starts on this boundary.
+#define TQC_CAM_CACHE_ALIGN     16
+
+
+typedef struct _stCamCacheHeader
+{
+    char    magic[4];
+    int     version;
+    uint64  key;
+    int     nMats;
+    int     roi1[4];
+    int     roi2[4];
+    float   fFusedScale;
+} stCamCacheHeader;
+
+// Every Mat is stored as this header followed by its aligned, continuous data.
+typedef struct _stCamCacheMat
+{
+    int     rows;
+    int     cols;
+    int     type;
+    int     reserved;
+    int64   offset;     // Of the data, from the start of the file.
+} stCamCacheMat;
+
+
+// Function declaration
+bool   StereoGetCamParamKey(const char *strIntrinsicFile,
+                            const char *strExtrinsicFile,
+                            float fScale,
+                            Size imgSize,
+                            Size camCalibrateSize,
+                            uint64 *pKey);
+void   StereoGetCamParamCacheFile(uint64 key, char *strFile);
+bool   StereoLoadCamParamCache(const char *strFile, uint64 key, stCamParam *pOutCamParam);
+bool   StereoSaveCamParamCache(const char *strFile, uint64 key, const stCamParam &camParam);
+
+#endif /* __STEREO_CAM_CACHE_H */
\ No newline at end of file
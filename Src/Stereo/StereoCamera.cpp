@@ -8,10 +8,19 @@
 
 #include "TqcLog.h"
 #include "Config.h"
+#include "TqcUtils.h"
 #include "StereoCamera.h"
+#include "StereoCamCache.h"
 
 stCamParam g_CamParam;
 
+static bool StereoComputeCamParam(const char *strIntrinsicFile,
+                                  const char *strExtrinsicFile,
+                                  float fScale,
+                                  Size imgSize,
+                                  Size camCalibrateSize,
+                                  stCamParam *pOutCamParam);
+
 bool StereoLoadCamParam(const char *strIntrinsicFile,
                         const char *strExtrinsicFile,
                         float fScale,
@@ -19,9 +28,47 @@ bool StereoLoadCamParam(const char *strIntrinsicFile,
                         Size camCalibrateSize,
                         stCamParam *pOutCamParam)
 {
-    if (!strIntrinsicFile || !strExtrinsicFile)
+    if (!strIntrinsicFile || !strExtrinsicFile || !pOutCamParam)
+        return false;
+
+#if TQC_CAM_PARAM_CACHE
+    uint64 key;
+    char   strCacheFile[TQC_MAX_PATH];
+
+    if (!StereoGetCamParamKey(strIntrinsicFile, strExtrinsicFile, fScale, imgSize, camCalibrateSize, &key))
+    {
+        return false;
+    }
+
+    StereoGetCamParamCacheFile(key, strCacheFile);
+
+    // Skip the YAML parsing, stereoRectify() and the map generation when nothing changed.
+    if (!StereoLoadCamParamCache(strCacheFile, key, pOutCamParam))
+    {
+        if (!StereoComputeCamParam(strIntrinsicFile, strExtrinsicFile, fScale, imgSize, camCalibrateSize, pOutCamParam))
+        {
+            return false;
+        }
+
+        StereoSaveCamParamCache(strCacheFile, key, *pOutCamParam);
+    }
+#else
+    if (!StereoComputeCamParam(strIntrinsicFile, strExtrinsicFile, fScale, imgSize, camCalibrateSize, pOutCamParam))
+    {
         return false;
+    }
+#endif
 
+    return StereoBuildDepthLut(pOutCamParam->Q, &pOutCamParam->depthLut);
+}
+
+static bool StereoComputeCamParam(const char *strIntrinsicFile,
+                                  const char *strExtrinsicFile,
+                                  float fScale,
+                                  Size imgSize,
+                                  Size camCalibrateSize,
+                                  stCamParam *pOutCamParam)
+{
     // reading intrinsic parameters
     FileStorage fs(strIntrinsicFile, FileStorage::READ);
     if (!fs.isOpened())
@@ -83,6 +130,107 @@ bool StereoLoadCamParam(const char *strIntrinsicFile,
     initUndistortRectifyMap(M1, D1, pOutCamParam->R1, pOutCamParam->P1, imgSize, CV_16SC2, pOutCamParam->map11, pOutCamParam->map12);
     initUndistortRectifyMap(M2, D2, pOutCamParam->R2, pOutCamParam->P2, imgSize, CV_16SC2, pOutCamParam->map21, pOutCamParam->map22);
 
+    if (!StereoBuildFusedMap(M1, D1, pOutCamParam->R1, pOutCamParam->P1, fScale, imgSize,
+                             pOutCamParam->fusedMap11, pOutCamParam->fusedMap12) ||
+        !StereoBuildFusedMap(M2, D2, pOutCamParam->R2, pOutCamParam->P2, fScale, imgSize,
+                             pOutCamParam->fusedMap21, pOutCamParam->fusedMap22))
+    {
+        return false;
+    }
+    pOutCamParam->fFusedScale = fScale;
+
+    return true;
+}
+
+// Build one map that goes straight from raw camera pixels to the scaled, culled, rectified image,
+// so StereoMatch() doesn't need the resize() and the full-frame remap() any more.
+bool StereoBuildFusedMap(const Mat &M,
+                         const Mat &D,
+                         const Mat &R,
+                         const Mat &P,
+                         float fScale,
+                         Size imgSize,
+                         Mat &outMap1,
+                         Mat &outMap2)
+{
+    Mat  mapX, mapY;
+    Rect dstRC(0, 0, imgSize.width, imgSize.height);
+
+    if (fScale <= 0)
+    {
+        LOGE("%s(%d): invalid scale %f.", __FUNCTION__, __LINE__, fScale);
+        return false;
+    }
+
+    // M is already scaled by fScale, so the float maps point into the resized image.
+    initUndistortRectifyMap(M, D, R, P, imgSize, CV_32FC1, mapX, mapY);
+
+#if TQC_STEREO_CULL
+    dstRC = Rect(TQC_STEREO_CAMERA_X_BORDER, TQC_STEREO_CAMERA_Y_BORDER,
+                 imgSize.width - TQC_STEREO_CAMERA_X_BORDER * 2, imgSize.height - TQC_STEREO_CAMERA_Y_BORDER * 2);
+#endif
+
+    mapX = mapX(dstRC).clone();
+    mapY = mapY(dstRC).clone();
+
+    // Undo the resize(): pixel centers of the resized image map back to (x + 0.5) / fScale - 0.5.
+    if (fScale != 1)
+    {
+        double k = 1.0 / fScale;
+        double b = 0.5 / fScale - 0.5;
+
+        mapX.convertTo(mapX, CV_32F, k, b);
+        mapY.convertTo(mapY, CV_32F, k, b);
+    }
+
+    convertMaps(mapX, mapY, outMap1, outMap2, CV_16SC2);
+
+    return true;
+}
+
+bool StereoBuildDepthLut(const Mat &Q, stDepthLut *pOutLut)
+{
+    double q[4][4];
+    Mat    _Q(4, 4, CV_64F, q);
+
+    if (!pOutLut || Q.rows != 4 || Q.cols != 4)
+    {
+        LOGE("%s(%d): invalid Q matrix.", __FUNCTION__, __LINE__);
+        return false;
+    }
+
+    Q.convertTo(_Q, CV_64F);
+
+    pOutLut->q03 = q[0][3];
+    pOutLut->q13 = q[1][3];
+    pOutLut->q23 = q[2][3];
+    pOutLut->nQ03 = cvRound(q[0][3] * (1 << TQC_DEPTH_Q_BITS));
+    pOutLut->nQ13 = cvRound(q[1][3] * (1 << TQC_DEPTH_Q_BITS));
+    pOutLut->nQ23 = cvRound(q[2][3] * (1 << TQC_DEPTH_Q_BITS));
+    pOutLut->depth.create(1, TQC_DEPTH_LUT_SIZE, CV_64F);
+    pOutLut->depthMm.create(1, TQC_DEPTH_LUT_SIZE, CV_16U);
+
+    double *pDepth   = pOutLut->depth.ptr<double>();
+    ushort *pDepthMm = pOutLut->depthMm.ptr<ushort>();
+
+    // Depth only depends on the disparity once Q is fixed, so evaluate it once for every 16-bit value.
+    for (int i = 0; i < TQC_DEPTH_LUT_SIZE; i++)
+    {
+        short  disp = (short)(unsigned short)i;
+        double z    = ((q[2][3]) / (q[3][2] * disp + q[3][3])) * 16;
+
+        pDepth[i] = z;
+
+        // Round half up by hand, cvRound() rounds ties to even on SSE2 but not on NEON, and the
+        // integer path has to give the same table everywhere. Positive depths never become 0.
+        if (!(z > 0))
+            pDepthMm[i] = 0;
+        else if (z >= USHRT_MAX)
+            pDepthMm[i] = USHRT_MAX;
+        else
+            pDepthMm[i] = (ushort)max((int)(z + 0.5), 1);
+    }
+
     return true;
 }
 
@@ -104,10 +252,12 @@ bool StereoOpenCam(VideoCapture &leftCam, VideoCapture &rightCam, int camWidth,
 
 bool StereoGetFrame(VideoCapture &leftCam, VideoCapture &rightCam, Mat &leftFrame, Mat &rightFrame)
 {
-    leftCam >> leftFrame;
-    rightCam >> rightFrame;
+    // Grab both before decoding either, so the exposures are not a whole decode apart.
+    // CStereoCapture does better (parallel grab/retrieve) for live loops.
+    bool bGrabbed = leftCam.grab() && rightCam.grab();
 
-    if (leftFrame.empty() || rightFrame.empty())
+    if (!bGrabbed || !leftCam.retrieve(leftFrame) || !rightCam.retrieve(rightFrame) ||
+        leftFrame.empty() || rightFrame.empty())
     {
         LOGE("%s(%d): Couldn't grab the next camera frame.\n", __FUNCTION__, __LINE__);
         return false;
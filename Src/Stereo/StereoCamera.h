@@ -12,15 +12,53 @@
 
 using namespace cv;
 
+// One entry for every possible CV_16S disparity value.
+#define TQC_DEPTH_LUT_SIZE 65536
+
+// Fixed-point copies of the Q terms keep this many fraction bits.
+#define TQC_DEPTH_Q_BITS   16
+
+
+// Depth of every 16-bit fixed-point disparity, precomputed from Q.
+typedef struct _stDepthLut
+{
+    Mat    depth;          // CV_64F, 1 x TQC_DEPTH_LUT_SIZE, indexed by (unsigned short)disparity.
+    Mat    depthMm;        // CV_16U, same index, depth rounded to mm. 0: invalid, 65535: that far or farther.
+    double q03, q13, q23;  // Q terms needed to get x/y back from depth.
+    int    nQ03, nQ13, nQ23;  // The same terms with TQC_DEPTH_Q_BITS fraction bits, for the integer path.
+} stDepthLut;
 
 typedef struct _stCamParam
 {
-    Mat  R1, P1, R2, P2, Q;
-    Rect roi1, roi2;
-    Mat  map11, map12, map21, map22;
+    Mat        R1, P1, R2, P2, Q;
+    Rect       roi1, roi2;
+    Mat        map11, map12, map21, map22;
+    Mat        fusedMap11, fusedMap12, fusedMap21, fusedMap22;   // Raw camera pixels -> scaled, culled, rectified output.
+    float      fFusedScale;                                     // fScale the fused maps were built for.
+    stDepthLut depthLut;
 } stCamParam;
 
 
+// Look up the depth of a CV_16S disparity value (x16).
+inline double StereoGetDepthFromLut(const stDepthLut &lut, short disp)
+{
+    return ((const double*)lut.depth.data)[(unsigned short)disp];
+}
+
+// Integer counterpart: depth in mm, within 0.5 mm of StereoGetDepthFromLut() below 65535 mm.
+inline ushort StereoGetDepthMmFromLut(const stDepthLut &lut, short disp)
+{
+    return ((const ushort*)lut.depthMm.data)[(unsigned short)disp];
+}
+
+
+// Fused maps can replace resize + remap + cull only when they were built for the same scale.
+inline bool StereoHasFusedMap(const stCamParam &camParam, float fScale)
+{
+    return !camParam.fusedMap11.empty() && camParam.fFusedScale == fScale;
+}
+
+
 // Function Declaration
 bool StereoLoadCamParam(const char *strIntrinsicFile,
                         const char *strExtrinsicFile,
@@ -28,6 +66,15 @@ bool StereoLoadCamParam(const char *strIntrinsicFile,
                         Size imgSize,
                         Size camCalibrateSize,
                         stCamParam *pOutCamParam);
+bool StereoBuildFusedMap(const Mat &M,
+                         const Mat &D,
+                         const Mat &R,
+                         const Mat &P,
+                         float fScale,
+                         Size imgSize,
+                         Mat &outMap1,
+                         Mat &outMap2);
+bool StereoBuildDepthLut(const Mat &Q, stDepthLut *pOutLut);
 bool StereoOpenCam(VideoCapture &leftCam, VideoCapture &rightCam, int camWidth, int camHeight);
 bool StereoGetFrame(VideoCapture &leftCam, VideoCapture &rightCam, Mat &leftFrame, Mat &rightFrame);
 
@@ -0,0 +1,310 @@
+#include <stdio.h>
+
+#include "TqcLog.h"
+#include "TqcOs.h"
+#include "TqcTrace.h"
+#include "Config.h"
+#include "StereoCapture.h"
+
+CStereoCapture::CStereoCapture()
+    : m_bQuit(false),
+      m_bLossless(false),
+      m_hRetrieved(NULL),
+      m_nCount(0),
+      m_nRead(0)
+{
+    for (int i = 0; i < 2; i++)
+    {
+        m_cam[i].pOwner  = this;
+        m_cam[i].tGrab   = 0;
+        m_cam[i].hThread = NULL;
+        m_cam[i].hRound  = NULL;
+        m_cam[i].bMaster = (i == 0);
+    }
+}
+
+CStereoCapture::~CStereoCapture()
+{
+    Stop();
+}
+
+bool CStereoCapture::Open(int nLeftIndex, int nRightIndex, int nWidth, int nHeight)
+{
+    // Try to set the camera resolution. Note that this only works for some cameras on
+    // some computers and only for some drivers, so don't rely on it to work!
+    for (int i = 0; i < 2; i++)
+    {
+        VideoCapture &cam = m_cam[i].cam;
+
+        if (!cam.open(i == 0 ? nLeftIndex : nRightIndex))
+        {
+            LOGE("%s(%d): cannot open camera %d.", __FUNCTION__, __LINE__, i == 0 ? nLeftIndex : nRightIndex);
+            return false;
+        }
+
+        cam.set(CV_CAP_PROP_FRAME_WIDTH, nWidth);
+        cam.set(CV_CAP_PROP_FRAME_HEIGHT, nHeight);
+    }
+
+    m_bLossless = false;
+
+    return true;
+}
+
+bool CStereoCapture::Open(const char *strLeftSource, const char *strRightSource)
+{
+    const char *strSource[2] = { strLeftSource, strRightSource };
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (!strSource[i] || !m_cam[i].cam.open(strSource[i]))
+        {
+            LOGE("%s(%d): cannot open source %s.", __FUNCTION__, __LINE__, strSource[i] ? strSource[i] : "(null)");
+            return false;
+        }
+    }
+
+    m_bLossless = true;
+
+    return true;
+}
+
+bool CStereoCapture::Start()
+{
+    m_bQuit      = false;
+    m_nCount     = 0;
+    m_nRead      = 0;
+    m_hRetrieved = TqcOsCreateSemaphore(0);
+
+    // Round 1 may grab right away.
+    for (int i = 0; i < 2; i++)
+    {
+        m_cam[i].hRound = TqcOsCreateSemaphore(1);
+    }
+
+    if (!m_hRetrieved || !m_cam[0].hRound || !m_cam[1].hRound)
+    {
+        LOGE("%s(%d): cannot create capture semaphores.", __FUNCTION__, __LINE__);
+        Stop();
+        return false;
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        m_cam[i].hThread = TqcOsCreateThread((void*)CamThread, &m_cam[i]);
+        if (!m_cam[i].hThread)
+        {
+            LOGE("%s(%d): cannot create capture thread.", __FUNCTION__, __LINE__);
+            Stop();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Safe to call twice and after a failed Open()/Start(): handles that don't exist are skipped.
+void CStereoCapture::Stop()
+{
+    Quit();
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (m_cam[i].hThread)
+        {
+            TqcOsJoinThread(m_cam[i].hThread);
+            m_cam[i].hThread = NULL;
+        }
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (m_cam[i].hRound)
+        {
+            TqcOsDeleteSemaphore(m_cam[i].hRound);
+            m_cam[i].hRound = NULL;
+        }
+    }
+
+    if (m_hRetrieved)
+    {
+        TqcOsDeleteSemaphore(m_hRetrieved);
+        m_hRetrieved = NULL;
+    }
+}
+
+// Stop both threads: every semaphore is posted once, so a thread blocked in Wait() wakes up and sees m_bQuit.
+void CStereoCapture::Quit()
+{
+    m_bQuit = true;
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (m_cam[i].hRound)
+            TqcOsPostSemaphore(m_cam[i].hRound, 1);
+    }
+
+    if (m_hRetrieved)
+        TqcOsPostSemaphore(m_hRetrieved, 1);
+}
+
+// Wait for a new pair. Camera sources return the newest pair (older unread ones are dropped
+// to keep latency low), file sources return every pair in order.
+bool CStereoCapture::Read(stStereoPair &pair)
+{
+    int nIndex;
+
+    while (1)
+    {
+        int nCount = m_nCount;
+
+        if (nCount > m_nRead)
+        {
+            nIndex = m_bLossless ? m_nRead + 1 : nCount;
+            break;
+        }
+
+        if (m_bQuit)
+        {
+            return false;
+        }
+
+        TqcOsSleep(1);
+    }
+
+    m_lock.Lock();
+    pair = m_ring[(nIndex - 1) % TQC_CAPTURE_RING_SIZE];
+    m_lock.UnLock();
+
+    m_nRead = nIndex;
+
+    return true;
+}
+
+bool CStereoCapture::Read(Mat &left, Mat &right)
+{
+    stStereoPair pair;
+
+    if (!Read(pair))
+    {
+        return false;
+    }
+
+    left  = pair.left;
+    right = pair.right;
+
+    return true;
+}
+
+// nBack = 0 is the newest pair, up to TQC_CAPTURE_RING_SIZE - 1 pairs back.
+bool CStereoCapture::GetRecent(int nBack, stStereoPair &pair)
+{
+    bool bFound = false;
+
+    m_lock.Lock();
+
+    int nIndex = m_nCount - nBack;
+    if (nBack >= 0 && nBack < TQC_CAPTURE_RING_SIZE && nIndex > 0)
+    {
+        pair   = m_ring[(nIndex - 1) % TQC_CAPTURE_RING_SIZE];
+        bFound = true;
+    }
+
+    m_lock.UnLock();
+
+    return bFound;
+}
+
+// Left/right grab skew of the newest pair, in milliseconds.
+double CStereoCapture::GetSkew()
+{
+    stStereoPair pair;
+
+    return GetRecent(0, pair) ? StereoGetPairSkew(pair) : 0.0;
+}
+
+// Block on hSem instead of polling: a post wakes the thread right away, which Sleep(1) granularity
+// would not, and nothing spins while the other camera grabs or decodes. False once Quit() was called.
+bool CStereoCapture::Wait(SemaphoreHandle hSem)
+{
+    TqcOsWaitSemaphore(hSem);
+
+    return !m_bQuit;
+}
+
+void CStereoCapture::PushPair(int nIndex)
+{
+    stStereoPair &pair = m_ring[(nIndex - 1) % TQC_CAPTURE_RING_SIZE];
+
+    m_lock.Lock();
+
+    // Frames are moved into the ring, the threads retrieve into fresh buffers next round.
+    pair.nIndex = nIndex;
+    pair.left   = m_cam[0].frame;
+    pair.right  = m_cam[1].frame;
+    pair.tLeft  = m_cam[0].tGrab;
+    pair.tRight = m_cam[1].tGrab;
+    m_cam[0].frame.release();
+    m_cam[1].frame.release();
+
+    m_lock.UnLock();
+
+    m_nCount = nIndex;
+}
+
+void* CStereoCapture::CamThread(void *pParam)
+{
+    stCamThread    *pCam  = (stCamThread*)pParam;
+    CStereoCapture *pThis = pCam->pOwner;
+
+    for (int nRound = 1; ; nRound++)
+    {
+        // Both threads leave this wait together, so both grabs start at the same moment.
+        if (!pThis->Wait(pCam->hRound))
+            break;
+
+        bool bOk;
+        {
+            TQC_TRACE_SCOPE("grab");
+            bOk = pCam->cam.grab();
+            pCam->tGrab = getTickCount();
+        }
+
+        // Decoding is the slow part, both cameras do it in parallel.
+        {
+            TQC_TRACE_SCOPE("retrieve");
+            bOk = bOk && pCam->cam.retrieve(pCam->frame) && !pCam->frame.empty();
+        }
+        if (!bOk)
+        {
+            LOGE("%s(%d): couldn't grab the next %s frame.\n", __FUNCTION__, __LINE__, pCam->bMaster ? "left" : "right");
+            pThis->Quit();
+            break;
+        }
+
+        if (!pCam->bMaster)
+        {
+            TqcOsPostSemaphore(pThis->m_hRetrieved, 1);
+            continue;
+        }
+
+        if (!pThis->Wait(pThis->m_hRetrieved))
+            break;
+
+        // Don't overwrite pairs the reader hasn't seen yet when replaying files.
+        while (pThis->m_bLossless && nRound - pThis->m_nRead > TQC_CAPTURE_RING_SIZE && !pThis->m_bQuit)
+        {
+            TqcOsSleep(1);
+        }
+
+        pThis->PushPair(nRound);
+
+        // Let both threads grab the next round.
+        for (int i = 0; i < 2; i++)
+        {
+            TqcOsPostSemaphore(pThis->m_cam[i].hRound, 1);
+        }
+    }
+
+    return NULL;
+}
\ No newline at end of file
@@ -0,0 +1,84 @@
+#ifndef __STEREO_CAPTURE_H
+#define __STEREO_CAPTURE_H
+
+#include <atomic>
+#include <opencv2/opencv.hpp>
+
+#include "TqcOs.h"
+#include "TqcUtils.h"
+
+using namespace cv;
+
+// Number of recent stereo pairs kept by CStereoCapture.
+#ifndef TQC_CAPTURE_RING_SIZE
+#define TQC_CAPTURE_RING_SIZE 4
+#endif
+
+
+// One synchronized stereo pair. Timestamps are getTickCount() values taken right after grab(),
+// i.e. as close to the exposure as VideoCapture lets us get.
+typedef struct _stStereoPair
+{
+    int    nIndex;
+    Mat    left, right;
+    int64  tLeft;
+    int64  tRight;
+} stStereoPair;
+
+
+// Left minus right grab time of a pair, in milliseconds.
+inline double StereoGetPairSkew(const stStereoPair &pair)
+{
+    return (pair.tLeft - pair.tRight) * 1000. / getTickFrequency();
+}
+
+
+// Concurrent stereo capture: each device has its own thread, both threads grab() at the same
+// moment (after a barrier), then retrieve()/decode in parallel. Works the same with camera indices
+// or with file-backed sources (video files or image sequences such as "left_%03d.png").
+class CStereoCapture
+{
+public:
+    CStereoCapture();
+    ~CStereoCapture();
+
+public:
+    bool    Open(int nLeftIndex, int nRightIndex, int nWidth, int nHeight);
+    bool    Open(const char *strLeftSource, const char *strRightSource);
+    bool    Start();
+    void    Stop();
+    bool    Read(stStereoPair &pair);
+    bool    Read(Mat &left, Mat &right);
+    bool    GetRecent(int nBack, stStereoPair &pair);
+    double  GetSkew();
+
+protected:
+    typedef struct _stCamThread
+    {
+        CStereoCapture *pOwner;
+        VideoCapture   cam;
+        Mat            frame;
+        int64          tGrab;
+        void           *hThread;
+        SemaphoreHandle hRound;     // Posted once by the master for every round this thread may grab.
+        bool           bMaster;
+    } stCamThread;
+
+    static void* CamThread(void *pParam);
+    bool    Wait(SemaphoreHandle hSem);
+    void    Quit();
+    void    PushPair(int nIndex);
+
+private:
+    stCamThread         m_cam[2];
+    std::atomic<bool>   m_bQuit;
+    bool                m_bLossless;    // File-backed sources: never drop a pair the reader hasn't seen.
+    SemaphoreHandle     m_hRetrieved;   // Posted by the other thread once its frame of the round is decoded.
+
+    CLock               m_lock;
+    stStereoPair        m_ring[TQC_CAPTURE_RING_SIZE];
+    std::atomic<int>    m_nCount;       // Pairs captured so far.
+    std::atomic<int>    m_nRead;        // Index of the last pair returned by Read().
+};
+
+#endif /* __STEREO_CAPTURE_H */
\ No newline at end of file
@@ -0,0 +1,418 @@
+#include <string.h>
+#include <limits.h>
+#include <algorithm>
+
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
+
+#include "TqcLog.h"
+#include "StereoCensusSgm.h"
+#include "StereoKernels.h"
+
+#define TQC_CENSUS_SGM_INVALID_DISP (-16)   // (minDisparity - 1) * 16, same as StereoSGBM.
+
+CCensusSgm::CCensusSgm()
+{
+    m_nNumDisparities    = 16;
+    m_nPaths             = 8;
+    m_nP1                = TQC_CENSUS_SGM_P1;
+    m_nP2                = TQC_CENSUS_SGM_P2;
+    m_nUniquenessRatio   = 10;
+    m_nDisp12MaxDiff     = 1;
+    m_nSpeckleWindowSize = 100;
+    m_nSpeckleRange      = 32;
+    m_bStreaming         = false;
+    m_nWidth             = 0;
+    m_nHeight            = 0;
+    m_pKernels           = NULL;
+}
+
+CCensusSgm::~CCensusSgm()
+{
+}
+
+bool CCensusSgm::Init(int nNumDisparities,
+                      int nPaths,
+                      int nP1,
+                      int nP2,
+                      int nUniquenessRatio,
+                      int nDisp12MaxDiff,
+                      int nSpeckleWindowSize,
+                      int nSpeckleRange,
+                      bool bStreaming)
+{
+    if (nNumDisparities <= 0 || nNumDisparities % 8 != 0)
+    {
+        LOGE("%s(%d): number of disparities(%d) must be a positive multiple of 8.", __FUNCTION__, __LINE__, nNumDisparities);
+        return false;
+    }
+
+    if (nPaths != 4 && nPaths != 8)
+    {
+        LOGE("%s(%d): SGM supports 4 or 8 paths, not %d.", __FUNCTION__, __LINE__, nPaths);
+        return false;
+    }
+
+    m_nNumDisparities    = nNumDisparities;
+    m_nPaths             = nPaths;
+    m_nP1                = nP1;
+    m_nP2                = std::max(nP2, nP1 + 1);
+    m_nUniquenessRatio   = nUniquenessRatio;
+    m_nDisp12MaxDiff     = nDisp12MaxDiff;
+    m_nSpeckleWindowSize = nSpeckleWindowSize;
+    m_nSpeckleRange      = nSpeckleRange;
+    m_bStreaming         = bStreaming;
+
+    return true;
+}
+
+bool CCensusSgm::Compute(const Mat &left, const Mat &right, Mat &disp)
+{
+    if (left.empty() || left.size() != right.size() || left.type() != right.type() || left.depth() != CV_8U)
+    {
+        LOGE("%s(%d): left and right images must be non-empty 8-bit images of the same size.", __FUNCTION__, __LINE__);
+        return false;
+    }
+
+    // Census only looks at intensity order, so color input is reduced to gray first.
+    if (left.channels() == 3)
+    {
+        cvtColor(left, m_grayLeft, COLOR_BGR2GRAY);
+        cvtColor(right, m_grayRight, COLOR_BGR2GRAY);
+    }
+    else
+    {
+        m_grayLeft  = left;
+        m_grayRight = right;
+    }
+
+    m_nWidth   = left.cols;
+    m_nHeight  = left.rows;
+    m_pKernels = &StereoGetKernels();
+
+    int D         = m_nNumDisparities;
+    int DS        = D + TQC_CENSUS_SGM_PAD * 2;
+    int nRowDirs  = (m_nPaths == 8 ? 3 : 1);
+    int nRowSlots = m_nWidth + 2;
+
+    m_costRow.resize((size_t)m_nWidth * D);
+    m_pathBuf.resize((size_t)(nRowDirs * 2 * nRowSlots + 3) * DS);
+    m_pathMin.resize((size_t)nRowDirs * 2 * nRowSlots);
+    m_disp2.resize(m_nWidth);
+    m_disp2Cost.resize(m_nWidth);
+
+    disp.create(m_nHeight, m_nWidth, CV_16S);
+
+    if (m_bStreaming)
+    {
+        // Census rows are made on the fly from the padded images, the sum holds a single row.
+        copyMakeBorder(m_grayLeft, m_paddedLeft, TQC_CENSUS_HEIGHT / 2, TQC_CENSUS_HEIGHT / 2,
+                       TQC_CENSUS_WIDTH / 2, TQC_CENSUS_WIDTH / 2, BORDER_REPLICATE);
+        copyMakeBorder(m_grayRight, m_paddedRight, TQC_CENSUS_HEIGHT / 2, TQC_CENSUS_HEIGHT / 2,
+                       TQC_CENSUS_WIDTH / 2, TQC_CENSUS_WIDTH / 2, BORDER_REPLICATE);
+
+        m_censusLeft.resize(m_nWidth);
+        m_censusRight.resize(m_nWidth);
+        m_sum.resize((size_t)m_nWidth * D);
+
+        StreamPass(disp);
+    }
+    else
+    {
+        CensusTransform(m_grayLeft, m_censusLeft);
+        CensusTransform(m_grayRight, m_censusRight);
+
+        m_sum.resize((size_t)m_nWidth * m_nHeight * D);
+
+        ForwardPass();
+        BackwardPass(disp);
+    }
+
+    if (m_nSpeckleWindowSize > 0)
+    {
+        filterSpeckles(disp, TQC_CENSUS_SGM_INVALID_DISP, m_nSpeckleWindowSize, 16 * m_nSpeckleRange, m_speckleBuf);
+    }
+
+    return true;
+}
+
+void CCensusSgm::CensusTransform(const Mat &gray, std::vector<uint64> &census)
+{
+    const int hw = TQC_CENSUS_WIDTH / 2;
+    const int hh = TQC_CENSUS_HEIGHT / 2;
+    Mat       padded;
+
+    copyMakeBorder(gray, padded, hh, hh, hw, hw, BORDER_REPLICATE);
+    census.resize((size_t)gray.cols * gray.rows);
+
+    for (int y = 0; y < gray.rows; y++)
+    {
+        CensusRow(padded, y, &census[(size_t)y * gray.cols]);
+    }
+}
+
+// Census of image row y, padded is the image with TQC_CENSUS_HEIGHT / 2 rows and TQC_CENSUS_WIDTH / 2
+// columns of border on every side.
+void CCensusSgm::CensusRow(const Mat &padded, int y, uint64 *pCensus)
+{
+    const int hw    = TQC_CENSUS_WIDTH / 2;
+    const int hh    = TQC_CENSUS_HEIGHT / 2;
+    const int width = padded.cols - hw * 2;
+
+    for (int x = 0; x < width; x++)
+    {
+        uchar  center = padded.at<uchar>(y + hh, x + hw);
+        uint64 bits   = 0;
+
+        for (int dy = 0; dy < TQC_CENSUS_HEIGHT; dy++)
+        {
+            const uchar *p = padded.ptr<uchar>(y + dy) + x;
+
+            for (int dx = 0; dx < TQC_CENSUS_WIDTH; dx++)
+            {
+                if (dy == hh && dx == hw)
+                    continue;
+
+                bits = (bits << 1) | (p[dx] < center ? 1 : 0);
+            }
+        }
+
+        pCensus[x] = bits;
+    }
+}
+
+// Buffer layout: nRowDirs x 2 rows of (width + 2) path vectors, then two horizontal vectors and one
+// border vector. Slot 0 and slot width + 1 of every row stay "border": all zeros with minimum 0,
+// which turns the update into L = C at the image edge.
+void CCensusSgm::InitPathBuf()
+{
+    const int D     = m_nNumDisparities;
+    const int DS    = D + TQC_CENSUS_SGM_PAD * 2;
+    ushort    *pBuf = &m_pathBuf[0];
+
+    // Padding is 0xFFFF, path values start at 0.
+    for (size_t i = 0; i < m_pathBuf.size(); i += DS)
+    {
+        for (int k = 0; k < DS; k++)
+        {
+            pBuf[i + k] = (k < TQC_CENSUS_SGM_PAD || k >= TQC_CENSUS_SGM_PAD + D) ? USHRT_MAX : 0;
+        }
+    }
+    memset(&m_pathMin[0], 0, m_pathMin.size() * sizeof(ushort));
+}
+
+// Kernel arguments of row y. nRowDirs is 0 for the horizontal path alone; the row buffers swap
+// between "previous" and "current" with the parity of y.
+void CCensusSgm::InitSgmRow(int y, const int *pDirX, int nRowDirs, bool bReverse, ushort *pSum, stSgmRow &row)
+{
+    const int D         = m_nNumDisparities;
+    const int DS        = D + TQC_CENSUS_SGM_PAD * 2;
+    const int nAllDirs  = (m_nPaths == 8 ? 3 : 1);
+    const int nRowSlots = m_nWidth + 2;
+    const int cur       = y & 1;
+    ushort    *pBuf     = &m_pathBuf[0];
+    ushort    *pMin     = &m_pathMin[0];
+
+    row.pCost           = &m_costRow[0];
+    row.pSum            = pSum;
+    row.pHorz[0]        = pBuf + (size_t)nAllDirs * 2 * nRowSlots * DS + TQC_CENSUS_SGM_PAD;
+    row.pHorz[1]        = pBuf + ((size_t)nAllDirs * 2 * nRowSlots + 1) * DS + TQC_CENSUS_SGM_PAD;
+    row.pBorder         = pBuf + ((size_t)nAllDirs * 2 * nRowSlots + 2) * DS + TQC_CENSUS_SGM_PAD;
+    row.pDirX           = pDirX;
+    row.nRowDirs        = nRowDirs;
+    row.nWidth          = m_nWidth;
+    row.nNumDisparities = D;
+    row.nP1             = m_nP1;
+    row.nP2             = m_nP2;
+    row.bReverse        = bReverse;
+
+    for (int r = 0; r < nAllDirs; r++)
+    {
+        row.pRowPrev[r] = pBuf + ((size_t)(r * 2 + (cur ^ 1)) * nRowSlots) * DS + TQC_CENSUS_SGM_PAD;
+        row.pRowCur[r]  = pBuf + ((size_t)(r * 2 + cur) * nRowSlots) * DS + TQC_CENSUS_SGM_PAD;
+        row.pMinPrev[r] = pMin + (r * 2 + (cur ^ 1)) * nRowSlots;
+        row.pMinCur[r]  = pMin + (r * 2 + cur) * nRowSlots;
+    }
+}
+
+void CCensusSgm::ForwardPass()
+{
+    const int D        = m_nNumDisparities;
+    const int nRowDirs = (m_nPaths == 8 ? 3 : 1);
+    stSgmRow  row;
+
+    InitPathBuf();
+    memset(&m_sum[0], 0, m_sum.size() * sizeof(ushort));
+
+    // Row directions, as the x offset of the previous pixel in the row above: top-left, top, top-right.
+    static const int dirX[3] = { -1, 0, 1 };
+    const int        *pDirX  = (nRowDirs == 1) ? &dirX[1] : dirX;
+
+    for (int y = 0; y < m_nHeight; y++)
+    {
+        m_pKernels->pfnCensusCost(&m_censusLeft[(size_t)y * m_nWidth], &m_censusRight[(size_t)y * m_nWidth],
+                                  m_nWidth, D, &m_costRow[0]);
+
+        InitSgmRow(y, pDirX, nRowDirs, false, &m_sum[(size_t)y * m_nWidth * D], row);
+        m_pKernels->pfnSgmAggregate(row);
+    }
+}
+
+void CCensusSgm::BackwardPass(Mat &disp)
+{
+    const int D         = m_nNumDisparities;
+    const int DS        = D + TQC_CENSUS_SGM_PAD * 2;
+    const int nRowDirs  = (m_nPaths == 8 ? 3 : 1);
+    const int nRowSlots = m_nWidth + 2;
+    ushort    *pBuf     = &m_pathBuf[0];
+    stSgmRow  row;
+
+    // Reset the row buffers back to border values, the forward pass left its last rows in there.
+    // Padding entries were never written and are still 0xFFFF.
+    for (size_t i = 0; i < (size_t)nRowDirs * 2 * nRowSlots * DS; i += DS)
+    {
+        for (int k = TQC_CENSUS_SGM_PAD; k < TQC_CENSUS_SGM_PAD + D; k++)
+        {
+            pBuf[i + k] = 0;
+        }
+    }
+    memset(&m_pathMin[0], 0, m_pathMin.size() * sizeof(ushort));
+
+    // Mirror of the forward pass: bottom-right, bottom, bottom-left.
+    static const int dirX[3] = { 1, 0, -1 };
+    const int        *pDirX  = (nRowDirs == 1) ? &dirX[1] : dirX;
+
+    for (int y = m_nHeight - 1; y >= 0; y--)
+    {
+        ushort *pSum = &m_sum[(size_t)y * m_nWidth * D];
+
+        m_pKernels->pfnCensusCost(&m_censusLeft[(size_t)y * m_nWidth], &m_censusRight[(size_t)y * m_nWidth],
+                                  m_nWidth, D, &m_costRow[0]);
+
+        InitSgmRow(y, pDirX, nRowDirs, true, pSum, row);
+        m_pKernels->pfnSgmAggregate(row);
+
+        // All paths of this row are summed now.
+        SelectDisparityRow(pSum, disp.ptr<short>(y));
+    }
+}
+
+// Single top-down pass that only keeps line buffers: the forward paths of ForwardPass() plus a
+// right-to-left path over the same row, summed into one row and resolved right away. 5 paths (3 with
+// TQC_CENSUS_SGM_PATHS 4) instead of 8, no bottom-up paths, but memory is O(width x disparities).
+void CCensusSgm::StreamPass(Mat &disp)
+{
+    const int D        = m_nNumDisparities;
+    const int nRowDirs = (m_nPaths == 8 ? 3 : 1);
+    stSgmRow  row;
+
+    InitPathBuf();
+
+    static const int dirX[3] = { -1, 0, 1 };
+    const int        *pDirX  = (nRowDirs == 1) ? &dirX[1] : dirX;
+
+    for (int y = 0; y < m_nHeight; y++)
+    {
+        CensusRow(m_paddedLeft, y, &m_censusLeft[0]);
+        CensusRow(m_paddedRight, y, &m_censusRight[0]);
+        m_pKernels->pfnCensusCost(&m_censusLeft[0], &m_censusRight[0], m_nWidth, D, &m_costRow[0]);
+        memset(&m_sum[0], 0, m_sum.size() * sizeof(ushort));
+
+        InitSgmRow(y, pDirX, nRowDirs, false, &m_sum[0], row);
+        m_pKernels->pfnSgmAggregate(row);
+
+        // Reverse pass limited to the row: the cost row is still there, nothing else is needed.
+        InitSgmRow(y, pDirX, 0, true, &m_sum[0], row);
+        m_pKernels->pfnSgmAggregate(row);
+
+        SelectDisparityRow(&m_sum[0], disp.ptr<short>(y));
+    }
+}
+
+// Winner-takes-all with uniqueness check, sub-pixel refinement and left-right check, as StereoSGBM does.
+void CCensusSgm::SelectDisparityRow(const ushort *pSum, short *pDisp)
+{
+    const int D = m_nNumDisparities;
+
+    for (int x = 0; x < m_nWidth; x++)
+    {
+        m_disp2[x]     = -1;
+        m_disp2Cost[x] = INT_MAX;
+    }
+
+    for (int x = 0; x < m_nWidth; x++)
+    {
+        const ushort *S       = pSum + (size_t)x * D;
+        int          minS     = INT_MAX;
+        int          bestDisp = -1;
+        int          d;
+
+        // Not every disparity has a match in the right image this close to the left border.
+        if (x < D)
+        {
+            pDisp[x] = TQC_CENSUS_SGM_INVALID_DISP;
+            continue;
+        }
+
+        for (d = 0; d < D; d++)
+        {
+            if (S[d] < minS)
+            {
+                minS     = S[d];
+                bestDisp = d;
+            }
+        }
+
+        if (m_nUniquenessRatio > 0)
+        {
+            for (d = 0; d < D; d++)
+            {
+                if (S[d] * (100 - m_nUniquenessRatio) < minS * 100 && std::abs(bestDisp - d) > 1)
+                    break;
+            }
+
+            if (d < D)
+            {
+                pDisp[x] = TQC_CENSUS_SGM_INVALID_DISP;
+                continue;
+            }
+        }
+
+        int x2 = x - bestDisp;
+        if (m_disp2Cost[x2] > minS)
+        {
+            m_disp2Cost[x2] = minS;
+            m_disp2[x2]     = (short)bestDisp;
+        }
+
+        d = bestDisp * 16;
+        if (0 < bestDisp && bestDisp < D - 1)
+        {
+            int denom2 = std::max(S[bestDisp - 1] + S[bestDisp + 1] - 2 * S[bestDisp], 1);
+            d += ((S[bestDisp - 1] - S[bestDisp + 1]) * 16 + denom2) / (denom2 * 2);
+        }
+
+        pDisp[x] = (short)d;
+    }
+
+    if (m_nDisp12MaxDiff < 0)
+        return;
+
+    for (int x = D; x < m_nWidth; x++)
+    {
+        int d1 = pDisp[x];
+        if (d1 == TQC_CENSUS_SGM_INVALID_DISP)
+            continue;
+
+        int _d = d1 >> 4;
+        int d_ = (d1 + 15) >> 4;
+        int _x = x - _d;
+        int x_ = x - d_;
+
+        if (0 <= _x && _x < m_nWidth && m_disp2[_x] >= 0 && std::abs(m_disp2[_x] - _d) > m_nDisp12MaxDiff &&
+            0 <= x_ && x_ < m_nWidth && m_disp2[x_] >= 0 && std::abs(m_disp2[x_] - d_) > m_nDisp12MaxDiff)
+        {
+            pDisp[x] = TQC_CENSUS_SGM_INVALID_DISP;
+        }
+    }
+}
\ No newline at end of file
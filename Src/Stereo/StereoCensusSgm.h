@@ -0,0 +1,103 @@
+#ifndef __STEREO_CENSUS_SGM_H
+#define __STEREO_CENSUS_SGM_H
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+#include "StereoKernels.h"
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+using namespace cv;
+
+// Census window is 9x7, so the 62 neighbour bits fit in one 64-bit word.
+#define TQC_CENSUS_WIDTH        9
+#define TQC_CENSUS_HEIGHT       7
+
+// Default SGM penalties, tuned for Hamming costs in [0, 62].
+#define TQC_CENSUS_SGM_P1       10
+#define TQC_CENSUS_SGM_P2       120
+
+
+// Number of bits set in a census XOR.
+inline int StereoPopCount64(uint64 v)
+{
+#if defined(__GNUC__)
+    return __builtin_popcountll(v);
+#elif defined(_MSC_VER) && defined(_M_X64) && defined(__AVX__)
+    return (int)__popcnt64(v);
+#else
+    v = v - ((v >> 1) & 0x5555555555555555ULL);
+    v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+    v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (int)((v * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+
+// Census transform + semi-global matching engine. The streaming mode aggregates in a single pass
+// over rolling line buffers and never holds the width x height x disparities sum.
+// Output is CV_16S with 4 fractional bits, the same convention as StereoBM/StereoSGBM.
+class CCensusSgm
+{
+public:
+    CCensusSgm();
+    ~CCensusSgm();
+
+public:
+    bool    Init(int nNumDisparities,
+                 int nPaths,
+                 int nP1,
+                 int nP2,
+                 int nUniquenessRatio,
+                 int nDisp12MaxDiff,
+                 int nSpeckleWindowSize,
+                 int nSpeckleRange,
+                 bool bStreaming);
+    bool    Compute(const Mat &left, const Mat &right, Mat &disp);
+    int     GetUniquenessRatio() const  { return m_nUniquenessRatio; }
+    int     GetDisp12MaxDiff() const    { return m_nDisp12MaxDiff; }
+
+protected:
+    void    CensusTransform(const Mat &gray, std::vector<uint64> &census);
+    void    CensusRow(const Mat &padded, int y, uint64 *pCensus);
+    void    InitPathBuf();
+    void    InitSgmRow(int y, const int *pDirX, int nRowDirs, bool bReverse, ushort *pSum, stSgmRow &row);
+    void    ForwardPass();
+    void    BackwardPass(Mat &disp);
+    void    StreamPass(Mat &disp);
+    void    SelectDisparityRow(const ushort *pSum, short *pDisp);
+
+private:
+    int                 m_nNumDisparities;
+    int                 m_nPaths;
+    int                 m_nP1;
+    int                 m_nP2;
+    int                 m_nUniquenessRatio;
+    int                 m_nDisp12MaxDiff;
+    int                 m_nSpeckleWindowSize;
+    int                 m_nSpeckleRange;
+    bool                m_bStreaming;
+
+    int                 m_nWidth;
+    int                 m_nHeight;
+    const stStereoKernels *m_pKernels;  // StereoGetKernels() of the current Compute().
+
+    Mat                 m_grayLeft;
+    Mat                 m_grayRight;
+    Mat                 m_paddedLeft;   // Streaming mode: gray images with the census border.
+    Mat                 m_paddedRight;
+    Mat                 m_speckleBuf;
+    std::vector<uint64> m_censusLeft;   // Whole image, or the current row in streaming mode.
+    std::vector<uint64> m_censusRight;
+    std::vector<uchar>  m_costRow;
+    std::vector<ushort> m_sum;          // Sum of all path costs, width x height x disparities (one row when streaming).
+    std::vector<ushort> m_pathBuf;      // Rolling path cost rows.
+    std::vector<ushort> m_pathMin;      // Minimum of every path cost vector in m_pathBuf.
+    std::vector<short>  m_disp2;        // Right-view disparity of the current row, for the L-R check.
+    std::vector<int>    m_disp2Cost;
+};
+
+#endif /* __STEREO_CENSUS_SGM_H */
\ No newline at end of file
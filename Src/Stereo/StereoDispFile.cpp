@@ -0,0 +1,337 @@
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "TqcLog.h"
+#include "TqcOs.h"
+#include "StereoDispFile.h"
+#include "StereoUtils.h"
+
+#ifdef _MSC_VER
+#define TqcFileSeek(fp, offset, origin) _fseeki64(fp, offset, origin)
+#define TqcFileTell(fp)                 _ftelli64(fp)
+#else
+#define TqcFileSeek(fp, offset, origin) fseeko(fp, offset, origin)
+#define TqcFileTell(fp)                 ftello(fp)
+#endif
+
+// The structs are the on-disk layout and are written and read as a whole, the same on every
+// compiler and on 32/64-bit builds.
+static_assert(sizeof(stDispFileHeader) == 16, "stDispFileHeader is not 16 bytes");
+static_assert(sizeof(stDispFrameHeader) == 240, "stDispFrameHeader is not 240 bytes");
+static_assert(offsetof(stDispFrameHeader, timestamp) == 24 && offsetof(stDispFrameHeader, Q) == 32 &&
+              offsetof(stDispFrameHeader, algorithm) == 160 && offsetof(stDispFrameHeader, name) == 176,
+              "stDispFrameHeader layout changed");
+static_assert(sizeof(stDispFileTrailer) == 16 && offsetof(stDispFileTrailer, indexOffset) == 8,
+              "stDispFileTrailer layout changed");
+
+static int64 GetFrameSize(const stDispFrameHeader &header)
+{
+    return (int64)sizeof(stDispFrameHeader) + (int64)header.rows * header.cols * sizeof(short);
+}
+
+static bool IsValidFrameHeader(const stDispFrameHeader &header)
+{
+    return memcmp(header.magic, TQC_DISP_FRAME_MAGIC, 4) == 0 &&
+           header.type == CV_16S && header.rows > 0 && header.cols > 0;
+}
+
+CDispFileWriter::CDispFileWriter()
+    : m_fp(NULL)
+{
+}
+
+CDispFileWriter::~CDispFileWriter()
+{
+    Close();
+}
+
+// Create the file, or reopen it to append after the frames already in it.
+bool CDispFileWriter::Open(const char *strFile)
+{
+    stDispFileHeader  header;
+    stDispFileTrailer trailer;
+    int64             offset = sizeof(stDispFileHeader);
+
+    Close();
+    m_index.clear();
+
+    m_fp = fopen(strFile, "r+b");
+    if (m_fp && fread(&header, sizeof(header), 1, m_fp) == 1 && memcmp(header.magic, TQC_DISP_FILE_MAGIC, 4) == 0)
+    {
+        TqcFileSeek(m_fp, -(int64)sizeof(trailer), SEEK_END);
+        if (fread(&trailer, sizeof(trailer), 1, m_fp) == 1 && memcmp(trailer.magic, TQC_DISP_INDEX_MAGIC, 4) == 0)
+        {
+            m_index.resize(trailer.nFrames);
+            TqcFileSeek(m_fp, trailer.indexOffset, SEEK_SET);
+            if (trailer.nFrames == 0 || fread(&m_index[0], sizeof(int64), trailer.nFrames, m_fp) == (size_t)trailer.nFrames)
+            {
+                offset = trailer.indexOffset;
+            }
+            else
+            {
+                m_index.clear();
+            }
+        }
+
+        // No usable index, walk the complete frames.
+        if (offset == sizeof(stDispFileHeader))
+        {
+            stDispFrameHeader frame;
+
+            TqcFileSeek(m_fp, offset, SEEK_SET);
+            while (fread(&frame, sizeof(frame), 1, m_fp) == 1 && IsValidFrameHeader(frame))
+            {
+                int64 next = offset + GetFrameSize(frame);
+
+                if (TqcFileSeek(m_fp, next - 1, SEEK_SET) != 0 || fgetc(m_fp) == EOF)
+                    break;
+
+                m_index.push_back(offset);
+                offset = next;
+            }
+        }
+
+        TqcFileSeek(m_fp, offset, SEEK_SET);
+        return true;
+    }
+
+    if (m_fp)
+    {
+        fclose(m_fp);
+    }
+
+    m_fp = fopen(strFile, "w+b");
+    if (!m_fp)
+    {
+        LOGE("%s(%d): cannot open file %s", __FUNCTION__, __LINE__, strFile);
+        return false;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TQC_DISP_FILE_MAGIC, 4);
+    header.version = TQC_DISP_FILE_VERSION;
+
+    return fwrite(&header, sizeof(header), 1, m_fp) == 1;
+}
+
+bool CDispFileWriter::Write(const Mat &disp, const Mat &Q, const char *strAlgorithm, const char *strName, int64 timestamp)
+{
+    stDispFrameHeader header;
+
+    if (!m_fp || disp.type() != CV_16S)
+    {
+        LOGE("%s(%d): file is not opened or disparity is not CV_16S.", __FUNCTION__, __LINE__);
+        return false;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TQC_DISP_FRAME_MAGIC, 4);
+    header.nIndex    = (int)m_index.size();
+    header.rows      = disp.rows;
+    header.cols      = disp.cols;
+    header.type      = CV_16S;
+    header.scale     = 16;
+    header.timestamp = timestamp;
+
+    if (Q.rows == 4 && Q.cols == 4)
+    {
+        Mat q(4, 4, CV_64F, header.Q);
+        Q.convertTo(q, CV_64F);
+    }
+
+    if (strAlgorithm)
+        strncpy(header.algorithm, strAlgorithm, sizeof(header.algorithm) - 1);
+    if (strName)
+        strncpy(header.name, strName, sizeof(header.name) - 1);
+
+    m_index.push_back(TqcFileTell(m_fp));
+
+    bool bOk = fwrite(&header, sizeof(header), 1, m_fp) == 1;
+
+    // Rows of a ROI aren't contiguous, write them one by one.
+    for (int y = 0; bOk && y < disp.rows; y++)
+    {
+        bOk = fwrite(disp.ptr<short>(y), sizeof(short), disp.cols, m_fp) == (size_t)disp.cols;
+    }
+
+    if (!bOk)
+    {
+        LOGE("%s(%d): cannot write frame %d.", __FUNCTION__, __LINE__, header.nIndex);
+        m_index.pop_back();
+    }
+
+    return bOk;
+}
+
+bool CDispFileWriter::Close()
+{
+    stDispFileTrailer trailer;
+    bool              bOk = true;
+
+    if (!m_fp)
+    {
+        return true;
+    }
+
+    memcpy(trailer.magic, TQC_DISP_INDEX_MAGIC, 4);
+    trailer.nFrames     = (int)m_index.size();
+    trailer.indexOffset = TqcFileTell(m_fp);
+
+    if (!m_index.empty())
+    {
+        bOk = fwrite(&m_index[0], sizeof(int64), m_index.size(), m_fp) == m_index.size();
+    }
+    bOk = bOk && fwrite(&trailer, sizeof(trailer), 1, m_fp) == 1;
+
+    fclose(m_fp);
+    m_fp = NULL;
+
+    return bOk;
+}
+
+CDispFileReader::CDispFileReader()
+    : m_pData(NULL),
+      m_nSize(0)
+{
+}
+
+CDispFileReader::~CDispFileReader()
+{
+    Close();
+}
+
+bool CDispFileReader::Open(const char *strFile)
+{
+    Close();
+
+    m_pData = (uchar*)TqcOsMapFile(strFile, &m_nSize);
+    if (!m_pData)
+    {
+        LOGE("%s(%d): cannot map file %s", __FUNCTION__, __LINE__, strFile);
+        return false;
+    }
+
+    // Frames have any size, so headers in the mapping may be misaligned: copy them out with memcpy().
+    if (m_nSize < (long long)sizeof(stDispFileHeader) || memcmp(m_pData, TQC_DISP_FILE_MAGIC, 4) != 0)
+    {
+        LOGE("%s(%d): %s is not a disparity file.", __FUNCTION__, __LINE__, strFile);
+        Close();
+        return false;
+    }
+
+    // Use the index when the trailer is intact, otherwise walk the frames.
+    if (m_nSize >= (long long)(sizeof(stDispFileHeader) + sizeof(stDispFileTrailer)))
+    {
+        stDispFileTrailer trailer;
+
+        memcpy(&trailer, m_pData + m_nSize - sizeof(stDispFileTrailer), sizeof(trailer));
+
+        if (memcmp(trailer.magic, TQC_DISP_INDEX_MAGIC, 4) == 0 && trailer.nFrames >= 0 && trailer.indexOffset >= 0 &&
+            trailer.indexOffset + (int64)trailer.nFrames * (int64)sizeof(int64) + (int64)sizeof(stDispFileTrailer) == m_nSize)
+        {
+            m_index.resize(trailer.nFrames);
+            if (trailer.nFrames > 0)
+            {
+                memcpy(&m_index[0], m_pData + trailer.indexOffset, trailer.nFrames * sizeof(int64));
+            }
+            return true;
+        }
+    }
+
+    return ScanFrames();
+}
+
+void CDispFileReader::Close()
+{
+    if (m_pData)
+    {
+        TqcOsUnmapFile(m_pData, m_nSize);
+    }
+
+    m_pData = NULL;
+    m_nSize = 0;
+    m_index.clear();
+}
+
+bool CDispFileReader::ScanFrames()
+{
+    int64 offset = sizeof(stDispFileHeader);
+
+    while (offset + (int64)sizeof(stDispFrameHeader) <= m_nSize)
+    {
+        stDispFrameHeader frame;
+
+        memcpy(&frame, m_pData + offset, sizeof(frame));
+
+        if (!IsValidFrameHeader(frame) || offset + GetFrameSize(frame) > m_nSize)
+            break;
+
+        m_index.push_back(offset);
+        offset += GetFrameSize(frame);
+    }
+
+    return true;
+}
+
+bool CDispFileReader::GetFrame(int nIndex, Mat &disp, stDispFrameHeader *pHeader)
+{
+    if (!m_pData || nIndex < 0 || nIndex >= (int)m_index.size())
+    {
+        LOGE("%s(%d): invalid frame index %d.", __FUNCTION__, __LINE__, nIndex);
+        return false;
+    }
+
+    stDispFrameHeader frame;
+
+    if (m_index[nIndex] < (int64)sizeof(stDispFileHeader) || m_index[nIndex] + (int64)sizeof(frame) > m_nSize)
+    {
+        LOGE("%s(%d): frame %d is out of the file.", __FUNCTION__, __LINE__, nIndex);
+        return false;
+    }
+
+    memcpy(&frame, m_pData + m_index[nIndex], sizeof(frame));
+    if (!IsValidFrameHeader(frame) || m_index[nIndex] + GetFrameSize(frame) > m_nSize)
+    {
+        LOGE("%s(%d): frame %d is corrupted.", __FUNCTION__, __LINE__, nIndex);
+        return false;
+    }
+
+    // Headers are 240 bytes and frames whole shorts, so the data itself stays 2-byte aligned.
+    disp = Mat(frame.rows, frame.cols, CV_16S, (void*)(m_pData + m_index[nIndex] + sizeof(frame)));
+
+    if (pHeader)
+    {
+        *pHeader = frame;
+    }
+
+    return true;
+}
+
+// Write every frame of a disparity file in the old per-pixel text format, with the same file
+// names SaveDispData() used to produce, for the MATLAB scripts.
+bool StereoConvertDispFile(const char *strDispFile, const char *strFileName, const char *strOutputPath)
+{
+    CDispFileReader   reader;
+    stDispFrameHeader header;
+    Mat               disp;
+
+    if (!reader.Open(strDispFile))
+    {
+        return false;
+    }
+
+    for (int i = 0; i < reader.GetFrameCount(); i++)
+    {
+        if (!reader.GetFrame(i, disp, &header))
+        {
+            return false;
+        }
+
+        SaveDispData(strFileName, header.name, strOutputPath, header.algorithm, disp);
+    }
+
+    LOGE("%s(%d): %d frames converted.\n", __FUNCTION__, __LINE__, reader.GetFrameCount());
+
+    return true;
+}
\ No newline at end of file
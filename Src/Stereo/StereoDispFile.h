@@ -0,0 +1,98 @@
+#ifndef __STEREO_DISP_FILE_H
+#define __STEREO_DISP_FILE_H
+
+#include <stdio.h>
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+using namespace cv;
+
+// Binary disparity container, little-endian:
+//   stDispFileHeader
+//   stDispFrameHeader + rows x cols CV_16S, once per frame
+//   int64 offset of every frame header
+//   stDispFileTrailer
+// Appending overwrites the index and trailer, then writes them again on Close().
+// A file without trailer (crash while writing) is still readable by walking the frames.
+#define TQC_DISP_FILE_MAGIC     "TQCD"
+#define TQC_DISP_FRAME_MAGIC    "TQCF"
+#define TQC_DISP_INDEX_MAGIC    "TQCI"
+#define TQC_DISP_FILE_VERSION   1
+#define TQC_DISP_FILE_EXT       "tqcd"
+
+
+typedef struct _stDispFileHeader
+{
+    char    magic[4];
+    int     version;
+    int     reserved[2];
+} stDispFileHeader;
+
+typedef struct _stDispFrameHeader
+{
+    char    magic[4];
+    int     nIndex;
+    int     rows;
+    int     cols;
+    int     type;           // Always CV_16S for now.
+    int     scale;          // Disparity = value / scale, 16 for StereoBM/SGBM.
+    int64   timestamp;      // Microseconds.
+    double  Q[16];
+    char    algorithm[16];
+    char    name[64];       // Source frame, e.g. the left image name.
+} stDispFrameHeader;
+
+typedef struct _stDispFileTrailer
+{
+    char    magic[4];
+    int     nFrames;
+    int64   indexOffset;
+} stDispFileTrailer;
+
+
+// Appends frames to a disparity file. Not thread-safe, frames are written in call order.
+class CDispFileWriter
+{
+public:
+    CDispFileWriter();
+    ~CDispFileWriter();
+
+public:
+    bool    Open(const char *strFile);
+    bool    Write(const Mat &disp, const Mat &Q, const char *strAlgorithm, const char *strName, int64 timestamp);
+    bool    Close();
+
+private:
+    FILE                *m_fp;
+    std::vector<int64>  m_index;
+};
+
+
+// Memory-mapped reader. Frames returned by GetFrame() point into the mapping and stay
+// valid until Close().
+class CDispFileReader
+{
+public:
+    CDispFileReader();
+    ~CDispFileReader();
+
+public:
+    bool    Open(const char *strFile);
+    void    Close();
+    int     GetFrameCount() const { return (int)m_index.size(); }
+    bool    GetFrame(int nIndex, Mat &disp, stDispFrameHeader *pHeader = NULL);
+
+protected:
+    bool    ScanFrames();
+
+private:
+    uchar               *m_pData;
+    long long           m_nSize;
+    std::vector<int64>  m_index;
+};
+
+
+// Function declaration
+bool StereoConvertDispFile(const char *strDispFile, const char *strFileName, const char *strOutputPath);
+
+#endif /* __STEREO_DISP_FILE_H */
\ No newline at end of file
@@ -0,0 +1,33 @@
+// Baseline kernels, built with the project's default flags: SSE2 on x64, NEON on Android.
+
+#include "TqcLog.h"
+#include "StereoKernelsImpl.h"
+
+static const stStereoKernels g_stereoKernelsBase =
+{
+    CV_SSE2 ? TQC_CPU_SSE2 : TQC_CPU_GENERIC, CensusCostRow, SgmAggregateRow, g_blockMatchKernels
+};
+
+// Highest table that is compiled in and allowed by TqcCpuGetLevel(). Cheap enough to call once per
+// frame, the level is detected only once.
+const stStereoKernels& StereoGetKernels()
+{
+    enTqcCpuLevel level = TqcCpuGetLevel();
+
+    if (level >= TQC_CPU_AVX512 && g_pStereoKernelsAvx512)
+    {
+        return *g_pStereoKernelsAvx512;
+    }
+
+    if (level >= TQC_CPU_AVX2 && g_pStereoKernelsAvx2)
+    {
+        return *g_pStereoKernelsAvx2;
+    }
+
+    if (level >= TQC_CPU_SSE41 && g_pStereoKernelsSse41)
+    {
+        return *g_pStereoKernelsSse41;
+    }
+
+    return g_stereoKernelsBase;
+}
\ No newline at end of file
@@ -0,0 +1,102 @@
+#ifndef __STEREO_KERNELS_H
+#define __STEREO_KERNELS_H
+
+#include <stddef.h>
+#if !defined(_MSC_VER)
+#include <stdint.h>
+#endif
+
+#include "TqcCpu.h"
+
+// This header is included by the ISA kernel units, which must not see OpenCV or STL headers (their
+// inline functions would be compiled with AVX flags there). These typedefs repeat the ones of
+// opencv2/hal/defs.h, so including both is fine.
+typedef unsigned char       uchar;
+typedef unsigned short      ushort;
+#if defined(_MSC_VER)
+typedef unsigned __int64    uint64;
+#else
+typedef uint64_t            uint64;
+#endif
+
+// Largest Hamming cost of the 9x7 census, disparities without a match get it.
+#define TQC_CENSUS_MAX_COST     63
+
+// Disparity padding on both sides of every path cost vector, so d-1/d+1 loads stay in bounds.
+#define TQC_CENSUS_SGM_PAD      8
+
+#define TQC_BLOCK_MATCH_INVALID_DISP (-16)  // (minDisparity - 1) * 16, same as StereoSGBM.
+
+// One row of SGM aggregation: the horizontal path plus nRowDirs paths coming from the row above
+// (or below), see CCensusSgm::InitPathBuf() for the buffer layout.
+typedef struct _stSgmRow
+{
+    const uchar     *pCost;             // nWidth x nNumDisparities.
+    ushort          *pSum;              // nWidth x nNumDisparities, every path cost is added here.
+    ushort          *pHorz[2];          // Ping-pong vectors of the horizontal path.
+    const ushort    *pBorder;
+    const ushort    *pRowPrev[3];       // Row path buffers at slot 0, d = 0.
+    ushort          *pRowCur[3];
+    const ushort    *pMinPrev[3];
+    ushort          *pMinCur[3];
+    const int       *pDirX;             // x offset of the previous pixel of every row direction.
+    int             nRowDirs;
+    int             nWidth;
+    int             nNumDisparities;
+    int             nP1;
+    int             nP2;
+    bool            bReverse;           // Right to left.
+} stSgmRow;
+
+// Inputs of a block matcher kernel call. Images are padded by block / 2 on every side, so the
+// window of output pixel (x, y) starts at padded pixel (x, y).
+typedef struct _stBlockMatchRows
+{
+    const uchar         *pLeft;
+    const uchar         *pRight;
+    size_t              nStep;
+    short               *pDisp;
+    size_t              nDispStep;          // In shorts.
+    int                 nWidth;             // Of the disparity, the padded width is nWidth + nBlock - 1.
+    int                 nHeight;
+    int                 nBlock;
+    int                 nNumDisparities;
+    int                 nUniquenessRatio;
+    int                 nBands;             // Item i matches rows [nHeight * i / nBands, nHeight * (i + 1) / nBands).
+    ushort              *pBuf;              // Scratch of item i at pBuf + i * nBandBuf, reused across frames.
+    size_t              nBandBuf;
+} stBlockMatchRows;
+
+// ParallelFor() kernel over bands of a stBlockMatchRows, same signature as pfnTqcRangeTask.
+typedef void (*pfnBlockMatchRows)(void *pParam, int nBegin, int nEnd);
+
+// Kernel for one (block size, number of disparities) pair, 0 for the generic one.
+typedef struct _stBlockMatchKernel
+{
+    int                 nBlock;
+    int                 nNumDisparities;
+    pfnBlockMatchRows   pfnKernel;
+} stBlockMatchKernel;
+
+typedef void (*pfnCensusCostRow)(const uint64 *pLeft, const uint64 *pRight, int nWidth, int nNumDisparities, uchar *pCost);
+typedef void (*pfnSgmAggregateRow)(const stSgmRow &row);
+
+// Hot loops of the project's own matchers, compiled once per ISA level.
+typedef struct _stStereoKernels
+{
+    enTqcCpuLevel               level;
+    pfnCensusCostRow            pfnCensusCost;
+    pfnSgmAggregateRow          pfnSgmAggregate;
+    const stBlockMatchKernel    *pBlockMatch;   // Specialized block matchers, the generic { 0, 0 } one last.
+} stStereoKernels;
+
+// Per-ISA tables, NULL when the compiler of that translation unit could not target the level.
+extern const stStereoKernels *const g_pStereoKernelsSse41;
+extern const stStereoKernels *const g_pStereoKernelsAvx2;
+extern const stStereoKernels *const g_pStereoKernelsAvx512;
+
+
+// Function declaration
+const stStereoKernels& StereoGetKernels();
+
+#endif /* __STEREO_KERNELS_H */
\ No newline at end of file
@@ -0,0 +1,17 @@
+// AVX2 kernels, this file is built with /arch:AVX2 (-mavx2 -mpopcnt on GCC and Clang).
+
+#include "StereoKernels.h"
+
+#if defined(__AVX2__) && (defined(__POPCNT__) || defined(_MSC_VER))
+#define TQC_KERNEL_SSE41
+#include "StereoKernelsImpl.h"
+
+static const stStereoKernels g_stereoKernelsAvx2 =
+{
+    TQC_CPU_AVX2, CensusCostRow, SgmAggregateRow, g_blockMatchKernels
+};
+
+const stStereoKernels *const g_pStereoKernelsAvx2 = &g_stereoKernelsAvx2;
+#else
+const stStereoKernels *const g_pStereoKernelsAvx2 = NULL;
+#endif
\ No newline at end of file
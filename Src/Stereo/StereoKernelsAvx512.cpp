@@ -0,0 +1,19 @@
+// AVX-512 kernels, this file needs /arch:AVX512 (-mavx512f -mavx512bw -mpopcnt on GCC and Clang).
+// The v120 toolset cannot target AVX-512, there the table stays NULL and AVX-512 machines run the
+// AVX2 kernels.
+
+#include "StereoKernels.h"
+
+#if defined(__AVX512F__) && defined(__AVX512BW__) && (defined(__POPCNT__) || defined(_MSC_VER))
+#define TQC_KERNEL_SSE41
+#include "StereoKernelsImpl.h"
+
+static const stStereoKernels g_stereoKernelsAvx512 =
+{
+    TQC_CPU_AVX512, CensusCostRow, SgmAggregateRow, g_blockMatchKernels
+};
+
+const stStereoKernels *const g_pStereoKernelsAvx512 = &g_stereoKernelsAvx512;
+#else
+const stStereoKernels *const g_pStereoKernelsAvx512 = NULL;
+#endif
\ No newline at end of file
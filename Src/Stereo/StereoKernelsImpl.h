@@ -0,0 +1,601 @@
+// Kernel bodies shared by StereoKernels*.cpp, each of them includes this file once with its own
+// compiler flags. Any inline function with external linkage that an ISA build compiles (OpenCV,
+// STL, our own headers) becomes a COMDAT the linker may keep for the baseline callers too, which
+// then fault on CPUs without that ISA. So the ISA builds define TQC_KERNEL_SSE41, include nothing
+// but StereoKernels.h and the intrinsics header, and everything below has internal linkage.
+// Only the baseline build pulls in the OpenCV universal intrinsics and StereoPopCount64().
+
+#ifndef __STEREO_KERNELS_IMPL_H
+#define __STEREO_KERNELS_IMPL_H
+
+#include <limits.h>
+
+#include "StereoKernels.h"
+
+#if defined(TQC_KERNEL_SSE41)
+#include <immintrin.h>
+#else
+#include "StereoCensusSgm.h"
+#include <opencv2/hal/intrin.hpp>
+#endif
+
+namespace
+{
+
+static inline int KernelMin(int a, int b)
+{
+    return a < b ? a : b;
+}
+
+static inline int KernelMax(int a, int b)
+{
+    return a > b ? a : b;
+}
+
+static inline int KernelPopCount64(uint64 v)
+{
+#if defined(TQC_KERNEL_SSE41) && (defined(_M_X64) || defined(__x86_64__))
+    return (int)_mm_popcnt_u64(v);
+#elif defined(TQC_KERNEL_SSE41)
+    return _mm_popcnt_u32((unsigned int)v) + _mm_popcnt_u32((unsigned int)(v >> 32));
+#else
+    return StereoPopCount64(v);
+#endif
+}
+
+// Hamming costs of one row, disparities without a match in the right image cost the maximum.
+static void CensusCostRow(const uint64 *pLeft, const uint64 *pRight, int nWidth, int nNumDisparities, uchar *pCost)
+{
+    const int D = nNumDisparities;
+
+    for (int x = 0; x < nWidth; x++)
+    {
+        uchar *c    = pCost + (size_t)x * D;
+        int   dMax  = KernelMin(D, x + 1);
+        int   d     = 0;
+
+        for (; d < dMax; d++)
+        {
+            c[d] = (uchar)KernelPopCount64(pLeft[x] ^ pRight[x - d]);
+        }
+
+        for (; d < D; d++)
+        {
+            c[d] = TQC_CENSUS_MAX_COST;
+        }
+    }
+}
+
+// Path cost of one pixel: L(p, d) = C(p, d) + min(L(p-r, d), L(p-r, d+-1) + P1, minL(p-r) + P2) - minL(p-r).
+// pPrev/pCur point at d = 0 and have TQC_CENSUS_SGM_PAD readable entries on both sides.
+// The path costs are added to pSum and the minimum of the new vector is returned.
+// Unsigned 16-bit adds saturate, so the 0xFFFF padding never wraps around.
+static inline int SgmPathUpdate(const uchar *pCost,
+                                const ushort *pPrev,
+                                int prevMin,
+                                ushort *pCur,
+                                ushort *pSum,
+                                int nNumDisparities,
+                                int P1,
+                                int P2)
+{
+    int d     = 0;
+    int minP2 = KernelMin(prevMin + P2, (int)USHRT_MAX);
+
+#if defined(TQC_KERNEL_SSE41)
+    __m128i vMin = _mm_set1_epi16(-1);
+
+#if defined(__AVX2__)
+    __m256i vMin2 = _mm256_set1_epi16(-1);
+
+#if defined(__AVX512BW__)
+    __m512i vMin4 = _mm512_set1_epi16(-1);
+
+    for (; d + 32 <= nNumDisparities; d += 32)
+    {
+        __m512i c  = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(pCost + d)));
+        __m512i l0 = _mm512_loadu_si512(pPrev + d);
+        __m512i lm = _mm512_adds_epu16(_mm512_loadu_si512(pPrev + d - 1), _mm512_set1_epi16((short)P1));
+        __m512i lp = _mm512_adds_epu16(_mm512_loadu_si512(pPrev + d + 1), _mm512_set1_epi16((short)P1));
+        __m512i m  = _mm512_min_epu16(_mm512_min_epu16(l0, lm), _mm512_min_epu16(lp, _mm512_set1_epi16((short)minP2)));
+        __m512i l  = _mm512_adds_epu16(c, _mm512_subs_epu16(m, _mm512_set1_epi16((short)prevMin)));
+
+        _mm512_storeu_si512(pCur + d, l);
+        _mm512_storeu_si512(pSum + d, _mm512_adds_epu16(_mm512_loadu_si512(pSum + d), l));
+        vMin4 = _mm512_min_epu16(vMin4, l);
+    }
+
+    vMin2 = _mm256_min_epu16(_mm512_castsi512_si256(vMin4), _mm512_extracti64x4_epi64(vMin4, 1));
+#endif
+    for (; d + 16 <= nNumDisparities; d += 16)
+    {
+        __m256i c  = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(pCost + d)));
+        __m256i l0 = _mm256_loadu_si256((const __m256i*)(pPrev + d));
+        __m256i lm = _mm256_adds_epu16(_mm256_loadu_si256((const __m256i*)(pPrev + d - 1)), _mm256_set1_epi16((short)P1));
+        __m256i lp = _mm256_adds_epu16(_mm256_loadu_si256((const __m256i*)(pPrev + d + 1)), _mm256_set1_epi16((short)P1));
+        __m256i m  = _mm256_min_epu16(_mm256_min_epu16(l0, lm), _mm256_min_epu16(lp, _mm256_set1_epi16((short)minP2)));
+        __m256i l  = _mm256_adds_epu16(c, _mm256_subs_epu16(m, _mm256_set1_epi16((short)prevMin)));
+
+        _mm256_storeu_si256((__m256i*)(pCur + d), l);
+        _mm256_storeu_si256((__m256i*)(pSum + d), _mm256_adds_epu16(_mm256_loadu_si256((const __m256i*)(pSum + d)), l));
+        vMin2 = _mm256_min_epu16(vMin2, l);
+    }
+
+    vMin = _mm_min_epu16(_mm256_castsi256_si128(vMin2), _mm256_extracti128_si256(vMin2, 1));
+#endif
+    // The number of disparities is a multiple of 8.
+    for (; d < nNumDisparities; d += 8)
+    {
+        __m128i c  = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(pCost + d)));
+        __m128i l0 = _mm_loadu_si128((const __m128i*)(pPrev + d));
+        __m128i lm = _mm_adds_epu16(_mm_loadu_si128((const __m128i*)(pPrev + d - 1)), _mm_set1_epi16((short)P1));
+        __m128i lp = _mm_adds_epu16(_mm_loadu_si128((const __m128i*)(pPrev + d + 1)), _mm_set1_epi16((short)P1));
+        __m128i m  = _mm_min_epu16(_mm_min_epu16(l0, lm), _mm_min_epu16(lp, _mm_set1_epi16((short)minP2)));
+        __m128i l  = _mm_adds_epu16(c, _mm_subs_epu16(m, _mm_set1_epi16((short)prevMin)));
+
+        _mm_storeu_si128((__m128i*)(pCur + d), l);
+        _mm_storeu_si128((__m128i*)(pSum + d), _mm_adds_epu16(_mm_loadu_si128((const __m128i*)(pSum + d)), l));
+        vMin = _mm_min_epu16(vMin, l);
+    }
+
+    return _mm_cvtsi128_si32(_mm_minpos_epu16(vMin)) & 0xFFFF;
+#elif CV_SIMD128
+    v_uint16x8 vP1      = v_setall_u16((ushort)P1);
+    v_uint16x8 vPrevMin = v_setall_u16((ushort)prevMin);
+    v_uint16x8 vMinP2   = v_setall_u16((ushort)minP2);
+    v_uint16x8 vMin     = v_setall_u16(USHRT_MAX);
+
+    for (; d < nNumDisparities; d += 8)
+    {
+        v_uint16x8 c  = v_load_expand(pCost + d);
+        v_uint16x8 l0 = v_load(pPrev + d);
+        v_uint16x8 lm = v_load(pPrev + d - 1) + vP1;
+        v_uint16x8 lp = v_load(pPrev + d + 1) + vP1;
+        v_uint16x8 l  = c + (v_min(v_min(l0, lm), v_min(lp, vMinP2)) - vPrevMin);
+
+        v_store(pCur + d, l);
+        v_store(pSum + d, v_load(pSum + d) + l);
+        vMin = v_min(vMin, l);
+    }
+
+    v_uint32x4 vMin0, vMin1;
+    v_expand(vMin, vMin0, vMin1);
+
+    return (int)v_reduce_min(v_min(vMin0, vMin1));
+#else
+    int minL = USHRT_MAX;
+
+    for (; d < nNumDisparities; d++)
+    {
+        int m = KernelMin(KernelMin((int)pPrev[d], pPrev[d - 1] + P1),
+                          KernelMin(pPrev[d + 1] + P1, minP2));
+        int l = KernelMin(pCost[d] + m - prevMin, (int)USHRT_MAX);
+
+        pCur[d] = (ushort)l;
+        pSum[d] = (ushort)KernelMin(pSum[d] + l, (int)USHRT_MAX);
+        minL    = KernelMin(minL, l);
+    }
+
+    return minL;
+#endif
+}
+
+// Slot 0 and slot width + 1 of every path row are the border, pixel x lives in slot x + 1.
+static void SgmAggregateRow(const stSgmRow &row)
+{
+    const int    D          = row.nNumDisparities;
+    const int    DS         = D + TQC_CENSUS_SGM_PAD * 2;
+    int          horzMin    = 0;
+    const ushort *pHorzPrev = row.pBorder;
+
+    for (int i = 0; i < row.nWidth; i++)
+    {
+        int         x     = row.bReverse ? row.nWidth - 1 - i : i;
+        const uchar *c    = row.pCost + (size_t)x * D;
+        ushort      *pSum = row.pSum + (size_t)x * D;
+        ushort      *pH   = row.pHorz[x & 1];
+
+        horzMin   = SgmPathUpdate(c, pHorzPrev, horzMin, pH, pSum, D, row.nP1, row.nP2);
+        pHorzPrev = pH;
+
+        for (int r = 0; r < row.nRowDirs; r++)
+        {
+            int prevSlot = x + 1 + row.pDirX[r];
+
+            row.pMinCur[r][x + 1] = (ushort)SgmPathUpdate(c, row.pRowPrev[r] + (size_t)prevSlot * DS, row.pMinPrev[r][prevSlot],
+                                                          row.pRowCur[r] + (size_t)(x + 1) * DS, pSum, D, row.nP1, row.nP2);
+        }
+    }
+}
+
+// Column sums of disparity d, pCol[d * nPadWidth + xp]: add |L - R| of one padded row and remove the
+// row that left the window, NULL pLeftOut for none. Columns with xp < d have no match and stay 0.
+// Unsigned 16-bit adds saturate, adding first keeps every intermediate value in range. DISP is the
+// compile-time number of disparities, 0 takes nNumDisparities instead.
+template <int DISP>
+static inline void SadColumnUpdate(const uchar *pLeftIn,
+                                   const uchar *pRightIn,
+                                   const uchar *pLeftOut,
+                                   const uchar *pRightOut,
+                                   ushort *pCol,
+                                   int nPadWidth,
+                                   int nNumDisparities)
+{
+    const int D = DISP > 0 ? DISP : nNumDisparities;
+
+    for (int d = 0; d < D; d++)
+    {
+        ushort *c  = pCol + (size_t)d * nPadWidth;
+        int    xp  = d;
+
+#if defined(__AVX512BW__)
+        for (; xp <= nPadWidth - 64; xp += 64)
+        {
+            __m512i l   = _mm512_loadu_si512(pLeftIn + xp);
+            __m512i r   = _mm512_loadu_si512(pRightIn + xp - d);
+            __m512i ad  = _mm512_or_si512(_mm512_subs_epu8(l, r), _mm512_subs_epu8(r, l));
+            __m512i c0  = _mm512_adds_epu16(_mm512_loadu_si512(c + xp), _mm512_cvtepu8_epi16(_mm512_castsi512_si256(ad)));
+            __m512i c1  = _mm512_adds_epu16(_mm512_loadu_si512(c + xp + 32), _mm512_cvtepu8_epi16(_mm512_extracti64x4_epi64(ad, 1)));
+
+            if (pLeftOut)
+            {
+                l  = _mm512_loadu_si512(pLeftOut + xp);
+                r  = _mm512_loadu_si512(pRightOut + xp - d);
+                ad = _mm512_or_si512(_mm512_subs_epu8(l, r), _mm512_subs_epu8(r, l));
+                c0 = _mm512_subs_epu16(c0, _mm512_cvtepu8_epi16(_mm512_castsi512_si256(ad)));
+                c1 = _mm512_subs_epu16(c1, _mm512_cvtepu8_epi16(_mm512_extracti64x4_epi64(ad, 1)));
+            }
+
+            _mm512_storeu_si512(c + xp, c0);
+            _mm512_storeu_si512(c + xp + 32, c1);
+        }
+#endif
+#if defined(__AVX2__)
+        for (; xp <= nPadWidth - 32; xp += 32)
+        {
+            __m256i l   = _mm256_loadu_si256((const __m256i*)(pLeftIn + xp));
+            __m256i r   = _mm256_loadu_si256((const __m256i*)(pRightIn + xp - d));
+            __m256i ad  = _mm256_or_si256(_mm256_subs_epu8(l, r), _mm256_subs_epu8(r, l));
+            __m256i c0  = _mm256_adds_epu16(_mm256_loadu_si256((const __m256i*)(c + xp)),
+                                            _mm256_cvtepu8_epi16(_mm256_castsi256_si128(ad)));
+            __m256i c1  = _mm256_adds_epu16(_mm256_loadu_si256((const __m256i*)(c + xp + 16)),
+                                            _mm256_cvtepu8_epi16(_mm256_extracti128_si256(ad, 1)));
+
+            if (pLeftOut)
+            {
+                l  = _mm256_loadu_si256((const __m256i*)(pLeftOut + xp));
+                r  = _mm256_loadu_si256((const __m256i*)(pRightOut + xp - d));
+                ad = _mm256_or_si256(_mm256_subs_epu8(l, r), _mm256_subs_epu8(r, l));
+                c0 = _mm256_subs_epu16(c0, _mm256_cvtepu8_epi16(_mm256_castsi256_si128(ad)));
+                c1 = _mm256_subs_epu16(c1, _mm256_cvtepu8_epi16(_mm256_extracti128_si256(ad, 1)));
+            }
+
+            _mm256_storeu_si256((__m256i*)(c + xp), c0);
+            _mm256_storeu_si256((__m256i*)(c + xp + 16), c1);
+        }
+#endif
+#if defined(TQC_KERNEL_SSE41)
+        for (; xp <= nPadWidth - 16; xp += 16)
+        {
+            __m128i l   = _mm_loadu_si128((const __m128i*)(pLeftIn + xp));
+            __m128i r   = _mm_loadu_si128((const __m128i*)(pRightIn + xp - d));
+            __m128i ad  = _mm_or_si128(_mm_subs_epu8(l, r), _mm_subs_epu8(r, l));
+            __m128i c0  = _mm_adds_epu16(_mm_loadu_si128((const __m128i*)(c + xp)), _mm_cvtepu8_epi16(ad));
+            __m128i c1  = _mm_adds_epu16(_mm_loadu_si128((const __m128i*)(c + xp + 8)),
+                                         _mm_unpackhi_epi8(ad, _mm_setzero_si128()));
+
+            if (pLeftOut)
+            {
+                l  = _mm_loadu_si128((const __m128i*)(pLeftOut + xp));
+                r  = _mm_loadu_si128((const __m128i*)(pRightOut + xp - d));
+                ad = _mm_or_si128(_mm_subs_epu8(l, r), _mm_subs_epu8(r, l));
+                c0 = _mm_subs_epu16(c0, _mm_cvtepu8_epi16(ad));
+                c1 = _mm_subs_epu16(c1, _mm_unpackhi_epi8(ad, _mm_setzero_si128()));
+            }
+
+            _mm_storeu_si128((__m128i*)(c + xp), c0);
+            _mm_storeu_si128((__m128i*)(c + xp + 8), c1);
+        }
+#elif CV_SIMD128
+        for (; xp <= nPadWidth - 16; xp += 16)
+        {
+            v_uint16x8 in0, in1, c0 = v_load(c + xp), c1 = v_load(c + xp + 8);
+
+            v_expand(v_absdiff(v_load(pLeftIn + xp), v_load(pRightIn + xp - d)), in0, in1);
+            c0 = c0 + in0;
+            c1 = c1 + in1;
+
+            if (pLeftOut)
+            {
+                v_uint16x8 out0, out1;
+
+                v_expand(v_absdiff(v_load(pLeftOut + xp), v_load(pRightOut + xp - d)), out0, out1);
+                c0 = c0 - out0;
+                c1 = c1 - out1;
+            }
+
+            v_store(c + xp, c0);
+            v_store(c + xp + 8, c1);
+        }
+#endif
+        for (; xp < nPadWidth; xp++)
+        {
+            int v = c[xp] + abs(pLeftIn[xp] - pRightIn[xp - d]);
+
+            if (pLeftOut)
+            {
+                v -= abs(pLeftOut[xp] - pRightOut[xp - d]);
+            }
+
+            c[xp] = (ushort)v;
+        }
+    }
+}
+
+// Block sums of one disparity: pCost[x] = pCol[x] + ... + pCol[x + nBlock - 1]. With a constant
+// nBlock the k loop is unrolled completely.
+static inline void BoxRow(const ushort *pCol, ushort *pCost, int nWidth, int nBlock)
+{
+    int x = 0;
+
+#if defined(TQC_KERNEL_SSE41)
+    for (; x <= nWidth - 8; x += 8)
+    {
+        __m128i s = _mm_loadu_si128((const __m128i*)(pCol + x));
+
+        for (int k = 1; k < nBlock; k++)
+        {
+            s = _mm_add_epi16(s, _mm_loadu_si128((const __m128i*)(pCol + x + k)));
+        }
+
+        _mm_storeu_si128((__m128i*)(pCost + x), s);
+    }
+#elif CV_SIMD128
+    for (; x <= nWidth - 8; x += 8)
+    {
+        v_uint16x8 s = v_load(pCol + x);
+
+        for (int k = 1; k < nBlock; k++)
+        {
+            s = s + v_load(pCol + x + k);
+        }
+
+        v_store(pCost + x, s);
+    }
+#endif
+    for (; x < nWidth; x++)
+    {
+        int s = pCol[x];
+
+        for (int k = 1; k < nBlock; k++)
+        {
+            s += pCol[x + k];
+        }
+
+        pCost[x] = (ushort)s;
+    }
+}
+
+// Winner-takes-all over pCost[d * nWidth + x] with the StereoSGBM uniqueness test and a parabola
+// sub-pixel fit. pMin/pBest/pSecond are nWidth scratch entries.
+static inline void SelectRow(const ushort *pCost,
+                             int nWidth,
+                             int nNumDisparities,
+                             int nUniquenessRatio,
+                             ushort *pMin,
+                             ushort *pBest,
+                             ushort *pSecond,
+                             short *pDisp)
+{
+    int x = 0;
+
+#if defined(TQC_KERNEL_SSE41)
+    // No unsigned 16-bit compare before AVX-512, flipping the sign bit makes the signed one work.
+    const __m128i vSign = _mm_set1_epi16((short)0x8000);
+    const __m128i vOne  = _mm_set1_epi16(1);
+    const __m128i vMax  = _mm_set1_epi16(-1);
+
+    for (; x <= nWidth - 8; x += 8)
+    {
+        __m128i vMin    = vMax;
+        __m128i vBest   = _mm_setzero_si128();
+        __m128i vSecond = vMax;
+        __m128i vD;
+
+        for (int d = 0; d < nNumDisparities; d++)
+        {
+            __m128i c    = _mm_loadu_si128((const __m128i*)(pCost + (size_t)d * nWidth + x));
+            __m128i less = _mm_cmplt_epi16(_mm_xor_si128(c, vSign), _mm_xor_si128(vMin, vSign));
+
+            vD    = _mm_set1_epi16((short)d);
+            vMin  = _mm_min_epu16(vMin, c);
+            vBest = _mm_blendv_epi8(vBest, vD, less);
+        }
+
+        // Second pass for the best cost more than one disparity away from the winner.
+        for (int d = 0; d < nNumDisparities; d++)
+        {
+            __m128i c = _mm_loadu_si128((const __m128i*)(pCost + (size_t)d * nWidth + x));
+            __m128i far;
+
+            vD      = _mm_set1_epi16((short)d);
+            far     = _mm_or_si128(_mm_cmpgt_epi16(vD, _mm_add_epi16(vBest, vOne)), _mm_cmplt_epi16(_mm_add_epi16(vD, vOne), vBest));
+            vSecond = _mm_min_epu16(vSecond, _mm_blendv_epi8(vMax, c, far));
+        }
+
+        _mm_storeu_si128((__m128i*)(pMin + x), vMin);
+        _mm_storeu_si128((__m128i*)(pBest + x), vBest);
+        _mm_storeu_si128((__m128i*)(pSecond + x), vSecond);
+    }
+#elif CV_SIMD128
+    for (; x <= nWidth - 8; x += 8)
+    {
+        v_uint16x8 vMin    = v_setall_u16(USHRT_MAX);
+        v_uint16x8 vBest   = v_setall_u16(0);
+        v_uint16x8 vSecond = v_setall_u16(USHRT_MAX);
+        v_uint16x8 vOne    = v_setall_u16(1);
+        v_uint16x8 vD;
+
+        for (int d = 0; d < nNumDisparities; d++)
+        {
+            v_uint16x8 c    = v_load(pCost + (size_t)d * nWidth + x);
+            v_uint16x8 less = c < vMin;
+
+            vD    = v_setall_u16((ushort)d);
+            vMin  = v_min(vMin, c);
+            vBest = v_select(less, vD, vBest);
+        }
+
+        // Second pass for the best cost more than one disparity away from the winner.
+        for (int d = 0; d < nNumDisparities; d++)
+        {
+            v_uint16x8 c   = v_load(pCost + (size_t)d * nWidth + x);
+            v_uint16x8 far;
+
+            vD      = v_setall_u16((ushort)d);
+            far     = (vD > vBest + vOne) | (vD + vOne < vBest);
+            vSecond = v_min(vSecond, v_select(far, c, v_setall_u16(USHRT_MAX)));
+        }
+
+        v_store(pMin + x, vMin);
+        v_store(pBest + x, vBest);
+        v_store(pSecond + x, vSecond);
+    }
+#endif
+    for (; x < nWidth; x++)
+    {
+        int minS   = USHRT_MAX;
+        int best   = 0;
+        int second = USHRT_MAX;
+
+        for (int d = 0; d < nNumDisparities; d++)
+        {
+            int c = pCost[(size_t)d * nWidth + x];
+
+            if (c < minS)
+            {
+                minS = c;
+                best = d;
+            }
+        }
+
+        for (int d = 0; d < nNumDisparities; d++)
+        {
+            if (d - best > 1 || best - d > 1)
+            {
+                second = KernelMin(second, (int)pCost[(size_t)d * nWidth + x]);
+            }
+        }
+
+        pMin[x]    = (ushort)minS;
+        pBest[x]   = (ushort)best;
+        pSecond[x] = (ushort)second;
+    }
+
+    for (x = 0; x < nWidth; x++)
+    {
+        int best = pBest[x];
+        int minS = pMin[x];
+
+        // Not every disparity has a match in the right image this close to the left border.
+        if (x < nNumDisparities - 1 || pSecond[x] * (100 - nUniquenessRatio) < minS * 100)
+        {
+            pDisp[x] = TQC_BLOCK_MATCH_INVALID_DISP;
+            continue;
+        }
+
+        int d = best * 16;
+        if (0 < best && best < nNumDisparities - 1)
+        {
+            int cm     = pCost[(size_t)(best - 1) * nWidth + x];
+            int cp     = pCost[(size_t)(best + 1) * nWidth + x];
+            int denom2 = KernelMax(cm + cp - 2 * minS, 1);
+
+            d += ((cm - cp) * 16 + denom2) / (denom2 * 2);
+        }
+
+        pDisp[x] = (short)d;
+    }
+}
+
+// Rows [nBegin, nEnd) of the disparity. BLOCK and DISP are the compile-time block size and number
+// of disparities, 0 takes the value from stBlockMatchRows instead (the generic kernel).
+template <int BLOCK, int DISP>
+static void BlockMatchBand(const stBlockMatchRows *p, int nBegin, int nEnd, ushort *pBuf)
+{
+    const int nBlock    = BLOCK > 0 ? BLOCK : p->nBlock;
+    const int D         = DISP > 0 ? DISP : p->nNumDisparities;
+    const int nWidth    = p->nWidth;
+    const int nPadWidth = nWidth + nBlock - 1;
+    ushort    *pCol     = pBuf;
+    ushort    *pCost    = pCol + (size_t)D * nPadWidth;
+    ushort    *pScratch = pCost + (size_t)D * nWidth;
+
+    for (size_t i = 0; i < (size_t)D * nPadWidth; i++)
+    {
+        pCol[i] = 0;
+    }
+
+    // Window of row nBegin minus its last row, that one is added by the first iteration below.
+    for (int k = 0; k < nBlock - 1; k++)
+    {
+        SadColumnUpdate<DISP>(p->pLeft + (nBegin + k) * p->nStep, p->pRight + (nBegin + k) * p->nStep,
+                              NULL, NULL, pCol, nPadWidth, D);
+    }
+
+    for (int y = nBegin; y < nEnd; y++)
+    {
+        const uchar *pLeftIn  = p->pLeft + (y + nBlock - 1) * p->nStep;
+        const uchar *pRightIn = p->pRight + (y + nBlock - 1) * p->nStep;
+
+        if (y > nBegin)
+        {
+            SadColumnUpdate<DISP>(pLeftIn, pRightIn, p->pLeft + (y - 1) * p->nStep, p->pRight + (y - 1) * p->nStep,
+                                  pCol, nPadWidth, D);
+        }
+        else
+        {
+            SadColumnUpdate<DISP>(pLeftIn, pRightIn, NULL, NULL, pCol, nPadWidth, D);
+        }
+
+        for (int d = 0; d < D; d++)
+        {
+            BoxRow(pCol + (size_t)d * nPadWidth, pCost + (size_t)d * nWidth, nWidth, nBlock);
+        }
+
+        SelectRow(pCost, nWidth, D, p->nUniquenessRatio, pScratch, pScratch + nWidth, pScratch + nWidth * 2,
+                  p->pDisp + y * p->nDispStep);
+    }
+}
+
+// ParallelFor() items are the bands of stBlockMatchRows, each with its own scratch.
+template <int BLOCK, int DISP>
+static void BlockMatchRows(void *pParam, int nBegin, int nEnd)
+{
+    const stBlockMatchRows *p = (const stBlockMatchRows*)pParam;
+
+    for (int i = nBegin; i < nEnd; i++)
+    {
+        BlockMatchBand<BLOCK, DISP>(p, p->nHeight * i / p->nBands, p->nHeight * (i + 1) / p->nBands, p->pBuf + p->nBandBuf * i);
+    }
+}
+
+// Kernels compiled for the usual block sizes x number of disparities, the generic one last.
+// TQC_SAD_WINDOW_SIZE and TQC_NUM_DISPARITIES of the production build are among them.
+static const stBlockMatchKernel g_blockMatchKernels[] =
+{
+    { 5,  16, BlockMatchRows<5,  16> },
+    { 5,  32, BlockMatchRows<5,  32> },
+    { 5,  64, BlockMatchRows<5,  64> },
+    { 9,  16, BlockMatchRows<9,  16> },
+    { 9,  32, BlockMatchRows<9,  32> },
+    { 9,  64, BlockMatchRows<9,  64> },
+    { 15, 16, BlockMatchRows<15, 16> },
+    { 15, 32, BlockMatchRows<15, 32> },
+    { 15, 64, BlockMatchRows<15, 64> },
+    { 0,  0,  BlockMatchRows<0,  0> }
+};
+
+} // namespace
+
+#endif /* __STEREO_KERNELS_IMPL_H */
\ No newline at end of file
@@ -0,0 +1,18 @@
+// SSE4.1 + POPCNT kernels. MSVC accepts these intrinsics without extra flags, GCC and Clang need
+// -msse4.1 -mpopcnt on this file.
+
+#include "StereoKernels.h"
+
+#if defined(__SSE4_1__) && defined(__POPCNT__) || defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define TQC_KERNEL_SSE41
+#include "StereoKernelsImpl.h"
+
+static const stStereoKernels g_stereoKernelsSse41 =
+{
+    TQC_CPU_SSE41, CensusCostRow, SgmAggregateRow, g_blockMatchKernels
+};
+
+const stStereoKernels *const g_pStereoKernelsSse41 = &g_stereoKernelsSse41;
+#else
+const stStereoKernels *const g_pStereoKernelsSse41 = NULL;
+#endif
\ No newline at end of file
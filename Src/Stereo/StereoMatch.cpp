@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <vector>
+#include <atomic>
 
 #include "opencv2/calib3d/calib3d.hpp"
 #include "opencv2/imgproc/imgproc.hpp"
@@ -10,23 +11,66 @@
 
 #include "TqcLog.h"
 #include "TqcUtils.h"
+#include "TqcOs.h"
+#include "TqcTrace.h"
 #include "Config.h"
 #include "StereoVision.h"
 #include "StereoCamera.h"
 #include "StereoMatchAlgorithm.h"
 #include "StereoUtils.h"
+#include "StereoDispFile.h"
+#include "StereoPointCloud.h"
 
 using namespace cv;
 using namespace std;
 
+// Upper bound of --jobs.
+#define TQC_MAX_JOBS 64
+
+
+// Result of one stereo pair, filled by a worker and consumed in order by the main thread.
+typedef struct _stPairJob
+{
+    char              filePre[TQC_MAX_PATH];
+    int               nWidth;
+    int               nHeight;
+    int64             t;
+    int64             timestamp;                // Microseconds, when the disparity was ready.
+    double            d[3][3];
+    bool              bOk;
+    Mat               img1, img2, disp, disp8;  // Kept for the display/disparity file, released in batch mode.
+    std::atomic<bool> bDone;
+} stPairJob;
+
+// Shared state of a --jobs=N run.
+typedef struct _stBatch
+{
+    vector<char*>     *pFileList1;
+    vector<char*>     *pFileList2;
+    stPairJob         *pJobs;
+    int               nCount;
+    std::atomic<int>  nNext;
+    std::atomic<bool> bQuit;
+} stBatch;
+
+typedef struct _stWorker
+{
+    CStereoMatcher matcher;
+    stBatch        *pBatch;
+    void           *hThread;
+} stWorker;
+
+
 int  g_width  = 0;
 int  g_height = 0;
 Mat  g_disp;
-Mat  g_Q;
 Size g_imgSize          = Size(320, 240);
 Size g_camCalibrateSize = Size(320, 240);
 
-void SaveTimeCost(const char *postfixName, const char *strOutputPath, const char *strAlgorithmName, int64 time);
+CDispFileWriter g_dispWriter;
+bool            g_bDispWriter = false;
+
+void SaveTimeCost(const char *postfixName, const char *strOutputPath, const char *strAlgorithmName, int width, int height, int64 time);
 
 // Mouse event handler. Called automatically by OpenCV when the user clicks in the GUI window.
 void OnMouse(int event, int x, int y, int, void*)
@@ -35,21 +79,225 @@ void OnMouse(int event, int x, int y, int, void*)
     if (event != CV_EVENT_LBUTTONDOWN)
         return;
 
+    if (g_option.bFixedPoint)
+    {
+        Point3i p;
+
+        StereoReprojectPixelTo3D(g_disp, g_CamParam.depthLut, Point2i(x, y), p);
+
+        LOGE("(%d, %d, %d): %d, %d, %d\n", x, y, g_disp.at<short>(y, x), p.x, p.y, p.z);
+        return;
+    }
+
     Point3d p;
 
-    StereoReprojectPixelTo3D(g_disp, g_Q, Point2i(x, y), p);
+    StereoReprojectPixelTo3D(g_disp, g_CamParam.depthLut, Point2i(x, y), p);
 
     LOGE("(%d, %d, %d): %f, %f, %f\n", x, y, g_disp.at<short>(y, x), p.x, p.y, p.z);
 }
 
+static bool InitMatcher(CStereoMatcher &matcher)
+{
+    // Default channel's number is 3. --gray keeps loading color, the remap converts it to gray and
+    // SGBM's P1/P2 are set for one channel.
+    if (!matcher.Init(g_option.bGrayRemap ? 1 : 3,
+                      g_CamParam.roi1,
+                      g_CamParam.roi2,
+                      g_option.nNumDisparities,
+                      g_option.nSADWindowSize,
+                      g_imgSize.width,
+                      g_option.algorithm))
+    {
+        return false;
+    }
+
+    matcher.SetCamParam(g_CamParam);
+    matcher.SetTiles(g_option.nTiles);
+    matcher.SetFixedPoint(g_option.bFixedPoint);
+
+    return true;
+}
+
+// Decode, match and write the per-pair output files of one pair. Everything here only touches
+// files named after this pair, so any number of pairs can run at the same time.
+static bool ProcessPair(CStereoMatcher &matcher, const char *leftFile, const char *rightFile, stPairJob &job)
+{
+    int    nColorMode = (g_option.algorithm == TQC_STEREO_BM || g_option.algorithm == TQC_STEREO_CENSUS_SGM ||
+                          g_option.algorithm == TQC_STEREO_PYRAMID || g_option.algorithm == TQC_STEREO_STREAM_SGM ||
+                          g_option.algorithm == TQC_STEREO_SAD || g_option.algorithm == TQC_STEREO_ZSAD ? 0 : -1);
+    size_t len        = strlen(leftFile) - 1;
+    size_t orgLen     = len;
+
+    memset(job.filePre, 0, TQC_MAX_PATH);
+    memset(job.d, 0, sizeof(job.d));
+
+    while (leftFile[len] != '\\')
+    {
+        len--;
+    }
+
+    memcpy(job.filePre, &leftFile[len + 1], orgLen - len);
+
+    {
+        TQC_TRACE_SCOPE("decode");
+        job.img1 = imread(leftFile, nColorMode);
+        job.img2 = imread(rightFile, nColorMode);
+    }
+    if (job.img1.empty() || job.img2.empty())
+    {
+        LOGE("Command-line parameter error: could not load the input image files\n");
+        return false;
+    }
+
+    // Begin time record.
+    int64 t = getTickCount();
+
+    job.nWidth  = job.img1.cols;
+    job.nHeight = job.img1.rows;
+
+    bool bMatched = g_option.bRoiOnly ?
+                    matcher.MatchRoi(job.img1, job.img2, g_option.fScale, job.disp) :
+                    matcher.Match(job.img1, job.img2, g_option.fScale, job.disp);
+    if (!bMatched)
+    {
+        LOGE("%s(%d): cannot match left and right images.", __FUNCTION__, __LINE__);
+        return false;
+    }
+
+#if TQC_FILTER_DEPTH_VALUE
+    // Filter, if depth > 5m, we will skip this.
+    StereoFilterDisp(job.disp, g_CamParam.depthLut, g_option.bFixedPoint);
+#endif
+
+    job.disp8 = StereoGetDisp8FromDisp(job.disp, matcher.GetParam().selector, matcher.GetParam().nNumDisparities);
+    StereoCalcDepthOfVirtualCopter(job.disp, g_CamParam.depthLut, job.d, g_option.bFixedPoint);
+
+    job.t         = getTickCount() - t;
+    job.timestamp = (int64)((t + job.t) * 1000000. / getTickFrequency());
+
+    {
+        TQC_TRACE_SCOPE("save files");
+
+#if TQC_OUTPUT_3D_PCL_TO_FILE
+        if (g_option.strPCLFile)
+        {
+            char buf[TQC_MAX_PATH];
+
+            GetFileName(buf, g_option.strPCLFile, job.filePre, "ply", g_option.strOutputPath, g_option.strAlgorithmName, job.disp.cols, job.disp.rows);
+            StereoSavePly(buf, job.disp, g_CamParam.depthLut, TQC_PLY_WITH_COLOR ? matcher.GetRectifiedLeft() : Mat(), TQC_MAX_DEPTH);
+        }
+#endif
+
+#if TQC_OUTPUT_DISP_TO_IMAGE
+        SavePic(job.filePre, g_option.strOutputPath, g_option.strAlgorithmName, job.disp8);
+#endif
+    }
+
+    return true;
+}
+
+static void* MatchWorker(void *pParam)
+{
+    stWorker *pWorker = (stWorker*)pParam;
+    stBatch  *pBatch  = pWorker->pBatch;
+
+    while (!pBatch->bQuit)
+    {
+        int i = pBatch->nNext++;
+        if (i >= pBatch->nCount)
+            break;
+
+        stPairJob &job = pBatch->pJobs[i];
+
+        job.bOk = ProcessPair(pWorker->matcher, pBatch->pFileList1->at(i), pBatch->pFileList2->at(i), job);
+
+        // Only the summary (and the disparity for the disparity file) is needed from here on.
+        job.img1.release();
+        job.img2.release();
+        job.disp8.release();
+        if (!g_bDispWriter)
+        {
+            job.disp.release();
+        }
+
+        job.bDone = true;
+    }
+
+    return NULL;
+}
+
+// Ordered output of one finished pair: time_cost.log, the depth file and the display.
+// Returns false when the disparity file cannot be written, e.g. the disk is full.
+static bool OutputPair(const stPairJob &job, bool bDisplay)
+{
+    TQC_TRACE_SCOPE("output");
+
+    SaveTimeCost(job.filePre, g_option.strOutputPath, g_option.strAlgorithmName, job.nWidth, job.nHeight, job.t);
+
+    // LOGE("****************************************");
+    // LOGE("* %08.3f * %08.3f * %08.3f *", d[0][0], d[0][1], d[0][2]);
+    // LOGE("* %08.3f * %08.3f * %08.3f *", d[1][0], d[1][1], d[1][2]);
+    // LOGE("* %08.3f * %08.3f * %08.3f *", d[2][0], d[2][1], d[2][2]);
+    // LOGE("****************************************");
+
+#if TQC_OUTPUT_DISP_VALUE_TO_FILE
+    // All frames go to one binary file, use --convert-disp to get the text files for matlab.
+    if (g_bDispWriter && !g_dispWriter.Write(job.disp, g_CamParam.Q, g_option.strAlgorithmName, job.filePre, job.timestamp))
+    {
+        return false;
+    }
+#endif
+
+#if TQC_OUTPUT_VIRTUAL_COPTER_DEPTH_TO_FILE
+    if (g_option.depthFile)
+    {
+        char buf[TQC_MAX_PATH];
+        char *strFileName = GetFileName(buf, "disp", job.filePre, "jpg", g_option.strOutputPath, g_option.strAlgorithmName, job.nWidth, job.nHeight);
+        fprintf(g_option.depthFile, "%s\n", strFileName);
+        fprintf(g_option.depthFile, "****************************************\n");
+        fprintf(g_option.depthFile, "* %08.3f * %08.3f * %08.3f *\n", job.d[0][0], job.d[0][1], job.d[0][2]);
+        fprintf(g_option.depthFile, "* %08.3f * %08.3f * %08.3f *\n", job.d[1][0], job.d[1][1], job.d[1][2]);
+        fprintf(g_option.depthFile, "* %08.3f * %08.3f * %08.3f *\n", job.d[2][0], job.d[2][1], job.d[2][2]);
+        fprintf(g_option.depthFile, "****************************************\n\n");
+    }
+#endif
+
+    if (bDisplay)
+    {
+        g_disp = job.disp;
+
+        namedWindow("left", 1);
+        imshow("left", job.img1);
+        namedWindow("right", 1);
+        imshow("right", job.img2);
+        namedWindow("disparity", 0);
+        imshow("disparity", job.disp8);
+
+        // Get OpenCV to automatically call my "onMouse()" function when the user clicks in the GUI window.
+        setMouseCallback("disparity", OnMouse, 0);
+
+        LOGE("press any key to continue...");
+        fflush(stdout);
+        waitKey();
+        LOGE("\n");
+    }
+
+    return true;
+}
+
 int main(int argc, char **argv)
 {
     vector<char*> fileList1;
     vector<char*> fileList2;
 
-    char  filePre[TQC_MAX_PATH];
-    int64 totalTimeCost       = 0;
-    int   totalFrame          = 0;
+    stPairJob *pLastJob     = NULL;
+    int64     totalTimeCost = 0;
+    int       totalFrame    = 0;
+    int       nRet          = 0;
+    int       nCount        = 0;
+    int       nJobs         = 1;
+    stBatch   batch;
+    stWorker  *pWorkers     = NULL;
 
     if (argc < 3 || !ParseCmd(argc, argv, g_option))
     {
@@ -57,11 +305,24 @@ int main(int argc, char **argv)
         return -1;
     }
 
+    if (g_option.strConvertFile)
+    {
+        return StereoConvertDispFile(g_option.strConvertFile, g_option.strDispFile ? g_option.strDispFile : "disp",
+                                     g_option.strOutputPath) ? 0 : -1;
+    }
+
     if (!CheckOption(g_option))
     {
         return -1;
     }
 
+    TqcTraceEnable(g_option.strTraceFile != NULL);
+
+    if (!StartScheduler(g_option))
+    {
+        return -1;
+    }
+
     // Add files to file list.
     if (g_option.strLeftFile && g_option.strRightFile)
     {
@@ -86,151 +347,148 @@ int main(int argc, char **argv)
         return -1;
     }
 
-    // Default channel's number is 3.
-    if (!StereoInitAlgorithm(3,
-                             g_CamParam.roi1,
-                             g_CamParam.roi2,
-                             g_option.nNumDisparities,
-                             g_option.nSADWindowSize,
-                             g_imgSize.width,
-                             g_option.algorithm))
+    nCount = (int)min(fileList1.size(), fileList2.size());
+    nJobs  = min(min(g_option.nJobs, TQC_MAX_JOBS), max(nCount, 1));
+
+    // The display waits for a key after every pair, that only makes sense one pair at a time.
+    if (nJobs > 1 && g_option.bDisplay)
     {
-        return -1;
+        LOGE("%s(%d): --jobs=%d disables the display.\n", __FUNCTION__, __LINE__, nJobs);
     }
 
-    // Loop all files.
-    for (int i = 0; i < fileList1.size() && i < fileList2.size(); i++)
+#if TQC_OUTPUT_DISP_VALUE_TO_FILE
+    if (g_option.strDispFile)
     {
-        int    nColorMode = (g_option.algorithm == TQC_STEREO_BM ? 0 : -1);
-        double d[3][3]    = { 0.0f };
-        Mat    img1       = imread(fileList1.at(i), nColorMode);
-        Mat    img2       = imread(fileList2.at(i), nColorMode);
-
-        char   path[TQC_MAX_PATH];
-        char   *leftFilePre = fileList1.at(i);
-        size_t len          = strlen(leftFilePre) - 1;
-        size_t orgLen       = len;
-        Mat     disp;
-        Mat     disp8;
-
-        memset(path, 0, TQC_MAX_PATH);
-        memset(filePre, 0, TQC_MAX_PATH);
-
-        while (leftFilePre[len] != '\\')
-        {
-            len--;
-        }
+        char buf[TQC_MAX_PATH];
 
-        memcpy(path, leftFilePre, len + 1);
-        memcpy(filePre, &leftFilePre[len + 1], orgLen - len);
+        memset(buf, 0, TQC_MAX_PATH);
+        sprintf(buf, "%s/%s_%s.%s", g_option.strOutputPath, g_option.strDispFile, g_option.strAlgorithmName, TQC_DISP_FILE_EXT);
 
-        if (img1.empty() || img2.empty())
+        g_bDispWriter = g_dispWriter.Open(buf);
+        if (!g_bDispWriter)
         {
-            LOGE("Command-line parameter error: could not load the input image files\n");
             return -1;
         }
+    }
+#endif
 
-        // Begin time record.
-        int64 t = getTickCount();
+    batch.pFileList1 = &fileList1;
+    batch.pFileList2 = &fileList2;
+    batch.pJobs      = new stPairJob[max(nCount, 1)];
+    batch.nCount     = nCount;
+    batch.nNext      = 0;
+    batch.bQuit      = false;
 
-        Size imgSize = img1.size();
+    for (int i = 0; i < nCount; i++)
+    {
+        batch.pJobs[i].bOk   = false;
+        batch.pJobs[i].bDone = false;
+    }
 
-        g_width = imgSize.width;
-        g_height = imgSize.height;
+    // Every worker has its own matcher, so pairs are matched at the same time.
+    pWorkers = new stWorker[nJobs];
+    for (int k = 0; k < nJobs; k++)
+    {
+        pWorkers[k].pBatch  = &batch;
+        pWorkers[k].hThread = NULL;
+    }
 
-        if (!StereoMatch(img1, img2, g_option.fScale, g_option.algorithm, g_CamParam, disp))
+    for (int k = 0; k < nJobs; k++)
+    {
+        if (!InitMatcher(pWorkers[k].matcher))
         {
-            LOGE("%s(%d): cannot match left and right images.", __FUNCTION__, __LINE__);
-            return -1;
+            nRet = -1;
+            break;
         }
 
-        g_disp = disp;
-
-#if TQC_FILTER_DEPTH_VALUE
-        // Filter, if depth > 5m, we will skip this.
-        StereoFilterDisp(disp, g_CamParam.Q);
-#endif
+        if (nJobs > 1)
+        {
+            pWorkers[k].hThread = TqcOsCreateThread((void*)MatchWorker, &pWorkers[k]);
+            if (!pWorkers[k].hThread)
+            {
+                LOGE("%s(%d): cannot create match worker %d.", __FUNCTION__, __LINE__, k);
+                nRet = -1;
+                break;
+            }
+        }
+    }
 
-        disp8 = StereoGetDisp8FromDisp(disp, g_algorithmParam.selector, g_algorithmParam.nNumDisparities);
-        StereoCalcDepthOfVirtualCopter(disp, g_CamParam.Q, d);
+    // Loop all files. Output that goes to shared files is written here, in file list order.
+    for (int i = 0; nRet == 0 && i < nCount; i++)
+    {
+        stPairJob &job = batch.pJobs[i];
 
-        // Output time cost.
-        t = getTickCount() - t;
-        SaveTimeCost(filePre, g_option.strOutputPath, g_option.strAlgorithmName, t);
-        if (i != 0)
+        if (nJobs > 1)
         {
-            totalFrame++;
-            totalTimeCost += t;
+            while (!job.bDone)
+            {
+                TqcOsSleep(1);
+            }
+        }
+        else
+        {
+            job.bOk = ProcessPair(pWorkers[0].matcher, fileList1.at(i), fileList2.at(i), job);
         }
 
-        // LOGE("****************************************");
-        // LOGE("* %08.3f * %08.3f * %08.3f *", d[0][0], d[0][1], d[0][2]);
-        // LOGE("* %08.3f * %08.3f * %08.3f *", d[1][0], d[1][1], d[1][2]);
-        // LOGE("* %08.3f * %08.3f * %08.3f *", d[2][0], d[2][1], d[2][2]);
-        // LOGE("****************************************");
-
-#if TQC_OUTPUT_VIRTUAL_COPTER_DEPTH_TO_FILE
-        if (g_option.depthFile)
+        if (!job.bOk)
         {
-            char *strFileName = GetFileName("disp", filePre, "jpg", g_option.strOutputPath, g_option.strAlgorithmName, imgSize.width, imgSize.height);
-            fprintf(g_option.depthFile, "%s\n", strFileName);
-            fprintf(g_option.depthFile, "****************************************\n");
-            fprintf(g_option.depthFile, "* %08.3f * %08.3f * %08.3f *\n", d[0][0], d[0][1], d[0][2]);
-            fprintf(g_option.depthFile, "* %08.3f * %08.3f * %08.3f *\n", d[1][0], d[1][1], d[1][2]);
-            fprintf(g_option.depthFile, "* %08.3f * %08.3f * %08.3f *\n", d[2][0], d[2][1], d[2][2]);
-            fprintf(g_option.depthFile, "****************************************\n\n");
+            nRet = -1;
+            break;
         }
-#endif
 
-#if TQC_OUTPUT_DISP_VALUE_TO_FILE
-        // benet-add for matlab display
-        if (g_option.strDispFile)
+        g_width  = job.nWidth;
+        g_height = job.nHeight;
+
+        if (!OutputPair(job, nJobs == 1 && g_option.bDisplay))
         {
-            // LOGE("Q Matrix: 0x%X\n", Q.type());
-            // LOGE("%f %f %f %f\n", Q.at<double>(0, 0), Q.at<double>(0, 1), Q.at<double>(0, 2), Q.at<double>(0, 3));
-            // LOGE("%f %f %f %f\n", Q.at<double>(1, 0), Q.at<double>(1, 1), Q.at<double>(1, 2), Q.at<double>(1, 3));
-            // LOGE("%f %f %f %f\n", Q.at<double>(2, 0), Q.at<double>(2, 1), Q.at<double>(2, 2), Q.at<double>(2, 3));
-            // LOGE("%f %f %f %f\n", Q.at<double>(3, 0), Q.at<double>(3, 1), Q.at<double>(3, 2), Q.at<double>(3, 3));
-            SaveDispData(g_option.strDispFile, filePre, g_option.strOutputPath, g_option.strAlgorithmName, disp);
+            nRet = -1;
+            break;
         }
-#endif
 
-        if (g_option.bDisplay)
+        if (i != 0)
         {
-            namedWindow("left", 1);
-            imshow("left", img1);
-            namedWindow("right", 1);
-            imshow("right", img2);
-            namedWindow("disparity", 0);
-            imshow("disparity", disp8);
-
-            // Get OpenCV to automatically call my "onMouse()" function when the user clicks in the GUI window.
-            setMouseCallback("disparity", OnMouse, 0);
-
-            LOGE("press any key to continue...");
-            fflush(stdout);
-            waitKey();
-            LOGE("\n");
+            totalFrame++;
+            totalTimeCost += job.t;
         }
 
-#if TQC_OUTPUT_3D_PCL_TO_FILE
-        if (g_option.strPCLFile)
+        pLastJob = &job;
+
+        // The output is written, only the summary of the last pair is needed from here on.
+        job.img1.release();
+        job.img2.release();
+        job.disp8.release();
+        job.disp.release();
+    }
+
+    batch.bQuit = true;
+    for (int k = 0; k < nJobs; k++)
+    {
+        if (pWorkers[k].hThread)
         {
-            LOGE("storing the point cloud...");
-            fflush(stdout);
-            Mat xyz;
-            reprojectImageTo3D(disp, xyz, g_CamParam.Q, true);
-            SaveXYZData(g_option.strPCLFile, filePre, g_option.strOutputPath, g_option.strAlgorithmName, xyz);
-            LOGE("\n");
+            TqcOsJoinThread(pWorkers[k].hThread);
         }
-#endif
+    }
 
-#if TQC_OUTPUT_DISP_TO_IMAGE
-        SavePic(filePre, g_option.strOutputPath, g_option.strAlgorithmName, disp8);
-#endif
+    if (nRet == 0 && pLastJob && totalFrame > 0)
+    {
+        SaveTimeCost(pLastJob->filePre, g_option.strOutputPath, g_option.strAlgorithmName,
+                     pLastJob->nWidth, pLastJob->nHeight, totalTimeCost / totalFrame);
+    }
+
+    if (!g_dispWriter.Close())
+    {
+        LOGE("%s(%d): cannot write the index of the disparity file.", __FUNCTION__, __LINE__);
+        nRet = -1;
+    }
+
+    if (g_option.strTraceFile)
+    {
+        TqcTraceDump(g_option.strTraceFile);
+        TqcTraceSummary(NULL);
     }
 
-    SaveTimeCost(filePre, g_option.strOutputPath, g_option.strAlgorithmName, totalTimeCost / totalFrame);
+    delete[] pWorkers;
+    delete[] batch.pJobs;
 
     for (int i = 0; i < fileList1.size(); i++)
     {
@@ -253,14 +511,14 @@ int main(int argc, char **argv)
     fileList1.clear();
     fileList2.clear();
 
-    return 0;
+    return nRet;
 }
 
-void SaveTimeCost(const char *postfixName, const char *strOutputPath, const char *strAlgorithmName, int64 time)
+void SaveTimeCost(const char *postfixName, const char *strOutputPath, const char *strAlgorithmName, int width, int height, int64 time)
 {
     static int i = 0;
     char       fileName[TQC_MAX_PATH];
-    char       *strPicName = NULL;
+    char       picName[TQC_MAX_PATH];
     FILE       *fp         = NULL;
     float      fTime       = 0.0f;
 
@@ -277,6 +535,7 @@ void SaveTimeCost(const char *postfixName, const char *strOutputPath, const char
         return;
     }
 
-    strPicName = GetFileName("disp", postfixName, "jpg", strOutputPath, strAlgorithmName, g_width, g_height);
-    fprintf(fp, "%s: %8.3fms\n", strPicName, fTime);
+    GetFileName(picName, "disp", postfixName, "jpg", strOutputPath, strAlgorithmName, width, height);
+    fprintf(fp, "%s: %8.3fms\n", picName, fTime);
+    fclose(fp);
 }
\ No newline at end of file
@@ -1,21 +1,180 @@
 #include <opencv2/imgproc/imgproc.hpp>
 
 #include "TqcLog.h"
+#include "TqcTrace.h"
+#include "TqcScheduler.h"
 #include "Config.h"
 #include "StereoMatchAlgorithm.h"
 #include "StereoUtils.h"
 
-stAlgorithmParam g_algorithmParam;
-Ptr<StereoBM>    g_bm   = StereoBM::create(16, 9);
-Ptr<StereoSGBM>  g_sgbm = StereoSGBM::create(0, 16, 3);
+// Matcher behind the StereoInitAlgorithm()/StereoMatch() wrappers.
+static CStereoMatcher g_defaultMatcher;
 
-bool StereoInitAlgorithm(int nChannels,
-                         Rect roi1,
-                         Rect roi2,
-                         int nNumDisparities,
-                         int nSADWindowSize,
-                         int imgWidth,
-                         enAlgorithm selector)
+// ParallelFor() items of RemapPair(): item i is band i / 2 of the left (even) or right (odd) image.
+typedef struct _stRemapBands
+{
+    const Mat   *pSrc[2];
+    const Mat   *pMap1[2];
+    const Mat   *pMap2[2];
+    Mat         *pDst[2];
+    int         nBands;
+} stRemapBands;
+
+// BGR2GRAY weights of cvtColor(), 14 fraction bits.
+#define TQC_GRAY_B 1868
+#define TQC_GRAY_G 9617
+#define TQC_GRAY_R 4899
+
+// Luminance of one BGR pixel with 14 fraction bits, 0 outside the image like remap()'s BORDER_CONSTANT.
+static inline unsigned GrayTap(const Mat &src, int x, int y)
+{
+    if ((unsigned)x >= (unsigned)src.cols || (unsigned)y >= (unsigned)src.rows)
+        return 0;
+
+    const uchar *p = src.ptr<uchar>(y) + x * 3;
+    return p[0] * TQC_GRAY_B + p[1] * TQC_GRAY_G + p[2] * TQC_GRAY_R;
+}
+
+// Bilinear remap of a CV_8UC3 BGR image straight into CV_8UC1 gray, one read of the source and one
+// write of the output instead of a 3-channel remap plus cvtColor(). map1/map2 are the CV_16SC2 +
+// CV_16UC1 maps of convertMaps(): integer position and (fy << INTER_BITS) | fx. The four taps are
+// weighted in 1/32 steps like remap() does, in integers only (255 << 24 still fits 32 bits). The
+// output is within 1 of cvtColor(remap()), which rounds once per channel and once more to gray.
+static void RemapBgrToGray(const Mat &src, Mat &dst, const Mat &map1, const Mat &map2)
+{
+    for (int y = 0; y < dst.rows; y++)
+    {
+        const short  *pXY  = map1.ptr<short>(y);
+        const ushort *pA   = map2.empty() ? NULL : map2.ptr<ushort>(y);
+        uchar        *pDst = dst.ptr<uchar>(y);
+
+        for (int x = 0; x < dst.cols; x++)
+        {
+            int      sx  = pXY[x * 2];
+            int      sy  = pXY[x * 2 + 1];
+            int      a   = pA ? pA[x] & (INTER_TAB_SIZE2 - 1) : 0;
+            unsigned fx  = a & (INTER_TAB_SIZE - 1);
+            unsigned fy  = a >> INTER_BITS;
+            unsigned l00, l01, l10, l11;
+
+            if (sx >= 0 && sy >= 0 && sx < src.cols - 1 && sy < src.rows - 1)
+            {
+                const uchar *p0 = src.ptr<uchar>(sy) + sx * 3;
+                const uchar *p1 = p0 + src.step;
+
+                l00 = p0[0] * TQC_GRAY_B + p0[1] * TQC_GRAY_G + p0[2] * TQC_GRAY_R;
+                l01 = p0[3] * TQC_GRAY_B + p0[4] * TQC_GRAY_G + p0[5] * TQC_GRAY_R;
+                l10 = p1[0] * TQC_GRAY_B + p1[1] * TQC_GRAY_G + p1[2] * TQC_GRAY_R;
+                l11 = p1[3] * TQC_GRAY_B + p1[4] * TQC_GRAY_G + p1[5] * TQC_GRAY_R;
+            }
+            else
+            {
+                l00 = GrayTap(src, sx, sy);
+                l01 = GrayTap(src, sx + 1, sy);
+                l10 = GrayTap(src, sx, sy + 1);
+                l11 = GrayTap(src, sx + 1, sy + 1);
+            }
+
+            unsigned sum = (INTER_TAB_SIZE - fx) * (INTER_TAB_SIZE - fy) * l00 + fx * (INTER_TAB_SIZE - fy) * l01 +
+                           (INTER_TAB_SIZE - fx) * fy * l10 + fx * fy * l11;
+
+            pDst[x] = (uchar)((sum + (1u << (INTER_BITS2 + 13))) >> (INTER_BITS2 + 14));
+        }
+    }
+}
+
+static void RemapBands(void *pParam, int nBegin, int nEnd)
+{
+    stRemapBands *pBands = (stRemapBands*)pParam;
+
+    for (int i = nBegin; i < nEnd; i++)
+    {
+        int        k    = i & 1;
+        int        rows = pBands->pDst[k]->rows;
+        Range      band(rows * (i >> 1) / pBands->nBands, rows * ((i >> 1) + 1) / pBands->nBands);
+        Mat        dst  = pBands->pDst[k]->rowRange(band);
+        Mat        map1 = pBands->pMap1[k]->rowRange(band);
+        Mat        map2 = pBands->pMap2[k]->empty() ? Mat() : pBands->pMap2[k]->rowRange(band);
+        const Mat &src  = *pBands->pSrc[k];
+
+        if (dst.channels() == src.channels())
+        {
+            // dst is a view of the preallocated output, so remap() writes in place.
+            remap(src, dst, map1, map2, INTER_LINEAR);
+        }
+        else if (src.type() == CV_8UC3 && map1.type() == CV_16SC2 && (map2.empty() || map2.type() == CV_16UC1))
+        {
+            RemapBgrToGray(src, dst, map1, map2);
+        }
+        else
+        {
+            Mat color;
+
+            remap(src, color, map1, map2, INTER_LINEAR);
+            cvtColor(color, dst, COLOR_BGR2GRAY);
+        }
+    }
+}
+
+// ParallelFor() items of ComputeTiled(): strip i matches rows [pRows[i] - overlap, pRows[i + 1] + overlap)
+// with its own StereoSGBM and copies back only its own rows.
+typedef struct _stSgbmTiles
+{
+    const Mat               *pLeft;
+    const Mat               *pRight;
+    Mat                     *pDisp;
+    Ptr<StereoSGBM>         *pSgbm;
+    Mat                     *pTileDisp;
+    const int               *pRows;
+    int                     nOverlap;
+} stSgbmTiles;
+
+static void ComputeSgbmTiles(void *pParam, int nBegin, int nEnd)
+{
+    stSgbmTiles *pTiles = (stSgbmTiles*)pParam;
+
+    for (int i = nBegin; i < nEnd; i++)
+    {
+        int   r0 = pTiles->pRows[i];
+        int   r1 = pTiles->pRows[i + 1];
+        Range rows(std::max(r0 - pTiles->nOverlap, 0), std::min(r1 + pTiles->nOverlap, pTiles->pLeft->rows));
+
+        pTiles->pSgbm[i]->compute(pTiles->pLeft->rowRange(rows), pTiles->pRight->rowRange(rows), pTiles->pTileDisp[i]);
+        pTiles->pTileDisp[i].rowRange(r0 - rows.start, r1 - rows.start).copyTo(pTiles->pDisp->rowRange(r0, r1));
+    }
+}
+
+CStereoMatcher::CStereoMatcher()
+{
+    m_param.nChannels       = 0;
+    m_param.nNumDisparities = 0;
+    m_param.nSADWindowSize  = 0;
+    m_param.nImgWidth       = 0;
+    m_param.selector        = TQC_STEREO_VALID;
+
+    m_bm   = StereoBM::create(16, 9);
+    m_sgbm = StereoSGBM::create(0, 16, 3);
+
+    m_obstacle.bm = StereoBM::create(16, 9);
+
+    m_nTemporalRefresh = 0;
+    m_nTemporalFrame   = 0;
+    m_nTemporalCap     = 0;
+    m_nTiles           = 1;
+    m_bFixedPoint      = TQC_FIXED_POINT != 0;
+}
+
+CStereoMatcher::~CStereoMatcher()
+{
+}
+
+bool CStereoMatcher::Init(int nChannels,
+                          Rect roi1,
+                          Rect roi2,
+                          int nNumDisparities,
+                          int nSADWindowSize,
+                          int imgWidth,
+                          enAlgorithm selector)
 {
     nNumDisparities = nNumDisparities > 0 ? nNumDisparities : ((imgWidth / 8) + 15) & - 16;
 
@@ -23,33 +182,61 @@ bool StereoInitAlgorithm(int nChannels,
     {
     case TQC_STEREO_BM:
         nSADWindowSize = nSADWindowSize > 0 ? nSADWindowSize : 9;
-        g_bm->setROI1(roi1);
-        g_bm->setROI2(roi2);
-        g_bm->setPreFilterCap(31);
-        g_bm->setBlockSize(nSADWindowSize);
-        g_bm->setMinDisparity(0);
-        g_bm->setNumDisparities(nNumDisparities);
-        g_bm->setTextureThreshold(10);
-        g_bm->setUniquenessRatio(15);
-        g_bm->setSpeckleWindowSize(100);
-        g_bm->setSpeckleRange(32);
-        g_bm->setDisp12MaxDiff(1);
+        m_bm->setROI1(roi1);
+        m_bm->setROI2(roi2);
+        m_bm->setPreFilterCap(31);
+        m_bm->setBlockSize(nSADWindowSize);
+        m_bm->setMinDisparity(0);
+        m_bm->setNumDisparities(nNumDisparities);
+        m_bm->setTextureThreshold(10);
+        m_bm->setUniquenessRatio(15);
+        m_bm->setSpeckleWindowSize(100);
+        m_bm->setSpeckleRange(32);
+        m_bm->setDisp12MaxDiff(1);
         break;
 
     case TQC_STEREO_SGBM:
     case TQC_STEREO_HH:
         nSADWindowSize = nSADWindowSize > 0 ? nSADWindowSize : 3;
-        g_sgbm->setPreFilterCap(63);
-        g_sgbm->setBlockSize(nSADWindowSize);
-        g_sgbm->setP1(8 * nChannels * nSADWindowSize * nSADWindowSize);
-        g_sgbm->setP2(32 * nChannels * nSADWindowSize * nSADWindowSize);
-        g_sgbm->setMinDisparity(0);
-        g_sgbm->setNumDisparities(nNumDisparities);
-        g_sgbm->setUniquenessRatio(10);
-        g_sgbm->setSpeckleWindowSize(100);
-        g_sgbm->setSpeckleRange(32);
-        g_sgbm->setDisp12MaxDiff(1);
-        g_sgbm->setMode(selector == TQC_STEREO_HH ? StereoSGBM::MODE_HH : StereoSGBM::MODE_SGBM);
+        m_sgbm->setPreFilterCap(63);
+        m_sgbm->setBlockSize(nSADWindowSize);
+        m_sgbm->setP1(8 * nChannels * nSADWindowSize * nSADWindowSize);
+        m_sgbm->setP2(32 * nChannels * nSADWindowSize * nSADWindowSize);
+        m_sgbm->setMinDisparity(0);
+        m_sgbm->setNumDisparities(nNumDisparities);
+        m_sgbm->setUniquenessRatio(10);
+        m_sgbm->setSpeckleWindowSize(100);
+        m_sgbm->setSpeckleRange(32);
+        m_sgbm->setDisp12MaxDiff(1);
+        m_sgbm->setMode(selector == TQC_STEREO_HH ? StereoSGBM::MODE_HH : StereoSGBM::MODE_SGBM);
+        break;
+
+    case TQC_STEREO_CENSUS_SGM:
+    case TQC_STEREO_STREAM_SGM:
+        // Census window is fixed at 9x7, the block size is kept only for reporting.
+        nSADWindowSize = nSADWindowSize > 0 ? nSADWindowSize : TQC_CENSUS_WIDTH;
+        if (!m_censusSgm.Init(nNumDisparities, TQC_CENSUS_SGM_PATHS, TQC_CENSUS_SGM_P1, TQC_CENSUS_SGM_P2, 10, 1, 100, 32,
+                              selector == TQC_STEREO_STREAM_SGM))
+        {
+            return false;
+        }
+        break;
+
+    case TQC_STEREO_SAD:
+    case TQC_STEREO_ZSAD:
+        nSADWindowSize = nSADWindowSize > 0 ? nSADWindowSize : TQC_SAD_WINDOW_SIZE;
+        if (!m_blockMatch.Init(nNumDisparities, nSADWindowSize, selector == TQC_STEREO_ZSAD, 15, 100, 32))
+        {
+            return false;
+        }
+        break;
+
+    case TQC_STEREO_PYRAMID:
+        nSADWindowSize = nSADWindowSize > 0 ? nSADWindowSize : 5;
+        if (!m_pyramid.Init(nNumDisparities, nSADWindowSize, TQC_PYRAMID_LEVELS, TQC_PYRAMID_REFINE_RADIUS, 10, 100, 32))
+        {
+            return false;
+        }
         break;
 
     default:
@@ -57,34 +244,131 @@ bool StereoInitAlgorithm(int nChannels,
         return false;
     }
 
-    g_algorithmParam.nNumDisparities = nNumDisparities;
-    g_algorithmParam.nSADWindowSize  = nSADWindowSize;
-    g_algorithmParam.nImgWidth       = imgWidth;
-    g_algorithmParam.selector        = selector;
+    m_param.nChannels       = nChannels;
+    m_param.nNumDisparities = nNumDisparities;
+    m_param.nSADWindowSize  = nSADWindowSize;
+    m_param.nImgWidth       = imgWidth;
+    m_param.selector        = selector;
 
     return true;
 }
 
-bool StereoMatch(Mat left,
-                 Mat right,
-                 float fScale,
-                 enAlgorithm selector,
-                 stCamParam camParam,
-                 Mat &disp)
+// Maps and the depth LUT are shared (Mat reference counting), they are read-only while matching.
+void CStereoMatcher::SetCamParam(const stCamParam &camParam)
 {
-    Mat imgLeft;
-    Mat imgRight;
-    Mat img1r;
-    Mat img2r;
+    m_camParam = camParam;
+}
+
+// Temporal mode for live video: a full match every nRefreshFrames frames, the frames between only
+// search +-TQC_TEMPORAL_RADIUS around the previous disparity. 0 turns it off. Call it after Init():
+// tracking uses the configured block size, the uniqueness ratio and left-right check of the
+// selected matcher, and the StereoBM/StereoSGBM x-Sobel prefilter when one of those is selected.
+bool CStereoMatcher::SetTemporal(int nRefreshFrames)
+{
+    int nUniquenessRatio = 10;
+    int nDisp12MaxDiff   = -1;
+    int nPreFilterCap    = 0;
+
+    switch (m_param.selector)
+    {
+    case TQC_STEREO_BM:
+        nUniquenessRatio = m_bm->getUniquenessRatio();
+        nDisp12MaxDiff   = m_bm->getDisp12MaxDiff();
+        nPreFilterCap    = m_bm->getPreFilterCap();
+        break;
+
+    case TQC_STEREO_SGBM:
+    case TQC_STEREO_HH:
+        nUniquenessRatio = m_sgbm->getUniquenessRatio();
+        nDisp12MaxDiff   = m_sgbm->getDisp12MaxDiff();
+        nPreFilterCap    = m_sgbm->getPreFilterCap();
+        break;
+
+    case TQC_STEREO_CENSUS_SGM:
+    case TQC_STEREO_STREAM_SGM:
+        nUniquenessRatio = m_censusSgm.GetUniquenessRatio();
+        nDisp12MaxDiff   = m_censusSgm.GetDisp12MaxDiff();
+        break;
+
+    case TQC_STEREO_PYRAMID:
+        nUniquenessRatio = m_pyramid.GetUniquenessRatio();
+        nDisp12MaxDiff   = m_pyramid.GetDisp12MaxDiff();
+        break;
+
+    case TQC_STEREO_SAD:
+    case TQC_STEREO_ZSAD:
+        nUniquenessRatio = m_blockMatch.GetUniquenessRatio();
+        break;
+
+    default:
+        break;
+    }
+
+    if (nRefreshFrames > 0 &&
+        !m_temporal.Init(std::max(m_param.nSADWindowSize, 3) | 1, TQC_TEMPORAL_RADIUS, nUniquenessRatio, nDisp12MaxDiff))
+    {
+        return false;
+    }
+
+    m_nTemporalCap = nPreFilterCap;
+
+    m_nTemporalRefresh = std::max(nRefreshFrames, 0);
+    m_nTemporalFrame   = 0;
+    m_prevDisp.release();
+
+    return true;
+}
+
+// Split StereoSGBM/HH into nTiles horizontal strips matched on the task scheduler, see ComputeTiled().
+void CStereoMatcher::SetTiles(int nTiles)
+{
+    m_nTiles = std::max(nTiles, 1);
+}
+
+// Resample with integer weights only. Rectification already is: the maps are CV_16SC2 + CV_16UC1,
+// so remap() uses 1/32 pixel positions (at most 1/64 pixel off the float map) and 15-bit weights.
+// What changes is the separate resize of non-fused scales: INTER_LINEAR with 11-bit weights in both
+// directions, instead of INTER_AREA (float sums for non-integer ratios) and INTER_CUBIC. Disparity
+// stays CV_16S x16, depth and the copter grid go through stDepthLut::depthMm when the callers pass
+// IsFixedPoint() on.
+void CStereoMatcher::SetFixedPoint(bool bFixedPoint)
+{
+    m_bFixedPoint = bFixedPoint;
+}
+
+bool CStereoMatcher::Match(const Mat &left, const Mat &right, float fScale, Mat &disp)
+{
+    const stCamParam &camParam = m_camParam;
+    Mat               imgLeft;
+    Mat               imgRight;
+
+    if (m_param.selector == TQC_STEREO_VALID || camParam.map11.empty())
+    {
+        LOGE("%s(%d): matcher is not initialized.", __FUNCTION__, __LINE__);
+        return false;
+    }
+
+    // Fused maps already include the resize and the cull, one remap gives the matcher input.
+    if (StereoHasFusedMap(camParam, fScale))
+    {
+        {
+            TQC_TRACE_SCOPE("remap");
+            RemapPair(left, right, camParam.fusedMap11, camParam.fusedMap12, camParam.fusedMap21, camParam.fusedMap22,
+                      m_img1r, m_img2r);
+        }
+
+        m_rectLeft = m_img1r;
+        return ComputeDisp(m_img1r, m_img2r, disp);
+    }
 
     if (fScale != 1.f)
     {
-        Mat temp1, temp2;
-        int method = fScale < 1 ? INTER_AREA : INTER_CUBIC;
-        resize(left, temp1, Size(), fScale, fScale, method);
-        imgLeft = temp1;
-        resize(right, temp2, Size(), fScale, fScale, method);
-        imgRight = temp2;
+        TQC_TRACE_SCOPE("resize");
+        int method = m_bFixedPoint ? INTER_LINEAR : fScale < 1 ? INTER_AREA : INTER_CUBIC;
+        resize(left, m_temp1, Size(), fScale, fScale, method);
+        imgLeft = m_temp1;
+        resize(right, m_temp2, Size(), fScale, fScale, method);
+        imgRight = m_temp2;
     }
     else
     {
@@ -92,14 +376,17 @@ bool StereoMatch(Mat left,
         imgRight = right;
     }
 
-    remap(imgLeft, img1r, camParam.map11, camParam.map12, INTER_LINEAR);
-    remap(imgRight, img2r, camParam.map21, camParam.map22, INTER_LINEAR);
+    {
+        TQC_TRACE_SCOPE("remap");
+        RemapPair(imgLeft, imgRight, camParam.map11, camParam.map12, camParam.map21, camParam.map22, m_img1r, m_img2r);
+    }
 
-    imgLeft  = img1r;
-    imgRight = img2r;
+    imgLeft  = m_img1r;
+    imgRight = m_img2r;
 
 #if TQC_STEREO_CULL
     {
+        TQC_TRACE_SCOPE("cull");
         Rect dstRC;
         Mat  dstROI;
 
@@ -111,20 +398,522 @@ bool StereoMatch(Mat left,
     }
 #endif
 
+    m_rectLeft = imgLeft;
+    return ComputeDisp(imgLeft, imgRight, disp);
+}
+
+bool CStereoMatcher::ComputeDisp(const Mat &imgLeft, const Mat &imgRight, Mat &disp)
+{
+    TQC_TRACE_SCOPE("compute");
+    enAlgorithm selector = m_param.selector;
+    bool        bRet     = true;
+
+    if (m_nTemporalRefresh > 0 && ComputeTemporal(imgLeft, imgRight, disp))
+    {
+        return true;
+    }
+
     if (selector == TQC_STEREO_BM)
     {
-        g_bm->compute(imgLeft, imgRight, disp);
+        m_bm->compute(imgLeft, imgRight, disp);
+    }
+    else if ((selector == TQC_STEREO_SGBM || selector == TQC_STEREO_HH) && m_nTiles > 1)
+    {
+        ComputeTiled(imgLeft, imgRight, disp);
     }
     else if (selector == TQC_STEREO_SGBM || selector == TQC_STEREO_HH)
     {
-        g_sgbm->compute(imgLeft, imgRight, disp);
+        m_sgbm->compute(imgLeft, imgRight, disp);
+    }
+    else if (selector == TQC_STEREO_CENSUS_SGM || selector == TQC_STEREO_STREAM_SGM)
+    {
+        bRet = m_censusSgm.Compute(imgLeft, imgRight, disp);
+    }
+    else if (selector == TQC_STEREO_PYRAMID)
+    {
+        bRet = m_pyramid.Compute(imgLeft, imgRight, disp);
+    }
+    else if (selector == TQC_STEREO_SAD || selector == TQC_STEREO_ZSAD)
+    {
+        bRet = m_blockMatch.Compute(imgLeft, imgRight, disp);
+    }
+
+    if (bRet && m_nTemporalRefresh > 0)
+    {
+        disp.copyTo(m_prevDisp);
+        m_nTemporalFrame = 0;
+    }
+
+    return bRet;
+}
+
+// StereoSGBM keeps a width x disparities cost volume and runs on one thread, so every strip gets its
+// own instance, cost volume and worker. The overlap rows let the vertical and diagonal paths settle
+// before a strip's own rows. Speckles are filtered once on the stitched map, so no strip border
+// turns into a speckle border.
+void CStereoMatcher::ComputeTiled(const Mat &imgLeft, const Mat &imgRight, Mat &disp)
+{
+    int              nOverlap = TQC_SGBM_TILE_OVERLAP + m_sgbm->getBlockSize() / 2;
+    int              nTiles   = std::max(std::min(m_nTiles, imgLeft.rows / std::max(nOverlap * 2, 1)), 1);
+    std::vector<int> rows(nTiles + 1);
+    stSgbmTiles      tiles;
+
+    if ((int)m_tileSgbm.size() < nTiles)
+    {
+        m_tileSgbm.resize(nTiles);
+        m_tileDisp.resize(nTiles);
+    }
+
+    for (int i = 0; i < nTiles; i++)
+    {
+        if (m_tileSgbm[i].empty())
+        {
+            m_tileSgbm[i] = StereoSGBM::create(0, 16, 3);
+        }
+
+        m_tileSgbm[i]->setPreFilterCap(m_sgbm->getPreFilterCap());
+        m_tileSgbm[i]->setBlockSize(m_sgbm->getBlockSize());
+        m_tileSgbm[i]->setP1(m_sgbm->getP1());
+        m_tileSgbm[i]->setP2(m_sgbm->getP2());
+        m_tileSgbm[i]->setMinDisparity(m_sgbm->getMinDisparity());
+        m_tileSgbm[i]->setNumDisparities(m_sgbm->getNumDisparities());
+        m_tileSgbm[i]->setUniquenessRatio(m_sgbm->getUniquenessRatio());
+        m_tileSgbm[i]->setSpeckleWindowSize(0);
+        m_tileSgbm[i]->setDisp12MaxDiff(m_sgbm->getDisp12MaxDiff());
+        m_tileSgbm[i]->setMode(m_sgbm->getMode());
+
+        rows[i] = imgLeft.rows * i / nTiles;
+    }
+    rows[nTiles] = imgLeft.rows;
+
+    disp.create(imgLeft.size(), CV_16S);
+
+    tiles.pLeft     = &imgLeft;
+    tiles.pRight    = &imgRight;
+    tiles.pDisp     = &disp;
+    tiles.pSgbm     = &m_tileSgbm[0];
+    tiles.pTileDisp = &m_tileDisp[0];
+    tiles.pRows     = &rows[0];
+    tiles.nOverlap  = nOverlap;
+
+    TqcGetScheduler().ParallelFor(0, nTiles, 1, ComputeSgbmTiles, &tiles);
+
+    if (m_sgbm->getSpeckleWindowSize() > 0)
+    {
+        filterSpeckles(disp, (m_sgbm->getMinDisparity() - 1) * 16, m_sgbm->getSpeckleWindowSize(),
+                       16 * m_sgbm->getSpeckleRange(), m_speckleBuf);
     }
+}
+
+// Track the previous disparity instead of a full match. Pixels the last full match rejected and
+// pixels that fail the window search stay invalid until the next full match, which is the
+// full-range search for them. Returns false when a full match is due instead: refresh frame,
+// size change or too many lost pixels.
+bool CStereoMatcher::ComputeTemporal(const Mat &imgLeft, const Mat &imgRight, Mat &disp)
+{
+    if (m_prevDisp.size() != imgLeft.size() || ++m_nTemporalFrame >= m_nTemporalRefresh)
+    {
+        return false;
+    }
+
+    TQC_TRACE_SCOPE("temporal");
+
+    TemporalInput(imgLeft, m_grayLeft);
+    TemporalInput(imgRight, m_grayRight);
+
+    int nFailed = m_temporal.Refine(m_grayLeft, m_grayRight, m_prevDisp, 1, m_param.nNumDisparities, disp);
+
+    if (nFailed * 100 > imgLeft.cols * imgLeft.rows * TQC_TEMPORAL_MAX_FALLBACK)
+    {
+        return false;
+    }
+
+    // Pixels that found their previous disparity again keep the full match's value, sub-pixel part
+    // included, so a static scene gives the output of the selected matcher.
+    for (int y = 0; y < disp.rows; y++)
+    {
+        const short *pPrev = m_prevDisp.ptr<short>(y);
+        short       *pDisp = disp.ptr<short>(y);
+
+        for (int x = 0; x < disp.cols; x++)
+        {
+            if (pDisp[x] >= 0 && (pDisp[x] + 8) >> 4 == (pPrev[x] + 8) >> 4)
+            {
+                pDisp[x] = pPrev[x];
+            }
+        }
+    }
+
+    // Same speckle filter as the full matches.
+    filterSpeckles(disp, TQC_REFINE_INVALID_DISP, 100, 16 * 32, m_speckleBuf);
+    disp.copyTo(m_prevDisp);
 
     return true;
 }
 
+// 8-bit image the temporal mode matches: gray, or with a prefilter cap the x-Sobel response clipped
+// to +-cap and offset by cap, which is what StereoBM/StereoSGBM compute their costs on.
+void CStereoMatcher::TemporalInput(const Mat &img, Mat &gray)
+{
+    const int cap = m_nTemporalCap;
+
+    if (img.channels() == 3)
+    {
+        cvtColor(img, gray, COLOR_BGR2GRAY);
+    }
+    else if (cap <= 0)
+    {
+        gray = img;
+    }
+    else if (gray.data == img.data)
+    {
+        gray.release();     // Still the caller's image from before the cap was set.
+    }
+
+    if (cap <= 0)
+    {
+        return;
+    }
+
+    Sobel(img.channels() == 3 ? gray : img, m_temporalSobel, CV_16S, 1, 0, 3, 1, 0, BORDER_REPLICATE);
+    gray.create(img.size(), CV_8U);
+
+    for (int y = 0; y < img.rows; y++)
+    {
+        const short *pSobel = m_temporalSobel.ptr<short>(y);
+        uchar       *pGray  = gray.ptr<uchar>(y);
+
+        for (int x = 0; x < img.cols; x++)
+        {
+            pGray[x] = (uchar)(std::min(std::max((int)pSobel[x], -cap), cap) + cap);
+        }
+    }
+}
+
+// Rectify only the virtual copter window into img1r/img2r, plus nSearchRange columns on its
+// left and a small margin around it. temp1/temp2 receive the resized input when fScale != 1.
+// roi is the window in output coordinates, mapRC the same window in full rectified coordinates,
+// dispSize the size of a full Match() output.
+bool CStereoMatcher::RemapCopterWindow(const Mat &left, const Mat &right, float fScale, int nSearchRange,
+                                       Mat &temp1, Mat &temp2, Mat &img1r, Mat &img2r,
+                                       Size &dispSize, Rect &roi, Rect &mapRC)
+{
+    const stCamParam &camParam = m_camParam;
+    Mat               imgLeft;
+    Mat               imgRight;
+    Size              rectSize = camParam.map11.size();
+    int               xBorder  = 0;
+    int               yBorder  = 0;
+    bool              bFused   = StereoHasFusedMap(camParam, fScale);
+
+    if (m_param.selector == TQC_STEREO_VALID || camParam.map11.empty())
+    {
+        LOGE("%s(%d): matcher is not initialized.", __FUNCTION__, __LINE__);
+        return false;
+    }
+
+    if (bFused)
+    {
+        imgLeft  = left;
+        imgRight = right;
+    }
+    else if (fScale != 1.f)
+    {
+        TQC_TRACE_SCOPE("resize");
+        int method = m_bFixedPoint ? INTER_LINEAR : fScale < 1 ? INTER_AREA : INTER_CUBIC;
+        resize(left, temp1, Size(), fScale, fScale, method);
+        resize(right, temp2, Size(), fScale, fScale, method);
+        imgLeft  = temp1;
+        imgRight = temp2;
+    }
+    else
+    {
+        imgLeft  = left;
+        imgRight = right;
+    }
+
+    dispSize = rectSize;
+#if TQC_STEREO_CULL
+    xBorder  = TQC_STEREO_CAMERA_X_BORDER;
+    yBorder  = TQC_STEREO_CAMERA_Y_BORDER;
+    dispSize = Size(rectSize.width - xBorder * 2, rectSize.height - yBorder * 2);
+#endif
+
+    // Matchers leave the first nSearchRange columns invalid, so the search range is added on the left.
+    int margin = TQC_VIRTUAL_COPTER_ROI_MARGIN + m_param.nSADWindowSize / 2;
+
+    roi = Rect(TQC_VIRTUAL_COPTER_LEFT - nSearchRange - margin,
+               TQC_VIRTUAL_COPTER_TOP - margin,
+               TQC_VIRTUAL_COPTER_X_SIZE + nSearchRange + margin * 2,
+               TQC_VIRTUAL_COPTER_Y_SIZE + margin * 2);
+
+    roi &= Rect(0, 0, dispSize.width, dispSize.height);
+    if (roi.area() <= 0)
+    {
+        LOGE("%s(%d): virtual copter window is outside of the %dx%d disparity image.", __FUNCTION__, __LINE__,
+             dispSize.width, dispSize.height);
+        return false;
+    }
+
+    // Sub-maps rectify only the pixels inside the window.
+    mapRC = roi + Point(xBorder, yBorder);
+
+    TQC_TRACE_SCOPE("remap roi");
+    if (bFused)
+    {
+        RemapPair(imgLeft, imgRight, camParam.fusedMap11(roi), camParam.fusedMap12(roi),
+                  camParam.fusedMap21(roi), camParam.fusedMap22(roi), img1r, img2r);
+    }
+    else
+    {
+        RemapPair(imgLeft, imgRight, camParam.map11(mapRC), camParam.map12(mapRC),
+                  camParam.map21(mapRC), camParam.map22(mapRC), img1r, img2r);
+    }
+
+    return true;
+}
+
+// Rectify left and right into img1r/img2r in row bands on the task scheduler. Left and right
+// bands are interleaved, so both images are rectified at the same time. A matcher initialized with
+// one channel gets BGR input converted to gray in the same pass, see RemapBgrToGray().
+void CStereoMatcher::RemapPair(const Mat &left, const Mat &right,
+                               const Mat &map11, const Mat &map12, const Mat &map21, const Mat &map22,
+                               Mat &img1r, Mat &img2r)
+{
+    CTaskScheduler &scheduler = TqcGetScheduler();
+    stRemapBands   bands;
+    bool           bGray      = m_param.nChannels == 1 && left.channels() == 3;
+
+    // Only the first frame (or a new map size) allocates, later frames write into the same buffers.
+    img1r.create(map11.size(), bGray ? CV_8UC1 : left.type());
+    img2r.create(map21.size(), bGray ? CV_8UC1 : right.type());
+
+    bands.pSrc[0]  = &left;
+    bands.pSrc[1]  = &right;
+    bands.pMap1[0] = &map11;
+    bands.pMap1[1] = &map21;
+    bands.pMap2[0] = &map12;
+    bands.pMap2[1] = &map22;
+    bands.pDst[0]  = &img1r;
+    bands.pDst[1]  = &img2r;
+    bands.nBands   = std::max(1, std::min(img1r.rows / TQC_REMAP_BAND_ROWS, (scheduler.GetWorkerCount() + 1) * 2));
+
+    scheduler.ParallelFor(0, bands.nBands * 2, 1, RemapBands, &bands);
+}
+
+// Only rectify and match the virtual copter window, plus the disparity search range on its left and
+// a small margin around it. The result has the same size as Match()'s output so the copter grid
+// and display code are unchanged, but everything outside the window is invalid.
+bool CStereoMatcher::MatchRoi(const Mat &left, const Mat &right, float fScale, Mat &disp)
+{
+    Mat  dispRoi;
+    Size dispSize;
+    Rect roi;
+    Rect mapRC;
+
+    m_rectLeft.release();
+
+    if (!RemapCopterWindow(left, right, fScale, m_param.nNumDisparities, m_temp1, m_temp2, m_img1r, m_img2r, dispSize, roi, mapRC))
+    {
+        return false;
+    }
+
+    // StereoBM's valid ROIs are in full image coordinates, move them into the window.
+    Rect roi1 = m_bm->getROI1();
+    Rect roi2 = m_bm->getROI2();
+    if (m_param.selector == TQC_STEREO_BM)
+    {
+        m_bm->setROI1(roi1 - mapRC.tl());
+        m_bm->setROI2(roi2 - mapRC.tl());
+    }
+
+    bool bMatched = ComputeDisp(m_img1r, m_img2r, dispRoi);
+
+    if (m_param.selector == TQC_STEREO_BM)
+    {
+        m_bm->setROI1(roi1);
+        m_bm->setROI2(roi2);
+    }
+
+    if (!bMatched)
+    {
+        return false;
+    }
+
+    disp.create(dispSize, CV_16S);
+    disp.setTo(Scalar::all(-16));
+    dispRoi.copyTo(disp(roi));
+
+    return true;
+}
+
+// "Is anything closer than dMaxDepth?" per copter cell. The threshold maps to a minimum disparity,
+// so only the band from there to the end of the search range is matched, inside the copter window.
+// Runs its own StereoBM on its own buffers (m_obstacle) whatever the selector is, the camera
+// parameters must be set.
+bool CStereoMatcher::CheckObstacle(const Mat &left, const Mat &right, float fScale, double dMaxDepth, stObstacleGrid &grid)
+{
+    TQC_TRACE_SCOPE("obstacle");
+    const stDepthLut &lut     = m_camParam.depthLut;
+    stObstacleState  &state   = m_obstacle;
+    const Mat        &dispRoi = state.disp;
+    Size              dispSize;
+    Rect              roi;
+    Rect              mapRC;
+
+    for (int j = 0; j < TQC_VIRTUAL_COPTER_Y_SPLITE; j++)
+    {
+        for (int i = 0; i < TQC_VIRTUAL_COPTER_X_SPLITE; i++)
+        {
+            grid.bHit[j][i] = false;
+            grid.d[j][i]    = TQC_MAX_DEPTH;
+        }
+    }
+
+    if (m_param.selector == TQC_STEREO_VALID || lut.depth.empty())
+    {
+        LOGE("%s(%d): matcher is not initialized.", __FUNCTION__, __LINE__);
+        return false;
+    }
+
+    int nMinDisp = StereoGetMinDisparity(lut, dMaxDepth, m_param.nNumDisparities);
+    int nNumDisp = (m_param.nNumDisparities - nMinDisp + 15) & -16;
+
+    grid.nMinDisparity = nMinDisp;
+
+    // Nothing inside the search range can be that close.
+    if (nMinDisp >= m_param.nNumDisparities)
+    {
+        return true;
+    }
+
+    if (!RemapCopterWindow(left, right, fScale, nMinDisp + nNumDisp, state.temp1, state.temp2, state.img1r, state.img2r,
+                           dispSize, roi, mapRC))
+    {
+        return false;
+    }
+
+    if (state.img1r.channels() == 3)
+    {
+        cvtColor(state.img1r, state.grayLeft, COLOR_BGR2GRAY);
+        cvtColor(state.img2r, state.grayRight, COLOR_BGR2GRAY);
+    }
+    else
+    {
+        state.grayLeft  = state.img1r;
+        state.grayRight = state.img2r;
+    }
+
+    // No speckle filter, the window is too small for it to pay off.
+    state.bm->setPreFilterCap(31);
+    state.bm->setBlockSize(max(m_param.nSADWindowSize, 5) | 1);
+    state.bm->setMinDisparity(nMinDisp);
+    state.bm->setNumDisparities(nNumDisp);
+    state.bm->setTextureThreshold(10);
+    state.bm->setUniquenessRatio(15);
+    state.bm->setSpeckleWindowSize(0);
+    state.bm->setDisp12MaxDiff(1);
+
+    {
+        TQC_TRACE_SCOPE("compute band");
+        state.bm->compute(state.grayLeft, state.grayRight, state.disp);
+    }
+
+    for (int j = 0; j < TQC_VIRTUAL_COPTER_Y_SPLITE; j++)
+    {
+        for (int i = 0; i < TQC_VIRTUAL_COPTER_X_SPLITE; i++)
+        {
+            // Cell in window coordinates.
+            int    x0    = TQC_VIRTUAL_COPTER_LEFT + TQC_VIRTUAL_COPTER_SUB_X * i - roi.x;
+            int    y0    = TQC_VIRTUAL_COPTER_TOP + TQC_VIRTUAL_COPTER_SUB_Y * j - roi.y;
+            int    x1    = min(x0 + TQC_VIRTUAL_COPTER_SUB_X, dispRoi.cols);
+            int    y1    = min(y0 + TQC_VIRTUAL_COPTER_SUB_Y, dispRoi.rows);
+            int    nHits = 0;
+            double dMin  = TQC_MAX_DEPTH;
+
+            for (int y = max(y0, 0); y < y1; y++)
+            {
+                const short *pDisp = dispRoi.ptr<short>(y);
+
+                for (int x = max(x0, 0); x < x1; x++)
+                {
+                    // A best match on the band's first disparity may really be farther away.
+                    if (pDisp[x] <= nMinDisp * 16)
+                        continue;
+
+                    double cur = StereoGetDepthFromLut(lut, pDisp[x]);
+                    if (cur > FLT_EPSILON && cur <= dMaxDepth)
+                    {
+                        nHits++;
+                        dMin = min(dMin, cur);
+                    }
+                }
+            }
+
+            if (nHits >= TQC_OBSTACLE_MIN_PIXELS)
+            {
+                grid.bHit[j][i] = true;
+                grid.d[j][i]    = dMin;
+            }
+        }
+    }
+
+    return true;
+}
+
+CStereoMatcher& StereoGetDefaultMatcher()
+{
+    return g_defaultMatcher;
+}
+
+bool StereoInitAlgorithm(int nChannels,
+                         Rect roi1,
+                         Rect roi2,
+                         int nNumDisparities,
+                         int nSADWindowSize,
+                         int imgWidth,
+                         enAlgorithm selector)
+{
+    return g_defaultMatcher.Init(nChannels, roi1, roi2, nNumDisparities, nSADWindowSize, imgWidth, selector);
+}
+
+bool StereoMatch(Mat left,
+                 Mat right,
+                 float fScale,
+                 enAlgorithm selector,
+                 stCamParam camParam,
+                 Mat &disp)
+{
+    if (selector != g_defaultMatcher.GetParam().selector)
+    {
+        LOGE("%s(%d): algorithm %d was not initialized.", __FUNCTION__, __LINE__, selector);
+        return false;
+    }
+
+    g_defaultMatcher.SetCamParam(camParam);
+    return g_defaultMatcher.Match(left, right, fScale, disp);
+}
+
+bool StereoMatchRoi(Mat left,
+                    Mat right,
+                    float fScale,
+                    enAlgorithm selector,
+                    stCamParam camParam,
+                    Mat &disp)
+{
+    if (selector != g_defaultMatcher.GetParam().selector)
+    {
+        LOGE("%s(%d): algorithm %d was not initialized.", __FUNCTION__, __LINE__, selector);
+        return false;
+    }
+
+    g_defaultMatcher.SetCamParam(camParam);
+    return g_defaultMatcher.MatchRoi(left, right, fScale, disp);
+}
+
 Mat StereoGetDisp8FromDisp(Mat disp, enAlgorithm selector, int nNumDisparities)
 {
+    TQC_TRACE_SCOPE("disp8");
     Mat disp8;
 
     if (selector != TQC_STEREO_VAR)
@@ -139,23 +928,60 @@ Mat StereoGetDisp8FromDisp(Mat disp, enAlgorithm selector, int nNumDisparities)
     return disp8;
 }
 
-double StereoGetDepthFromPixel(const Mat disp, const Mat &Q, const Point2i &pixel)
+double StereoGetDepthFromPixel(const Mat &disp, const stDepthLut &lut, const Point2i &pixel)
+{
+    return StereoGetDepthFromLut(lut, disp.at<short>(pixel.y, pixel.x));
+}
+
+// Depth in mm, 0 for invalid pixels. Within 0.5 mm of StereoGetDepthFromPixel() below 65535 mm.
+ushort StereoGetDepthMmFromPixel(const Mat &disp, const stDepthLut &lut, const Point2i &pixel)
 {
-    double depth;
-    double q[4][4];
-    Mat    _Q(4, 4, CV_64F, q);
-    int    x = pixel.x;
-    int    y = pixel.y;
+    return StereoGetDepthMmFromLut(lut, disp.at<short>(pixel.y, pixel.x));
+}
 
-    Q.convertTo(_Q, CV_64F);
+// Integer copter grid. The depth rounding is monotonic, so every cell is exactly the float cell
+// rounded half up: at most 0.5 mm off, and bit-exact between platforms.
+static void CalcDepthMmOfVirtualCopter(const Mat &disp, const stDepthLut &lut, double d[3][3])
+{
+    const ushort *pLut = lut.depthMm.ptr<ushort>();
 
-    depth = ((q[2][3]) / (q[3][2] * disp.at<short>(y, x) + q[3][3])) * 16;
+    for (int j = 0; j < TQC_VIRTUAL_COPTER_Y_SPLITE; j++)
+    {
+        for (int i = 0; i < TQC_VIRTUAL_COPTER_X_SPLITE; i++)
+        {
+            int left   = TQC_VIRTUAL_COPTER_LEFT + TQC_VIRTUAL_COPTER_SUB_X * i;
+            int top    = TQC_VIRTUAL_COPTER_TOP + TQC_VIRTUAL_COPTER_SUB_Y * j;
+            int right  = left + TQC_VIRTUAL_COPTER_SUB_X;
+            int bottom = top + TQC_VIRTUAL_COPTER_SUB_Y;
+            int nMin   = TQC_MAX_DEPTH_MM;
 
-    return depth;
+            for (int y = top; y < bottom; y++)
+            {
+                const short *pDisp = disp.ptr<short>(y);
+
+                for (int x = left; x < right; x++)
+                {
+                    int cur = pLut[(ushort)pDisp[x]];
+                    if (nMin > cur && cur > 0)
+                        nMin = cur;
+                }
+            }
+
+            d[j][i] = nMin;
+        }
+    }
 }
 
-void StereoCalcDepthOfVirtualCopter(const Mat &disp, const Mat &Q, double d[3][3])
+void StereoCalcDepthOfVirtualCopter(const Mat &disp, const stDepthLut &lut, double d[3][3], bool bFixedPoint)
 {
+    TQC_TRACE_SCOPE("copter grid");
+
+    if (bFixedPoint)
+    {
+        CalcDepthMmOfVirtualCopter(disp, lut, d);
+        return;
+    }
+
     for (int j = 0; j < TQC_VIRTUAL_COPTER_Y_SPLITE; j++)
     {
         for (int i = 0; i < TQC_VIRTUAL_COPTER_X_SPLITE; i++)
@@ -168,9 +994,11 @@ void StereoCalcDepthOfVirtualCopter(const Mat &disp, const Mat &Q, double d[3][3
 
             for (int y = top; y < bottom; y++)
             {
+                const short *pDisp = disp.ptr<short>(y);
+
                 for (int x = left; x < right; x++)
                 {
-                    double cur = StereoGetDepthFromPixel(disp, Q, Point2i(x, y));
+                    double cur = StereoGetDepthFromLut(lut, pDisp[x]);
                     if (dMin > cur && cur > FLT_EPSILON)
                         dMin = cur;
                 }
@@ -181,25 +1009,57 @@ void StereoCalcDepthOfVirtualCopter(const Mat &disp, const Mat &Q, double d[3][3
     }
 }
 
-void StereoFilterDisp(Mat &disp, Mat Q)
+void StereoFilterDisp(Mat &disp, const stDepthLut &lut, bool bFixedPoint)
 {
-    double q[4][4];
-    Mat    _Q(4, 4, CV_64F, q);
+    // Integer compare on the mm table. It only differs from the float one for depths in
+    // (5000, 5000.5) mm, which the fixed-point path keeps.
+    if (bFixedPoint)
+    {
+        const ushort *pLut = lut.depthMm.ptr<ushort>();
 
-    Q.convertTo(_Q, CV_64F);
+        for (int y = 0; y < disp.rows; y++)
+        {
+            short *pDisp = disp.ptr<short>(y);
+
+            for (int x = 0; x < disp.cols; x++)
+            {
+                if (pLut[(ushort)pDisp[x]] > 5000)
+                {
+                    pDisp[x] = -16;
+                }
+            }
+        }
+
+        return;
+    }
 
     for (int y = 0; y < disp.rows; y++)
     {
+        short *pDisp = disp.ptr<short>(y);
+
         for (int x = 0; x < disp.cols; x++)
         {
-            int    disp8 = (int)disp.at<short>(y, x);
-            double zc = ((q[2][3]) / (q[3][2] * disp8 + q[3][3])) * 16;
+            double zc = StereoGetDepthFromLut(lut, pDisp[x]);
 
             // Filter, if depth > 5m, we will skip this.
             if (zc > 5000.0f)
             {
-                disp.at<short>(y, x) = -16;
+                pDisp[x] = -16;
             }
         }
     }
+}
+
+// Largest disparity (pixels) below the one of dMaxDepth, nNumDisparities if even the end of the
+// search range is farther away.
+int StereoGetMinDisparity(const stDepthLut &lut, double dMaxDepth, int nNumDisparities)
+{
+    for (int d = 1; d < nNumDisparities; d++)
+    {
+        double cur = StereoGetDepthFromLut(lut, (short)(d * 16));
+        if (cur > FLT_EPSILON && cur <= dMaxDepth)
+            return d - 1;
+    }
+
+    return nNumDisparities;
 }
\ No newline at end of file
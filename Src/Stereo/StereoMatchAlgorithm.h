@@ -4,11 +4,18 @@
 #include <opencv2/calib3d/calib3d.hpp>
 #include <opencv2/core/types.hpp>
 
+#include <vector>
+
+#include "Config.h"
 #include "StereoCamera.h"
+#include "StereoCensusSgm.h"
+#include "StereoBlockMatch.h"
+#include "StereoPyramid.h"
 
 using namespace cv;
 
 #define TQC_MAX_DEPTH               10000.0f  // 10m
+#define TQC_MAX_DEPTH_MM            10000     // TQC_MAX_DEPTH of the fixed-point path.
 
 
 typedef enum _enStereoAlgorithm
@@ -17,19 +24,114 @@ typedef enum _enStereoAlgorithm
     TQC_STEREO_SGBM  = 1,
     TQC_STEREO_HH    = 2,
     TQC_STEREO_VAR   = 3,
+    TQC_STEREO_CENSUS_SGM = 4,
+    TQC_STEREO_PYRAMID    = 5,
+    TQC_STEREO_STREAM_SGM = 6,
+    TQC_STEREO_SAD        = 7,
+    TQC_STEREO_ZSAD       = 8,
     TQC_STEREO_VALID = -1
 } enAlgorithm;
 
 typedef struct _stAlgorithmParam
 {
+    int         nChannels;          // Channels the algorithm sees, BGR input is rectified to gray when 1.
     int         nNumDisparities;
     int         nSADWindowSize;
     int         nImgWidth;
     enAlgorithm selector;
 }stAlgorithmParam;
 
+// Result of CStereoMatcher::CheckObstacle(), one entry per virtual copter cell.
+typedef struct _stObstacleGrid
+{
+    int     nMinDisparity;      // First disparity searched (pixels), derived from the depth threshold.
+    bool    bHit[TQC_VIRTUAL_COPTER_Y_SPLITE][TQC_VIRTUAL_COPTER_X_SPLITE];
+    double  d[TQC_VIRTUAL_COPTER_Y_SPLITE][TQC_VIRTUAL_COPTER_X_SPLITE];   // Nearest depth of a hit, TQC_MAX_DEPTH otherwise.
+} stObstacleGrid;
+
+// Matcher and buffers of CheckObstacle(), apart from Match()'s so that the window-sized and the
+// full-sized path never reallocate each other's buffers.
+typedef struct _stObstacleState
+{
+    Ptr<StereoBM>   bm;                 // Band-limited matcher.
+    Mat             temp1, temp2;       // Resized input.
+    Mat             img1r, img2r;       // Rectified copter window.
+    Mat             grayLeft, grayRight;
+    Mat             disp;
+} stObstacleState;
+
+
+// One matcher context: algorithm instance, camera maps and scratch buffers. Each thread/rig/parameter
+// set uses its own instance, so several pairs can be matched at the same time in one process.
+class CStereoMatcher
+{
+public:
+    CStereoMatcher();
+    ~CStereoMatcher();
+
+public:
+    bool    Init(int nChannels,
+                 Rect roi1,
+                 Rect roi2,
+                 int nNumDisparities,
+                 int nSADWindowSize,
+                 int imgWidth,
+                 enAlgorithm selector = TQC_STEREO_SGBM);
+    void    SetCamParam(const stCamParam &camParam);
+    bool    SetTemporal(int nRefreshFrames);
+    void    SetTiles(int nTiles);
+    void    SetFixedPoint(bool bFixedPoint);
+    bool    Match(const Mat &left, const Mat &right, float fScale, Mat &disp);
+    bool    MatchRoi(const Mat &left, const Mat &right, float fScale, Mat &disp);
+    bool    CheckObstacle(const Mat &left, const Mat &right, float fScale, double dMaxDepth, stObstacleGrid &grid);
+
+    bool                    IsFixedPoint() const { return m_bFixedPoint; }
+    const stAlgorithmParam& GetParam() const    { return m_param; }
+    const stCamParam&       GetCamParam() const { return m_camParam; }
+    const Mat&              GetRectifiedLeft() const { return m_rectLeft; }  // Matcher input of the last Match().
+
+protected:
+    bool    ComputeDisp(const Mat &imgLeft, const Mat &imgRight, Mat &disp);
+    bool    ComputeTemporal(const Mat &imgLeft, const Mat &imgRight, Mat &disp);
+    void    TemporalInput(const Mat &img, Mat &gray);
+    void    ComputeTiled(const Mat &imgLeft, const Mat &imgRight, Mat &disp);
+    void    RemapPair(const Mat &left, const Mat &right,
+                      const Mat &map11, const Mat &map12, const Mat &map21, const Mat &map22,
+                      Mat &img1r, Mat &img2r);
+    bool    RemapCopterWindow(const Mat &left, const Mat &right, float fScale, int nSearchRange,
+                              Mat &temp1, Mat &temp2, Mat &img1r, Mat &img2r,
+                              Size &dispSize, Rect &roi, Rect &mapRC);
+
+private:
+    stAlgorithmParam    m_param;
+    stCamParam          m_camParam;
+    Ptr<StereoBM>       m_bm;
+    Ptr<StereoSGBM>     m_sgbm;
+    stObstacleState     m_obstacle;
+    int                 m_nTiles;           // Horizontal strips of the tiled SGBM, 1 when off.
+    std::vector<Ptr<StereoSGBM> > m_tileSgbm;
+    std::vector<Mat>    m_tileDisp;
+    bool                m_bFixedPoint;      // Integer-only resampling, see SetFixedPoint().
+    Mat                 m_speckleBuf;
+    CCensusSgm          m_censusSgm;
+    CPyramidMatcher     m_pyramid;
+    CBlockMatcher       m_blockMatch;       // SAD/ZSAD kernels specialized per block size and disparities.
+    CDispRefiner        m_temporal;         // Window search around m_prevDisp, see SetTemporal().
+    int                 m_nTemporalRefresh; // Frames per full match, 0 when the temporal mode is off.
+    int                 m_nTemporalFrame;   // Frames since the last full match.
+    int                 m_nTemporalCap;     // Prefilter cap of the tracked images, 0 for plain gray.
+
+    Mat                 m_temp1, m_temp2;   // Resized input.
+    Mat                 m_img1r, m_img2r;   // Rectified input, allocated once and reused every frame.
+    Mat                 m_rectLeft;         // Rectified, culled left image, same size as the disparity.
+    Mat                 m_grayLeft, m_grayRight;
+    Mat                 m_temporalSobel;
+    Mat                 m_prevDisp;         // Disparity of the previous ComputeDisp().
+};
+
 
 // Function declaration
+CStereoMatcher& StereoGetDefaultMatcher();
 bool StereoInitAlgorithm(int nChannels,
                          Rect roi1,
                          Rect roi2,
@@ -43,14 +145,17 @@ bool StereoMatch(Mat left,
                  enAlgorithm selector,
                  stCamParam camParam,
                  Mat &disp);
+bool StereoMatchRoi(Mat left,
+                    Mat right,
+                    float fScale,
+                    enAlgorithm selector,
+                    stCamParam camParam,
+                    Mat &disp);
 Mat  StereoGetDisp8FromDisp(Mat disp, enAlgorithm selector, int nNumDisparities);
-void StereoCalcDepthOfVirtualCopter(const Mat &disp, const Mat &Q, double d[3][3]);
-void StereoFilterDisp(Mat &disp, Mat Q);
-
-
-// Global variables' declaration
-extern stAlgorithmParam g_algorithmParam;
-extern Ptr<StereoBM>    g_bm;
-extern Ptr<StereoSGBM>  g_sgbm;
+double StereoGetDepthFromPixel(const Mat &disp, const stDepthLut &lut, const Point2i &pixel);
+ushort StereoGetDepthMmFromPixel(const Mat &disp, const stDepthLut &lut, const Point2i &pixel);
+void StereoCalcDepthOfVirtualCopter(const Mat &disp, const stDepthLut &lut, double d[3][3], bool bFixedPoint = false);
+void StereoFilterDisp(Mat &disp, const stDepthLut &lut, bool bFixedPoint = false);
+int  StereoGetMinDisparity(const stDepthLut &lut, double dMaxDepth, int nNumDisparities);
 
 #endif /* __STEREO_MATCH_ALGORITHM_H */
\ No newline at end of file
@@ -0,0 +1,182 @@
+#include <stdio.h>
+
+#include "TqcLog.h"
+#include "TqcOs.h"
+#include "Config.h"
+#include "StereoPipeline.h"
+
+CStereoPipeline::CStereoPipeline()
+    : m_pCapture(NULL),
+      m_pMatcher(NULL),
+      m_fScale(1.f),
+      m_bRoiOnly(false),
+      m_dObstacleDepth(0.0),
+      m_bKeepRectified(false),
+      m_hCapture(NULL),
+      m_hMatch(NULL),
+      m_hDepth(NULL),
+      m_bQuit(false),
+      m_captured(TQC_PIPELINE_QUEUE_SIZE),
+      m_matched(TQC_PIPELINE_QUEUE_SIZE),
+      m_done(TQC_PIPELINE_QUEUE_SIZE)
+{
+}
+
+CStereoPipeline::~CStereoPipeline()
+{
+    Stop();
+}
+
+bool CStereoPipeline::Start(CStereoCapture *pCapture,
+                            CStereoMatcher *pMatcher,
+                            float fScale,
+                            bool bRoiOnly,
+                            double dObstacleDepth)
+{
+    if (!pCapture || !pMatcher)
+    {
+        LOGE("%s(%d): invalid parameters.", __FUNCTION__, __LINE__);
+        return false;
+    }
+
+    m_pCapture       = pCapture;
+    m_pMatcher       = pMatcher;
+    m_fScale         = fScale;
+    m_bRoiOnly       = bRoiOnly;
+    m_dObstacleDepth = dObstacleDepth;
+    m_bQuit          = false;
+
+    m_captured.Reset();
+    m_matched.Reset();
+    m_done.Reset();
+
+    m_hDepth   = TqcOsCreateThread((void*)DepthThread, this);
+    m_hMatch   = TqcOsCreateThread((void*)MatchThread, this);
+    m_hCapture = TqcOsCreateThread((void*)CaptureThread, this);
+    if (!m_hDepth || !m_hMatch || !m_hCapture)
+    {
+        LOGE("%s(%d): cannot create pipeline threads.", __FUNCTION__, __LINE__);
+        Stop();
+        return false;
+    }
+
+    return true;
+}
+
+// Wait for the next finished frame. Returns false once the pipeline has stopped.
+bool CStereoPipeline::Pop(stPipelineFrame &frame)
+{
+    return m_done.Pop(frame);
+}
+
+void CStereoPipeline::Stop()
+{
+    Quit();
+
+    // Start() may have created only some of the threads, and Stop() runs again from the destructor.
+    if (m_hCapture)
+        TqcOsJoinThread(m_hCapture);
+    if (m_hMatch)
+        TqcOsJoinThread(m_hMatch);
+    if (m_hDepth)
+        TqcOsJoinThread(m_hDepth);
+
+    m_hCapture = NULL;
+    m_hMatch   = NULL;
+    m_hDepth   = NULL;
+}
+
+// Ask every stage to stop and wake the ones blocked on a queue.
+void CStereoPipeline::Quit()
+{
+    m_bQuit = true;
+
+    m_captured.Wake();
+    m_matched.Wake();
+    m_done.Wake();
+}
+
+void* CStereoPipeline::CaptureThread(void *pParam)
+{
+    CStereoPipeline *pThis = (CStereoPipeline*)pParam;
+    stStereoPair    pair;
+
+    while (!pThis->m_bQuit)
+    {
+        stPipelineFrame frame;
+
+        if (!pThis->m_pCapture->Read(pair))
+        {
+            pThis->Quit();
+            break;
+        }
+
+        frame.nIndex   = pair.nIndex;
+        frame.left     = pair.left;
+        frame.right    = pair.right;
+        frame.dSkew    = StereoGetPairSkew(pair);
+        frame.tCapture = std::min(pair.tLeft, pair.tRight);
+
+        if (!pThis->m_captured.Push(frame, &pThis->m_bQuit))
+            break;
+    }
+
+    return NULL;
+}
+
+void* CStereoPipeline::MatchThread(void *pParam)
+{
+    CStereoPipeline *pThis = (CStereoPipeline*)pParam;
+    stPipelineFrame frame;
+
+    while (pThis->m_captured.Pop(frame))
+    {
+        // The safety check has its own buffers in the matcher, running it first reports an obstacle before the full match.
+        frame.bObstacle = pThis->m_dObstacleDepth > 0 &&
+                          pThis->m_pMatcher->CheckObstacle(frame.left, frame.right, pThis->m_fScale, pThis->m_dObstacleDepth, frame.obstacle);
+
+        bool bMatched = pThis->m_bRoiOnly ?
+                        pThis->m_pMatcher->MatchRoi(frame.left, frame.right, pThis->m_fScale, frame.disp) :
+                        pThis->m_pMatcher->Match(frame.left, frame.right, pThis->m_fScale, frame.disp);
+        if (!bMatched)
+        {
+            LOGE("%s(%d): cannot match left and right images.", __FUNCTION__, __LINE__);
+            pThis->Quit();
+            break;
+        }
+
+        // The matcher overwrites its input buffer with the next frame, the later stages get a copy.
+        if (pThis->m_bKeepRectified)
+        {
+            pThis->m_pMatcher->GetRectifiedLeft().copyTo(frame.rectLeft);
+        }
+
+        frame.tMatched = getTickCount();
+
+        if (!pThis->m_matched.Push(frame, &pThis->m_bQuit))
+            break;
+    }
+
+    return NULL;
+}
+
+void* CStereoPipeline::DepthThread(void *pParam)
+{
+    CStereoPipeline *pThis = (CStereoPipeline*)pParam;
+    stPipelineFrame frame;
+
+    while (pThis->m_matched.Pop(frame))
+    {
+        const stAlgorithmParam &param = pThis->m_pMatcher->GetParam();
+
+        frame.disp8 = StereoGetDisp8FromDisp(frame.disp, param.selector, param.nNumDisparities);
+        StereoCalcDepthOfVirtualCopter(frame.disp, pThis->m_pMatcher->GetCamParam().depthLut, frame.d, pThis->m_pMatcher->IsFixedPoint());
+
+        frame.tGrid = getTickCount();
+
+        if (!pThis->m_done.Push(frame, &pThis->m_bQuit))
+            break;
+    }
+
+    return NULL;
+}
\ No newline at end of file
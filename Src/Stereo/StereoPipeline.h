@@ -0,0 +1,78 @@
+#ifndef __STEREO_PIPELINE_H
+#define __STEREO_PIPELINE_H
+
+#include <atomic>
+#include <opencv2/opencv.hpp>
+
+#include "TqcRingBuffer.h"
+#include "StereoCapture.h"
+#include "StereoCamera.h"
+#include "StereoMatchAlgorithm.h"
+
+using namespace cv;
+
+// Frames allowed in flight between two stages.
+#define TQC_PIPELINE_QUEUE_SIZE 2
+
+
+// One stereo pair and everything computed from it on its way through the pipeline.
+typedef struct _stPipelineFrame
+{
+    int    nIndex;
+    Mat    left, right;
+    Mat    disp, disp8;
+    Mat    rectLeft;   // Matcher input, only kept after SetKeepRectified(true).
+    double d[3][3];
+    double dSkew;      // Left/right grab skew in ms.
+    bool   bObstacle;  // obstacle is valid, the near-band check ran and succeeded.
+    stObstacleGrid obstacle;
+    int64  tCapture;   // getTickCount() when the pair was grabbed.
+    int64  tMatched;   // ... when the disparity was ready.
+    int64  tGrid;      // ... when the depth grid was ready.
+} stPipelineFrame;
+
+
+// Capture, rectify+match and depth post-processing each run on their own thread, connected by
+// bounded SPSC queues. The caller is the last stage: it pops finished frames for display/output,
+// since HighGUI has to stay on the thread that created the window.
+class CStereoPipeline
+{
+public:
+    CStereoPipeline();
+    ~CStereoPipeline();
+
+public:
+    bool    Start(CStereoCapture *pCapture,
+                  CStereoMatcher *pMatcher,
+                  float fScale,
+                  bool bRoiOnly,
+                  double dObstacleDepth);
+    bool    Pop(stPipelineFrame &frame);
+    void    Stop();
+    void    SetKeepRectified(bool bKeep) { m_bKeepRectified = bKeep; }
+
+protected:
+    void    Quit();
+    static void* CaptureThread(void *pParam);
+    static void* MatchThread(void *pParam);
+    static void* DepthThread(void *pParam);
+
+private:
+    CStereoCapture              *m_pCapture;
+    CStereoMatcher              *m_pMatcher;
+    float                       m_fScale;
+    bool                        m_bRoiOnly;
+    double                      m_dObstacleDepth;   // CheckObstacle() threshold in mm, 0 for none.
+    bool                        m_bKeepRectified;   // Copy the matcher input into every frame, e.g. for colored PLY.
+
+    void                        *m_hCapture;
+    void                        *m_hMatch;
+    void                        *m_hDepth;
+    std::atomic<bool>           m_bQuit;
+
+    CRingBuffer<stPipelineFrame> m_captured;
+    CRingBuffer<stPipelineFrame> m_matched;
+    CRingBuffer<stPipelineFrame> m_done;
+};
+
+#endif /* __STEREO_PIPELINE_H */
\ No newline at end of file
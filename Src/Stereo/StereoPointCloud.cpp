@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <string.h>
+#include <float.h>
+
+#include "TqcLog.h"
+#include "StereoPointCloud.h"
+
+// The vertex count is patched once all points are written, so keep its field a fixed width.
+#define TQC_PLY_COUNT_FORMAT "%010d"
+
+typedef struct _stPlyColorPoint
+{
+    float x, y, z;
+    uchar r, g, b;
+} stPlyColorPoint;
+
+static bool IsLittleEndian()
+{
+    int n = 1;
+    return *(char*)&n == 1;
+}
+
+static void WritePlyHeader(FILE *fp, int nPoints, bool bColor)
+{
+    fprintf(fp, "ply\n");
+    fprintf(fp, "format binary_little_endian 1.0\n");
+    fprintf(fp, "element vertex " TQC_PLY_COUNT_FORMAT "\n", nPoints);
+    fprintf(fp, "property float x\n");
+    fprintf(fp, "property float y\n");
+    fprintf(fp, "property float z\n");
+    if (bColor)
+    {
+        fprintf(fp, "property uchar red\n");
+        fprintf(fp, "property uchar green\n");
+        fprintf(fp, "property uchar blue\n");
+    }
+    fprintf(fp, "end_header\n");
+}
+
+// Reproject, filter and write a binary little-endian PLY in one pass over the disparity,
+// without a full CV_32FC3 intermediate. Coordinates follow StereoReprojectPixelTo3D().
+// color is optional: CV_8UC3 (BGR) or CV_8UC1, the same size as disp.
+bool StereoSavePly(const char *strFile, const Mat &disp, const stDepthLut &lut, const Mat &color, double dMaxDepth)
+{
+    bool   bColor  = !color.empty() && color.size() == disp.size() && color.depth() == CV_8U &&
+                     (color.channels() == 3 || color.channels() == 1);
+    size_t nStride = bColor ? 15 : 12;   // Packed PLY vertex size.
+    int    nPoints = 0;
+    int    nBuf    = 0;
+    FILE   *fp;
+    uchar  buf[TQC_PLY_BUFFER_POINTS * 15];
+
+    if (disp.type() != CV_16S || !IsLittleEndian())
+    {
+        LOGE("%s(%d): disparity must be CV_16S on a little-endian host.", __FUNCTION__, __LINE__);
+        return false;
+    }
+
+    fp = fopen(strFile, "wb");
+    if (!fp)
+    {
+        LOGE("%s(%d): cannot open file %s", __FUNCTION__, __LINE__, strFile);
+        return false;
+    }
+
+    WritePlyHeader(fp, 0, bColor);
+
+    for (int y = 0; y < disp.rows; y++)
+    {
+        const short *pDisp  = disp.ptr<short>(y);
+        const uchar *pColor = bColor ? color.ptr<uchar>(y) : NULL;
+        double      fy      = (y + lut.q13) / lut.q23;
+
+        for (int x = 0; x < disp.cols; x++)
+        {
+            // Missing and negative disparities are behind the camera or at infinity.
+            if (pDisp[x] <= 0)
+                continue;
+
+            double z = StereoGetDepthFromLut(lut, pDisp[x]);
+            if (z <= FLT_EPSILON || z > dMaxDepth)
+                continue;
+
+            stPlyColorPoint point;
+            point.x = (float)((x + lut.q03) / lut.q23 * z);
+            point.y = (float)(fy * z);
+            point.z = (float)z;
+
+            if (bColor)
+            {
+                const uchar *p = color.channels() == 3 ? pColor + x * 3 : pColor + x;
+
+                point.b = p[0];
+                point.g = color.channels() == 3 ? p[1] : p[0];
+                point.r = color.channels() == 3 ? p[2] : p[0];
+                memcpy(buf + nBuf * nStride, &point, 12);
+                memcpy(buf + nBuf * nStride + 12, &point.r, 3);
+            }
+            else
+            {
+                memcpy(buf + nBuf * nStride, &point, 12);
+            }
+
+            nPoints++;
+            if (++nBuf == TQC_PLY_BUFFER_POINTS)
+            {
+                fwrite(buf, nStride, nBuf, fp);
+                nBuf = 0;
+            }
+        }
+    }
+
+    if (nBuf > 0)
+    {
+        fwrite(buf, nStride, nBuf, fp);
+    }
+
+    // Patch the real vertex count into the header, it has the same length.
+    fseek(fp, 0, SEEK_SET);
+    WritePlyHeader(fp, nPoints, bColor);
+
+    bool bOk = !ferror(fp);
+    fclose(fp);
+
+    return bOk;
+}
\ No newline at end of file
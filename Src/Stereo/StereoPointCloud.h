@@ -0,0 +1,17 @@
+#ifndef __STEREO_POINT_CLOUD_H
+#define __STEREO_POINT_CLOUD_H
+
+#include <opencv2/core/core.hpp>
+
+#include "StereoCamera.h"
+
+using namespace cv;
+
+// Points buffered before every fwrite().
+#define TQC_PLY_BUFFER_POINTS 4096
+
+
+// Function declaration
+bool StereoSavePly(const char *strFile, const Mat &disp, const stDepthLut &lut, const Mat &color, double dMaxDepth);
+
+#endif /* __STEREO_POINT_CLOUD_H */
\ No newline at end of file
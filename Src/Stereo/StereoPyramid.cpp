@@ -0,0 +1,196 @@
+#include <algorithm>
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "TqcLog.h"
+#include "TqcTrace.h"
+#include "StereoPyramid.h"
+
+CPyramidMatcher::CPyramidMatcher()
+{
+    m_nNumDisparities    = 16;
+    m_nSADWindowSize     = 5;
+    m_nLevels            = 2;
+    m_nSpeckleWindowSize = 100;
+    m_nSpeckleRange      = 32;
+
+    m_coarse = StereoSGBM::create(0, 16, 5);
+}
+
+CPyramidMatcher::~CPyramidMatcher()
+{
+}
+
+bool CPyramidMatcher::Init(int nNumDisparities,
+                           int nSADWindowSize,
+                           int nLevels,
+                           int nRefineRadius,
+                           int nUniquenessRatio,
+                           int nSpeckleWindowSize,
+                           int nSpeckleRange)
+{
+    if (nNumDisparities <= 0 || nNumDisparities % 16 != 0)
+    {
+        LOGE("%s(%d): number of disparities(%d) must be a positive multiple of 16.", __FUNCTION__, __LINE__, nNumDisparities);
+        return false;
+    }
+
+    if (nSADWindowSize < 3 || nSADWindowSize % 2 == 0)
+    {
+        LOGE("%s(%d): block size(%d) must be odd and at least 3.", __FUNCTION__, __LINE__, nSADWindowSize);
+        return false;
+    }
+
+    if (nLevels < 0)
+    {
+        LOGE("%s(%d): wrong pyramid levels(%d).", __FUNCTION__, __LINE__, nLevels);
+        return false;
+    }
+
+    // Nearest upsampling doubles the coarse error, the refiner needs a radius of at least 1 to correct it.
+    if (!m_refiner.Init(nSADWindowSize, nRefineRadius, nUniquenessRatio, -1))
+    {
+        return false;
+    }
+
+    m_nNumDisparities    = nNumDisparities;
+    m_nSADWindowSize     = nSADWindowSize;
+    m_nLevels            = nLevels;
+    m_nSpeckleWindowSize = nSpeckleWindowSize;
+    m_nSpeckleRange      = nSpeckleRange;
+
+    m_coarse->setPreFilterCap(63);
+    m_coarse->setBlockSize(nSADWindowSize);
+    m_coarse->setP1(8 * nSADWindowSize * nSADWindowSize);
+    m_coarse->setP2(32 * nSADWindowSize * nSADWindowSize);
+    m_coarse->setMinDisparity(0);
+    m_coarse->setUniquenessRatio(nUniquenessRatio);
+    m_coarse->setSpeckleRange(nSpeckleRange);
+    m_coarse->setDisp12MaxDiff(1);
+    m_coarse->setMode(StereoSGBM::MODE_SGBM);
+
+    return true;
+}
+
+bool CPyramidMatcher::Compute(const Mat &left, const Mat &right, Mat &disp)
+{
+    if (left.empty() || left.size() != right.size() || left.type() != right.type() || left.depth() != CV_8U)
+    {
+        LOGE("%s(%d): left and right images must be non-empty 8-bit images of the same size.", __FUNCTION__, __LINE__);
+        return false;
+    }
+
+    // Refinement compares intensities, so color input is reduced to gray first.
+    if (left.channels() == 3)
+    {
+        cvtColor(left, m_grayLeft, COLOR_BGR2GRAY);
+        cvtColor(right, m_grayRight, COLOR_BGR2GRAY);
+    }
+    else
+    {
+        m_grayLeft  = left;
+        m_grayRight = right;
+    }
+
+    StereoBuildPyramid(m_grayLeft, m_nLevels + 1, m_pyrLeft);
+    StereoBuildPyramid(m_grayRight, m_nLevels + 1, m_pyrRight);
+
+    // Small input gets fewer levels, down to a plain StereoSGBM at level 0.
+    int nCoarse            = (int)m_pyrLeft.size() - 1;
+    int nCoarseDisparities = (((m_nNumDisparities + (1 << nCoarse) - 1) >> nCoarse) + 15) & -16;
+
+    {
+        TQC_TRACE_SCOPE("pyramid coarse");
+        m_coarse->setNumDisparities(nCoarseDisparities);
+        m_coarse->setSpeckleWindowSize(m_nSpeckleWindowSize >> (nCoarse * 2));
+        m_coarse->compute(m_pyrLeft[nCoarse], m_pyrRight[nCoarse], nCoarse == 0 ? disp : m_levelDisp);
+    }
+
+    if (nCoarse == 0)
+    {
+        return true;
+    }
+
+    {
+        TQC_TRACE_SCOPE("pyramid refine");
+
+        for (int level = nCoarse - 1; level >= 0; level--)
+        {
+            FillInvalid(m_levelDisp);
+            resize(m_levelDisp, m_base, m_pyrLeft[level].size(), 0, 0, INTER_NEAREST);
+            m_refiner.Refine(m_pyrLeft[level], m_pyrRight[level], m_base, 2,
+                             (m_nNumDisparities + (1 << level) - 1) >> level, level == 0 ? disp : m_levelDisp);
+        }
+    }
+
+    if (m_nSpeckleWindowSize > 0)
+    {
+        filterSpeckles(disp, TQC_REFINE_INVALID_DISP, m_nSpeckleWindowSize, 16 * m_nSpeckleRange, m_speckleBuf);
+    }
+
+    return true;
+}
+
+// Invalid runs take the smaller (farther) valid disparity at either end of the run, occluded
+// pixels are background. Rows without any valid pixel stay invalid.
+void CPyramidMatcher::FillInvalid(Mat &disp)
+{
+    for (int y = 0; y < disp.rows; y++)
+    {
+        short *pDisp = disp.ptr<short>(y);
+        int    x     = 0;
+
+        while (x < disp.cols)
+        {
+            if (pDisp[x] >= 0)
+            {
+                x++;
+                continue;
+            }
+
+            int end = x;
+
+            while (end < disp.cols && pDisp[end] < 0)
+            {
+                end++;
+            }
+
+            short dLeft  = x > 0 ? pDisp[x - 1] : TQC_REFINE_INVALID_DISP;
+            short dRight = end < disp.cols ? pDisp[end] : TQC_REFINE_INVALID_DISP;
+            short d      = dLeft < 0 ? dRight : (dRight < 0 ? dLeft : std::min(dLeft, dRight));
+
+            for (; x < end; x++)
+            {
+                pDisp[x] = d;
+            }
+        }
+    }
+}
+
+// Half-scale pyramid, pyramid[0] is img itself. nMaxLevels <= 0 keeps halving until a side
+// reaches TQC_PYRAMID_MIN_SIZE. Level buffers are reused across calls with the same input size.
+void StereoBuildPyramid(const Mat &img, int nMaxLevels, std::vector<Mat> &pyramid)
+{
+    size_t k = 1;
+
+    if (pyramid.empty())
+    {
+        pyramid.resize(1);
+    }
+
+    pyramid[0] = img;
+
+    while ((nMaxLevels <= 0 || (int)k < nMaxLevels) &&
+           pyramid[k - 1].cols / 2 > TQC_PYRAMID_MIN_SIZE && pyramid[k - 1].rows / 2 > TQC_PYRAMID_MIN_SIZE)
+    {
+        if (pyramid.size() <= k)
+        {
+            pyramid.resize(k + 1);
+        }
+
+        resize(pyramid[k - 1], pyramid[k], Size(), 0.5f, 0.5f, INTER_LINEAR);
+        k++;
+    }
+
+    pyramid.resize(k);
+}
\ No newline at end of file
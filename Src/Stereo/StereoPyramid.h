@@ -0,0 +1,62 @@
+#ifndef __STEREO_PYRAMID_H
+#define __STEREO_PYRAMID_H
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
+
+#include "StereoRefine.h"
+
+using namespace cv;
+
+// Pyramid levels stop once a side would drop to this size or below.
+#define TQC_PYRAMID_MIN_SIZE    32
+
+
+// Coarse-to-fine matcher: StereoSGBM over the full range on the coarsest level, then every finer
+// level only searches a few pixels around the upsampled disparity of the level below.
+// Output is CV_16S with 4 fractional bits, the same convention as StereoBM/StereoSGBM.
+class CPyramidMatcher
+{
+public:
+    CPyramidMatcher();
+    ~CPyramidMatcher();
+
+public:
+    bool    Init(int nNumDisparities,
+                 int nSADWindowSize,
+                 int nLevels,
+                 int nRefineRadius,
+                 int nUniquenessRatio,
+                 int nSpeckleWindowSize,
+                 int nSpeckleRange);
+    bool    Compute(const Mat &left, const Mat &right, Mat &disp);
+    int     GetUniquenessRatio() const  { return m_coarse->getUniquenessRatio(); }
+    int     GetDisp12MaxDiff() const    { return m_coarse->getDisp12MaxDiff(); }
+
+protected:
+    void    FillInvalid(Mat &disp);
+
+private:
+    int                 m_nNumDisparities;
+    int                 m_nSADWindowSize;
+    int                 m_nLevels;
+    int                 m_nSpeckleWindowSize;
+    int                 m_nSpeckleRange;
+
+    Ptr<StereoSGBM>     m_coarse;
+    CDispRefiner        m_refiner;
+    Mat                 m_grayLeft;
+    Mat                 m_grayRight;
+    Mat                 m_levelDisp;    // Disparity of the level below, CV_16S.
+    Mat                 m_base;         // m_levelDisp upsampled to the current level.
+    Mat                 m_speckleBuf;
+    std::vector<Mat>    m_pyrLeft;
+    std::vector<Mat>    m_pyrRight;
+};
+
+
+// Function declaration
+void StereoBuildPyramid(const Mat &img, int nMaxLevels, std::vector<Mat> &pyramid);
+
+#endif /* __STEREO_PYRAMID_H */
\ No newline at end of file
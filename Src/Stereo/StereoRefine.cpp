@@ -0,0 +1,270 @@
+#include <limits.h>
+#include <stdlib.h>
+#include <algorithm>
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "TqcLog.h"
+#include "StereoRefine.h"
+
+CDispRefiner::CDispRefiner()
+{
+    m_nSADWindowSize   = 5;
+    m_nRadius          = 2;
+    m_nUniquenessRatio = 10;
+    m_nDisp12MaxDiff   = -1;
+    m_nNumDisparities  = 0;
+    m_nWidth           = 0;
+}
+
+CDispRefiner::~CDispRefiner()
+{
+}
+
+bool CDispRefiner::Init(int nSADWindowSize, int nRadius, int nUniquenessRatio, int nDisp12MaxDiff)
+{
+    if (nSADWindowSize < 3 || nSADWindowSize % 2 == 0)
+    {
+        LOGE("%s(%d): block size(%d) must be odd and at least 3.", __FUNCTION__, __LINE__, nSADWindowSize);
+        return false;
+    }
+
+    if (nRadius < 1)
+    {
+        LOGE("%s(%d): search radius(%d) must be at least 1.", __FUNCTION__, __LINE__, nRadius);
+        return false;
+    }
+
+    m_nSADWindowSize   = nSADWindowSize;
+    m_nRadius          = nRadius;
+    m_nUniquenessRatio = nUniquenessRatio;
+    m_nDisp12MaxDiff   = nDisp12MaxDiff;
+
+    return true;
+}
+
+// Search (base * nBaseScale / 16) + [-radius, radius]. Every candidate is the block SAD of one
+// disparity over the whole window, so neighbours with another guess do not leak into it at depth
+// edges. Negative base values stay invalid. Returns the number of pixels that had a valid guess
+// but failed the cost, uniqueness or left-right test.
+int CDispRefiner::Refine(const Mat &left, const Mat &right, const Mat &base, int nBaseScale, int nNumDisparities, Mat &disp)
+{
+    const int nOffsets = m_nRadius * 2 + 1;
+    const int nMaxCost = 255 * m_nSADWindowSize * m_nSADWindowSize;
+    const int nMaxDisp = (nNumDisparities - 1) * 16;
+    int       nFailed  = 0;
+
+    m_nNumDisparities = nNumDisparities;
+    m_nWidth          = left.cols;
+
+    m_colCost.resize((size_t)nNumDisparities * left.cols);
+    m_colRow.assign((size_t)nNumDisparities * left.cols, -2);
+    m_winCost.resize(nNumDisparities);
+    m_winX.resize(nNumDisparities);
+    m_pixelCost.resize(nOffsets);
+    m_disp2.resize(left.cols);
+    m_disp2Cost.resize(left.cols);
+    disp.create(left.rows, left.cols, CV_16S);
+
+    for (int y = 0; y < left.rows; y++)
+    {
+        const short *pBase = base.ptr<short>(y);
+        short       *pDisp = disp.ptr<short>(y);
+
+        std::fill(m_winX.begin(), m_winX.end(), -2);
+        std::fill(m_disp2.begin(), m_disp2.end(), -1);
+        std::fill(m_disp2Cost.begin(), m_disp2Cost.end(), INT_MAX);
+
+        for (int x = 0; x < left.cols; x++)
+        {
+            if (pBase[x] < 0)
+            {
+                pDisp[x] = TQC_REFINE_INVALID_DISP;
+                continue;
+            }
+
+            int dFirst = ((pBase[x] * nBaseScale + 8) >> 4) - m_nRadius;
+            int nBest, nMinCost;
+
+            for (int k = 0; k < nOffsets; k++)
+            {
+                int d = dFirst + k;
+
+                m_pixelCost[k] = (d >= 0 && d < nNumDisparities) ? WindowCost(left, right, x, y, d) : nMaxCost;
+            }
+
+            pDisp[x] = SelectDisparity(&m_pixelCost[0], nOffsets, dFirst, nMaxDisp, nBest, nMinCost);
+
+            // Best match of every right pixel, the same bookkeeping as StereoSGBM.
+            if (pDisp[x] >= 0 && x - nBest >= 0 && nMinCost < m_disp2Cost[x - nBest])
+            {
+                m_disp2Cost[x - nBest] = nMinCost;
+                m_disp2[x - nBest]     = nBest;
+            }
+        }
+
+        if (m_nDisp12MaxDiff >= 0)
+        {
+            CheckLeftRight(pDisp, left.cols);
+        }
+
+        for (int x = 0; x < left.cols; x++)
+        {
+            nFailed += (pBase[x] >= 0 && pDisp[x] < 0);
+        }
+    }
+
+    return nFailed;
+}
+
+// SAD of column x over the window rows of row y at disparity d, 255 per pixel without a right
+// pixel. Rows are clamped to the image, the same as BORDER_REPLICATE. A column computed for the row
+// above is moved down by one row instead of summed again.
+int CDispRefiner::ColumnCost(const Mat &left, const Mat &right, int x, int y, int d)
+{
+    const int hw = m_nSADWindowSize / 2;
+
+    if (d > x)
+    {
+        return 255 * m_nSADWindowSize;
+    }
+
+    size_t i     = (size_t)d * m_nWidth + x;
+    int    &cost = m_colCost[i];
+
+    if (m_colRow[i] == y)
+    {
+        return cost;
+    }
+
+    if (m_colRow[i] == y - 1)
+    {
+        int yIn  = std::min(y + hw, left.rows - 1);
+        int yOut = std::max(y - 1 - hw, 0);
+
+        cost += abs(left.ptr<uchar>(yIn)[x] - right.ptr<uchar>(yIn)[x - d]) -
+                abs(left.ptr<uchar>(yOut)[x] - right.ptr<uchar>(yOut)[x - d]);
+    }
+    else
+    {
+        cost = 0;
+
+        for (int j = -hw; j <= hw; j++)
+        {
+            int yy = std::min(std::max(y + j, 0), left.rows - 1);
+
+            cost += abs(left.ptr<uchar>(yy)[x] - right.ptr<uchar>(yy)[x - d]);
+        }
+    }
+
+    m_colRow[i] = y;
+
+    return cost;
+}
+
+// Block SAD of pixel (x, y) at disparity d, columns clamped to the image. When pixel x - 1 of the
+// same row also searched d, its sum is moved right by one column, so a row of pixels with similar
+// guesses costs two column lookups per candidate.
+int CDispRefiner::WindowCost(const Mat &left, const Mat &right, int x, int y, int d)
+{
+    const int hw    = m_nSADWindowSize / 2;
+    int       &cost = m_winCost[d];
+
+    if (m_winX[d] == x - 1)
+    {
+        cost += ColumnCost(left, right, std::min(x + hw, m_nWidth - 1), y, d) -
+                ColumnCost(left, right, std::max(x - 1 - hw, 0), y, d);
+    }
+    else
+    {
+        cost = 0;
+
+        for (int i = -hw; i <= hw; i++)
+        {
+            cost += ColumnCost(left, right, std::min(std::max(x + i, 0), m_nWidth - 1), y, d);
+        }
+    }
+
+    m_winX[d] = x;
+
+    return cost;
+}
+
+// pCost[k] is the cost of disparity dFirst + k. Minimum with the StereoSGBM uniqueness test and a
+// parabola sub-pixel fit, TQC_REFINE_INVALID_DISP when every candidate is out of range or ambiguous.
+// nBest and nMinCost receive the integer disparity and its cost.
+short CDispRefiner::SelectDisparity(const int *pCost, int nCount, int dFirst, int nMaxDisp, int &nBest, int &nMinCost)
+{
+    const int nMaxCost = 255 * m_nSADWindowSize * m_nSADWindowSize;
+    int       best     = 0;
+    int       minCost  = pCost[0];
+    int       second   = INT_MAX;
+
+    for (int k = 1; k < nCount; k++)
+    {
+        if (pCost[k] < minCost)
+        {
+            minCost = pCost[k];
+            best    = k;
+        }
+    }
+
+    for (int k = 0; k < nCount; k++)
+    {
+        if (abs(k - best) > 1)
+        {
+            second = std::min(second, pCost[k]);
+        }
+    }
+
+    nBest    = dFirst + best;
+    nMinCost = minCost;
+
+    if (minCost >= nMaxCost || (second < INT_MAX && second * (100 - m_nUniquenessRatio) < minCost * 100))
+    {
+        return TQC_REFINE_INVALID_DISP;
+    }
+
+    int d = nBest * 16;
+
+    // Skipped on the edge of the searched range.
+    if (best > 0 && best < nCount - 1)
+    {
+        int cm    = pCost[best - 1];
+        int cp    = pCost[best + 1];
+        int denom = cm + cp - minCost * 2;
+
+        if (denom > 0)
+        {
+            d += cvRound((float)(cm - cp) * 8 / denom);
+        }
+    }
+
+    return (short)std::min(std::max(d, 0), nMaxDisp);
+}
+
+// StereoSGBM's left-right check on one row: a pixel is dropped when the right pixels at both its
+// rounded-down and rounded-up disparity matched further than m_nDisp12MaxDiff from it.
+void CDispRefiner::CheckLeftRight(short *pDisp, int nWidth)
+{
+    for (int x = 0; x < nWidth; x++)
+    {
+        int d1 = pDisp[x];
+
+        if (d1 < 0)
+        {
+            continue;
+        }
+
+        int dLo = d1 >> 4;
+        int dHi = (d1 + 15) >> 4;
+        int xLo = x - dLo;
+        int xHi = x - dHi;
+
+        if (xLo >= 0 && xLo < nWidth && m_disp2[xLo] >= 0 && abs(m_disp2[xLo] - dLo) > m_nDisp12MaxDiff &&
+            xHi >= 0 && xHi < nWidth && m_disp2[xHi] >= 0 && abs(m_disp2[xHi] - dHi) > m_nDisp12MaxDiff)
+        {
+            pDisp[x] = TQC_REFINE_INVALID_DISP;
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,49 @@
+#ifndef __STEREO_REFINE_H
+#define __STEREO_REFINE_H
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+using namespace cv;
+
+#define TQC_REFINE_INVALID_DISP (-16)   // (minDisparity - 1) * 16, same as StereoSGBM.
+
+
+// Block SAD search of 8-bit images around a per-pixel disparity guess. Used by the pyramid matcher
+// (guess = upsampled coarse level) and by the temporal mode (guess = previous frame). Window costs
+// are running sums of cached column sums, see WindowCost().
+// Output is CV_16S with 4 fractional bits, the same convention as StereoBM/StereoSGBM.
+class CDispRefiner
+{
+public:
+    CDispRefiner();
+    ~CDispRefiner();
+
+public:
+    bool    Init(int nSADWindowSize, int nRadius, int nUniquenessRatio, int nDisp12MaxDiff);
+    int     Refine(const Mat &left, const Mat &right, const Mat &base, int nBaseScale, int nNumDisparities, Mat &disp);
+
+protected:
+    int     ColumnCost(const Mat &left, const Mat &right, int x, int y, int d);
+    int     WindowCost(const Mat &left, const Mat &right, int x, int y, int d);
+    short   SelectDisparity(const int *pCost, int nCount, int dFirst, int nMaxDisp, int &nBest, int &nMinCost);
+    void    CheckLeftRight(short *pDisp, int nWidth);
+
+private:
+    int                 m_nSADWindowSize;
+    int                 m_nRadius;
+    int                 m_nUniquenessRatio;
+    int                 m_nDisp12MaxDiff;   // Negative turns the left-right check off.
+    int                 m_nNumDisparities;  // Of the current Refine().
+    int                 m_nWidth;
+
+    std::vector<int>    m_colCost;      // Column SAD per (disparity, x), valid for row m_colRow[].
+    std::vector<int>    m_colRow;
+    std::vector<int>    m_winCost;      // Window SAD per disparity, valid for column m_winX[] of the current row.
+    std::vector<int>    m_winX;
+    std::vector<int>    m_pixelCost;    // Costs of the candidates of one pixel.
+    std::vector<int>    m_disp2;        // Right-view disparity of the current row, for the L-R check.
+    std::vector<int>    m_disp2Cost;
+};
+
+#endif /* __STEREO_REFINE_H */
\ No newline at end of file
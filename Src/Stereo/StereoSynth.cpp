@@ -0,0 +1,419 @@
+/**
+@ StereoSynth.cpp
+@ synthetic stereo pairs with exact ground-truth disparity and a matching calibration.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+#include "opencv2/calib3d/calib3d.hpp"
+#include "opencv2/imgproc/imgproc.hpp"
+#include "opencv2/imgcodecs.hpp"
+#include "opencv2/core/utility.hpp"
+
+#include "TqcLog.h"
+#include "TqcUtils.h"
+#include "Config.h"
+#include "StereoDispFile.h"
+#include "StereoSynth.h"
+
+using namespace cv;
+using namespace std;
+
+// Foreground patches per frame, on top of the background plane.
+#define TQC_SYNTH_MIN_PATCHES       3
+#define TQC_SYNTH_MAX_PATCHES       8
+
+
+typedef enum _enSynthMode
+{
+    TQC_SYNTH_DOTS  = 0,    // Random dots on fronto-parallel layers, integer disparities.
+    TQC_SYNTH_PLANE = 1     // Smooth texture on slanted planes, sub-pixel disparities.
+} enSynthMode;
+
+// Planar surface seen through a rectangle of the left image: d(x, y) = a * x + b * y + c.
+typedef struct _stSynthPatch
+{
+    Rect   rc;
+    double a;
+    double b;
+    double c;
+    Mat    texture;         // CV_32F in left image coordinates, wide enough for every right pixel.
+} stSynthPatch;
+
+typedef struct _stSynthOption
+{
+    Size        imgSize;
+    int         nMinDisparity;
+    int         nNumDisparities;
+    int         nCount;
+    int         nSeed;
+    double      dFocal;     // Pixels, 0 means 1.15 x width like the Logitech cameras.
+    double      dBaseline;  // Millimeters.
+    enSynthMode mode;
+    const char  *strOutputPath;
+} stSynthOption;
+
+
+static Mat CreateTexture(RNG &rng, enSynthMode mode, Size size)
+{
+    Mat texture(size, CV_32F, Scalar(0));
+
+    if (mode == TQC_SYNTH_DOTS)
+    {
+        // Dots grow with the resolution so 1080p pairs are not pure pixel noise.
+        int nDot = max(1, size.height / 480);
+        Mat dots(size.height / nDot + 1, size.width / nDot + 1, CV_8U);
+
+        rng.fill(dots, RNG::UNIFORM, 0, 2);
+        dots.convertTo(dots, CV_32F, 255);
+        resize(dots, dots, Size(dots.cols * nDot, dots.rows * nDot), 0, 0, INTER_NEAREST);
+        texture = dots(Rect(0, 0, size.width, size.height)).clone();
+    }
+    else
+    {
+        // Value noise, every octave doubles the frequency and halves the amplitude.
+        double amplitude = 128;
+
+        for (int nCell = 64; nCell >= 2; nCell /= 2, amplitude /= 2)
+        {
+            Mat noise(size.height / nCell + 2, size.width / nCell + 2, CV_32F);
+            Mat octave;
+
+            rng.fill(noise, RNG::UNIFORM, -amplitude, amplitude);
+            resize(noise, octave, Size(noise.cols * nCell, noise.rows * nCell), 0, 0, INTER_CUBIC);
+            texture += octave(Rect(0, 0, size.width, size.height));
+        }
+        texture += 128;
+    }
+
+    return texture;
+}
+
+// Disparities of a patch stay inside [dMin, dMax] over its whole rectangle.
+static void CreatePatch(RNG &rng, const stSynthOption &option, bool bBackground, stSynthPatch &patch)
+{
+    int    w    = option.imgSize.width;
+    int    h    = option.imgSize.height;
+    double dMin = option.nMinDisparity;
+    double dMax = option.nMinDisparity + option.nNumDisparities - 1;
+
+    if (bBackground)
+    {
+        // The right view sees up to dMax pixels past the right border of the left view.
+        patch.rc = Rect(0, 0, w + (int)dMax + 2, h);
+        patch.a  = 0;
+        patch.b  = option.mode == TQC_SYNTH_PLANE ? (dMax - dMin) / 2 / h : 0;
+        patch.c  = dMin;
+    }
+    else
+    {
+        int pw = rng.uniform(w / 10, w * 2 / 5);
+        int ph = rng.uniform(h / 10, h * 2 / 5);
+
+        patch.rc = Rect(rng.uniform(0, w - pw), rng.uniform(0, h - ph), pw, ph);
+        patch.a  = 0;
+        patch.b  = 0;
+        patch.c  = rng.uniform((int)dMin + 1, (int)dMax + 1);
+
+        if (option.mode == TQC_SYNTH_PLANE)
+        {
+            double x0 = patch.rc.x;
+            double y0 = patch.rc.y;
+            double x1 = patch.rc.x + pw - 1;
+            double y1 = patch.rc.y + ph - 1;
+            double d0 = rng.uniform(dMin, dMax);
+            double d1 = rng.uniform(dMin, dMax);
+            double d2 = rng.uniform(dMin, dMax);
+
+            // d0 at the top-left, d1 at the top-right and d2 at the bottom-left corner.
+            patch.a = (d1 - d0) / max(x1 - x0, 1.0);
+            patch.b = (d2 - d0) / max(y1 - y0, 1.0);
+            patch.c = d0 - patch.a * x0 - patch.b * y0;
+
+            // The bottom-right corner may leave the range, or the plane may turn too far away from
+            // the cameras to be seen by both, fall back to a fronto-parallel patch then.
+            double d3 = patch.a * x1 + patch.b * y1 + patch.c;
+            if (d3 < dMin || d3 > dMax || fabs(patch.a) > 0.5)
+            {
+                patch.a = 0;
+                patch.b = 0;
+                patch.c = d0;
+            }
+        }
+    }
+
+    patch.texture = CreateTexture(rng, option.mode, Size(patch.rc.x + patch.rc.width, h));
+}
+
+static float SampleTexture(const Mat &texture, double x, int y)
+{
+    int          x0 = (int)floor(x);
+    float        fx = (float)(x - x0);
+    const float *p  = texture.ptr<float>(y);
+
+    x0 = std::min(std::max(x0, 0), texture.cols - 2);
+
+    return p[x0] * (1 - fx) + p[x0 + 1] * fx;
+}
+
+// Nearest surface wins in both views. Ground truth is in the left view, x16 like StereoBM/SGBM,
+// -16 where the match falls outside the right image.
+static void RenderPair(const vector<stSynthPatch> &patches, Size imgSize, Mat &left, Mat &right, Mat &gt)
+{
+    Mat left32(imgSize, CV_32F);
+    Mat right32(imgSize, CV_32F);
+
+    gt.create(imgSize, CV_16S);
+
+    for (int y = 0; y < imgSize.height; y++)
+    {
+        float *pLeft  = left32.ptr<float>(y);
+        float *pRight = right32.ptr<float>(y);
+        short *pGt    = gt.ptr<short>(y);
+
+        for (int x = 0; x < imgSize.width; x++)
+        {
+            double bestLeft   = -1;
+            double bestRight  = -1;
+            int    nLeft      = 0;
+            int    nRight     = 0;
+            double xRight     = 0;
+
+            for (int k = 0; k < (int)patches.size(); k++)
+            {
+                const stSynthPatch &p = patches[k];
+
+                if (y < p.rc.y || y >= p.rc.y + p.rc.height)
+                    continue;
+
+                if (x >= p.rc.x && x < p.rc.x + p.rc.width)
+                {
+                    double d = p.a * x + p.b * y + p.c;
+                    if (d > bestLeft)
+                    {
+                        bestLeft = d;
+                        nLeft    = k;
+                    }
+                }
+
+                // Right pixel x sees left position xl where xl - d(xl, y) = x.
+                double xl = (x + p.b * y + p.c) / (1 - p.a);
+                if (xl >= p.rc.x && xl < p.rc.x + p.rc.width)
+                {
+                    double d = p.a * xl + p.b * y + p.c;
+                    if (d > bestRight)
+                    {
+                        bestRight = d;
+                        nRight    = k;
+                        xRight    = xl;
+                    }
+                }
+            }
+
+            pLeft[x]  = patches[nLeft].texture.ptr<float>(y)[x];
+            pRight[x] = SampleTexture(patches[nRight].texture, xRight, y);
+            pGt[x]    = x - bestLeft < 0 ? -16 : (short)cvRound(bestLeft * 16);
+        }
+    }
+
+    left32.convertTo(left, CV_8U);
+    right32.convertTo(right, CV_8U);
+    cvtColor(left, left, COLOR_GRAY2BGR);
+    cvtColor(right, right, COLOR_GRAY2BGR);
+}
+
+// Identical pinhole cameras, principal point in the middle and a pure x baseline, so the
+// rectification StereoLoadCamParam() computes is the identity and the ground truth holds after it.
+static bool SaveCalibration(const stSynthOption &option, Mat &Q)
+{
+    char   buf[TQC_MAX_PATH];
+    double f  = option.dFocal > 0 ? option.dFocal : option.imgSize.width * 1.15;
+    Mat    M  = (Mat_<double>(3, 3) << f, 0, (option.imgSize.width - 1) / 2.,
+                                       0, f, (option.imgSize.height - 1) / 2.,
+                                       0, 0, 1);
+    Mat    D  = Mat::zeros(1, 5, CV_64F);
+    Mat    R  = Mat::zeros(3, 1, CV_64F);
+    Mat    T  = (Mat_<double>(3, 1) << -option.dBaseline, 0, 0);
+    Mat    R1, R2, P1, P2;
+
+    stereoRectify(M, D, M, D, option.imgSize, Mat::eye(3, 3, CV_64F), T, R1, R2, P1, P2, Q, CALIB_ZERO_DISPARITY, -1, option.imgSize);
+
+    sprintf(buf, "%s/%s", option.strOutputPath, TQC_SYNTH_INTRINSIC_FILE);
+    FileStorage fs(buf, FileStorage::WRITE);
+    if (!fs.isOpened())
+    {
+        LOGE("%s(%d): cannot open file %s", __FUNCTION__, __LINE__, buf);
+        return false;
+    }
+    fs << "M1" << M << "D1" << D << "M2" << M << "D2" << D;
+    fs.release();
+
+    sprintf(buf, "%s/%s", option.strOutputPath, TQC_SYNTH_EXTRINSIC_FILE);
+    fs.open(buf, FileStorage::WRITE);
+    if (!fs.isOpened())
+    {
+        LOGE("%s(%d): cannot open file %s", __FUNCTION__, __LINE__, buf);
+        return false;
+    }
+    fs << "R" << R << "T" << T << "R1" << R1 << "R2" << R2 << "P1" << P1 << "P2" << P2 << "Q" << Q;
+    fs.release();
+
+    return true;
+}
+
+static void PrintHelp()
+{
+    LOGE("\nUsage: StereoSynth --path outputPath [--size=<width>x<height>] [--mode=dots|plane]\n"
+         "[--min-disparity=<min_disparity>] [--max-disparity=<num_disparities>] [--count=N] [--seed=N]\n"
+         "[--focal=<pixels>] [--baseline=<mm>]");
+}
+
+int main(int argc, char **argv)
+{
+    stSynthOption   option;
+    CDispFileWriter gtWriter;
+    Mat             Q;
+    Rect            cullRC;
+    char            buf[TQC_MAX_PATH];
+
+    option.imgSize         = Size(640, 480);
+    option.nMinDisparity   = 1;
+    option.nNumDisparities = 64;
+    option.nCount          = 10;
+    option.nSeed           = 1;
+    option.dFocal          = 0;
+    option.dBaseline       = 70;
+    option.mode            = TQC_SYNTH_DOTS;
+    option.strOutputPath   = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        bool bOk = true;
+
+        if (strncmp(argv[i], "--size=", 7) == 0)
+        {
+            bOk = sscanf(argv[i] + 7, "%dx%d", &option.imgSize.width, &option.imgSize.height) == 2 &&
+                  option.imgSize.width > 0 && option.imgSize.height > 0;
+        }
+        else if (strncmp(argv[i], "--mode=", 7) == 0)
+        {
+            option.mode = strcmp(argv[i] + 7, "plane") == 0 ? TQC_SYNTH_PLANE : TQC_SYNTH_DOTS;
+            bOk         = option.mode == TQC_SYNTH_PLANE || strcmp(argv[i] + 7, "dots") == 0;
+        }
+        else if (strncmp(argv[i], "--min-disparity=", 16) == 0)
+        {
+            bOk = sscanf(argv[i] + 16, "%d", &option.nMinDisparity) == 1 && option.nMinDisparity >= 0;
+        }
+        else if (strncmp(argv[i], "--max-disparity=", 16) == 0)
+        {
+            bOk = sscanf(argv[i] + 16, "%d", &option.nNumDisparities) == 1 && option.nNumDisparities >= 2;
+        }
+        else if (strncmp(argv[i], "--count=", 8) == 0)
+        {
+            bOk = sscanf(argv[i] + 8, "%d", &option.nCount) == 1 && option.nCount > 0;
+        }
+        else if (strncmp(argv[i], "--seed=", 7) == 0)
+        {
+            bOk = sscanf(argv[i] + 7, "%d", &option.nSeed) == 1;
+        }
+        else if (strncmp(argv[i], "--focal=", 8) == 0)
+        {
+            bOk = sscanf(argv[i] + 8, "%lf", &option.dFocal) == 1 && option.dFocal > 0;
+        }
+        else if (strncmp(argv[i], "--baseline=", 11) == 0)
+        {
+            bOk = sscanf(argv[i] + 11, "%lf", &option.dBaseline) == 1 && option.dBaseline > 0;
+        }
+        else if (strcmp(argv[i], "--path") == 0 && i + 1 < argc)
+        {
+            option.strOutputPath = argv[++i];
+        }
+        else
+        {
+            bOk = false;
+        }
+
+        if (!bOk)
+        {
+            LOGE("Command-line parameter error: %s\n", argv[i]);
+            PrintHelp();
+            return -1;
+        }
+    }
+
+    // The matchers search [0, max-disparity), keep the scene inside it.
+    if (!option.strOutputPath || option.nMinDisparity >= option.nNumDisparities - 1)
+    {
+        PrintHelp();
+        return -1;
+    }
+    // From here on the number of disparities in the scene, starting at nMinDisparity.
+    option.nNumDisparities -= option.nMinDisparity;
+
+    cullRC = Rect(0, 0, option.imgSize.width, option.imgSize.height);
+#if TQC_STEREO_CULL
+    // StereoMatch() only outputs the culled window, the ground truth has the same size.
+    cullRC = Rect(TQC_STEREO_CAMERA_X_BORDER, TQC_STEREO_CAMERA_Y_BORDER,
+                  option.imgSize.width - TQC_STEREO_CAMERA_X_BORDER * 2, option.imgSize.height - TQC_STEREO_CAMERA_Y_BORDER * 2);
+    if (cullRC.width <= 0 || cullRC.height <= 0)
+    {
+        LOGE("%s(%d): %dx%d is smaller than the cull borders.", __FUNCTION__, __LINE__, option.imgSize.width, option.imgSize.height);
+        return -1;
+    }
+#endif
+
+    if (!SaveCalibration(option, Q))
+    {
+        return -1;
+    }
+
+    // Start a new ground-truth file, CDispFileWriter appends to an existing one.
+    sprintf(buf, "%s/%s", option.strOutputPath, TQC_SYNTH_GT_FILE);
+    remove(buf);
+    if (!gtWriter.Open(buf))
+    {
+        return -1;
+    }
+
+    RNG rng((uint64)option.nSeed);
+
+    for (int n = 0; n < option.nCount; n++)
+    {
+        vector<stSynthPatch> patches(1 + rng.uniform(TQC_SYNTH_MIN_PATCHES, TQC_SYNTH_MAX_PATCHES + 1));
+        Mat                  left, right, gt;
+        char                 name[TQC_MAX_PATH];
+
+        for (size_t k = 0; k < patches.size(); k++)
+        {
+            CreatePatch(rng, option, k == 0, patches[k]);
+        }
+
+        RenderPair(patches, option.imgSize, left, right, gt);
+
+        sprintf(name, TQC_SYNTH_LEFT_FILE, n);
+        sprintf(buf, "%s/%s", option.strOutputPath, name);
+        if (!imwrite(buf, left))
+        {
+            LOGE("%s(%d): cannot write %s", __FUNCTION__, __LINE__, buf);
+            return -1;
+        }
+
+        sprintf(buf, "%s/" TQC_SYNTH_RIGHT_FILE, option.strOutputPath, n);
+        if (!imwrite(buf, right))
+        {
+            LOGE("%s(%d): cannot write %s", __FUNCTION__, __LINE__, buf);
+            return -1;
+        }
+
+        gtWriter.Write(gt(cullRC), Q, "gt", name, 0);
+    }
+
+    gtWriter.Close();
+
+    LOGE("%d %dx%d pairs written to %s", option.nCount, option.imgSize.width, option.imgSize.height, option.strOutputPath);
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,13 @@
+#ifndef __STEREO_SYNTH_H
+#define __STEREO_SYNTH_H
+
+#include "StereoDispFile.h"
+
+// Output layout of StereoSynth, StereoBench --synthetic reads the same names.
+#define TQC_SYNTH_LEFT_FILE         "videoLeft_%04d.png"
+#define TQC_SYNTH_RIGHT_FILE        "videoRight_%04d.png"
+#define TQC_SYNTH_INTRINSIC_FILE    "synthetic_intrinsics.yml"
+#define TQC_SYNTH_EXTRINSIC_FILE    "synthetic_extrinsics.yml"
+#define TQC_SYNTH_GT_FILE           "disp_gt." TQC_DISP_FILE_EXT
+
+#endif /* __STEREO_SYNTH_H */
\ No newline at end of file
@@ -3,13 +3,14 @@
 
 #include "TqcLog.h"
 #include "TqcUtils.h"
+#include "TqcScheduler.h"
 #include "StereoUtils.h"
 
 stCmdOption g_option;
 
 bool ParseCmd(int argc, char *argv[], stCmdOption &cmd)
 {
-    if (argc < 3)
+    if (argc < 2)
     {
         return false;
     }
@@ -22,7 +23,12 @@ bool ParseCmd(int argc, char *argv[], stCmdOption &cmd)
             cmd.algorithm        = strcmp(cmd.strAlgorithmName, TQC_ALGORITHM_NAME_BM) == 0 ? TQC_STEREO_BM :
                                    strcmp(cmd.strAlgorithmName, TQC_ALGORITHM_NAME_SGBM) == 0 ? TQC_STEREO_SGBM :
                                    strcmp(cmd.strAlgorithmName, TQC_ALGORITHM_NAME_HH) == 0 ? TQC_STEREO_HH :
-                                   strcmp(cmd.strAlgorithmName, TQC_ALGORITHM_NAME_VAR) == 0 ? TQC_STEREO_VAR : TQC_STEREO_VALID;
+                                   strcmp(cmd.strAlgorithmName, TQC_ALGORITHM_NAME_VAR) == 0 ? TQC_STEREO_VAR :
+                                   strcmp(cmd.strAlgorithmName, TQC_ALGORITHM_NAME_CENSUS) == 0 ? TQC_STEREO_CENSUS_SGM :
+                                   strcmp(cmd.strAlgorithmName, TQC_ALGORITHM_NAME_PYRAMID) == 0 ? TQC_STEREO_PYRAMID :
+                                   strcmp(cmd.strAlgorithmName, TQC_ALGORITHM_NAME_STREAM) == 0 ? TQC_STEREO_STREAM_SGM :
+                                   strcmp(cmd.strAlgorithmName, TQC_ALGORITHM_NAME_SAD) == 0 ? TQC_STEREO_SAD :
+                                   strcmp(cmd.strAlgorithmName, TQC_ALGORITHM_NAME_ZSAD) == 0 ? TQC_STEREO_ZSAD : TQC_STEREO_VALID;
             if (cmd.algorithm < 0)
             {
                 LOGE("Command-line parameter error: Unknown stereo algorithm\n\n");
@@ -55,10 +61,114 @@ bool ParseCmd(int argc, char *argv[], stCmdOption &cmd)
                 return false;
             }
         }
+        else if (strncmp(argv[i], TQC_JOBS_OPTION, strlen(TQC_JOBS_OPTION)) == 0)
+        {
+            if (sscanf(argv[i] + strlen(TQC_JOBS_OPTION), "%d", &cmd.nJobs) != 1 || cmd.nJobs < 1)
+            {
+                LOGE("Command-line parameter error: The number of jobs (--jobs=<...>) must be a positive integer\n");
+                return false;
+            }
+        }
+        else if (strncmp(argv[i], TQC_THREADS_OPTION, strlen(TQC_THREADS_OPTION)) == 0)
+        {
+            if (sscanf(argv[i] + strlen(TQC_THREADS_OPTION), "%d", &cmd.nThreads) != 1 || cmd.nThreads < 0)
+            {
+                LOGE("Command-line parameter error: The number of threads (--threads=<...>) must not be negative\n");
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], TQC_AFFINITY_OPTION) == 0)
+        {
+            cmd.bAffinity = true;
+        }
+        else if (strcmp(argv[i], TQC_FIXED_POINT_OPTION) == 0)
+        {
+            cmd.bFixedPoint = true;
+        }
+        else if (strcmp(argv[i], TQC_GRAY_OPTION) == 0)
+        {
+            cmd.bGrayRemap = true;
+        }
+        else if (strncmp(argv[i], TQC_TILES_OPTION, strlen(TQC_TILES_OPTION)) == 0)
+        {
+            if (sscanf(argv[i] + strlen(TQC_TILES_OPTION), "%d", &cmd.nTiles) != 1 || cmd.nTiles < 1)
+            {
+                LOGE("Command-line parameter error: The number of tiles (--tiles=<...>) must be a positive integer\n");
+                return false;
+            }
+        }
+        else if (strncmp(argv[i], TQC_ITERATIONS_OPTION, strlen(TQC_ITERATIONS_OPTION)) == 0)
+        {
+            if (sscanf(argv[i] + strlen(TQC_ITERATIONS_OPTION), "%d", &cmd.nIterations) != 1 || cmd.nIterations < 1)
+            {
+                LOGE("Command-line parameter error: The number of iterations (--iterations=<...>) must be a positive integer\n");
+                return false;
+            }
+        }
+        else if (strncmp(argv[i], TQC_WARMUP_OPTION, strlen(TQC_WARMUP_OPTION)) == 0)
+        {
+            if (sscanf(argv[i] + strlen(TQC_WARMUP_OPTION), "%d", &cmd.nWarmup) != 1 || cmd.nWarmup < 0)
+            {
+                LOGE("Command-line parameter error: The number of warm-up iterations (--warmup=<...>) must not be negative\n");
+                return false;
+            }
+        }
+        else if (strncmp(argv[i], TQC_OBSTACLE_OPTION, strlen(TQC_OBSTACLE_OPTION)) == 0)
+        {
+            if (sscanf(argv[i] + strlen(TQC_OBSTACLE_OPTION), "%lf", &cmd.dObstacleDepth) != 1 || cmd.dObstacleDepth <= 0)
+            {
+                LOGE("Command-line parameter error: The obstacle distance (--obstacle=<mm>) must be a positive number\n");
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "--obstacle") == 0)
+        {
+            cmd.dObstacleDepth = TQC_OBSTACLE_DEPTH;
+        }
+        else if (strncmp(argv[i], TQC_TEMPORAL_OPTION, strlen(TQC_TEMPORAL_OPTION)) == 0)
+        {
+            if (sscanf(argv[i] + strlen(TQC_TEMPORAL_OPTION), "%d", &cmd.nTemporalRefresh) != 1 || cmd.nTemporalRefresh <= 0)
+            {
+                LOGE("Command-line parameter error: The temporal refresh period (--temporal=<frames>) must be a positive integer\n");
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "--temporal") == 0)
+        {
+            cmd.nTemporalRefresh = TQC_TEMPORAL_REFRESH;
+        }
+        else if (strncmp(argv[i], TQC_REPORT_OPTION, strlen(TQC_REPORT_OPTION)) == 0)
+        {
+            cmd.strReportFile = argv[i] + strlen(TQC_REPORT_OPTION);
+        }
+        else if (strcmp(argv[i], TQC_DATA_OPTION) == 0)
+        {
+            cmd.strDataPath = argv[++i];
+        }
+        else if (strcmp(argv[i], TQC_SYNTHETIC_OPTION) == 0)
+        {
+            cmd.strSynthPath = argv[++i];
+        }
         else if (strcmp(argv[i], TQC_NO_DISPLAY_OPTION) == 0)
         {
             cmd.bDisplay = false;
         }
+        else if (strcmp(argv[i], TQC_ROI_ONLY_OPTION) == 0)
+        {
+            cmd.bRoiOnly = true;
+        }
+        else if (strcmp(argv[i], TQC_PIPELINE_OPTION) == 0)
+        {
+            cmd.bPipeline = true;
+        }
+        else if (strcmp(argv[i], TQC_LEFT_SOURCE_OPTION) == 0)
+        {
+            cmd.strLeftSource = argv[++i];
+        }
+        else if (strcmp(argv[i], TQC_RIGHT_SOURCE_OPTION) == 0)
+        {
+            cmd.strRightSource = argv[++i];
+        }
         else if (strcmp(argv[i], "-i") == 0)
         {
             cmd.strIntrinsicFile = argv[++i];
@@ -101,6 +211,14 @@ bool ParseCmd(int argc, char *argv[], stCmdOption &cmd)
         {
             cmd.strRightPrefix = argv[++i];
         }
+        else if (strncmp(argv[i], TQC_TRACE_OPTION, strlen(TQC_TRACE_OPTION)) == 0)
+        {
+            cmd.strTraceFile = argv[i] + strlen(TQC_TRACE_OPTION);
+        }
+        else if (strcmp(argv[i], TQC_CONVERT_DISP_OPTION) == 0)
+        {
+            cmd.strConvertFile = argv[++i];
+        }
         else if (strcmp(argv[i], "--path") == 0)
         {
             cmd.strOutputPath = argv[++i];
@@ -118,10 +236,14 @@ bool ParseCmd(int argc, char *argv[], stCmdOption &cmd)
 void PrintHelp()
 {
     LOGE("\nDemo stereo matching converting L and R images into disparity and point clouds\n");
-    LOGE("\nUsage: stereo_match <left_image> <right_image> [--algorithm=bm|sgbm|hh] [--blocksize=<block_size>]\n"
-         "[--max-disparity=<max_disparity>] [--scale=scale_factor>] [-i <intrinsic_filename>] [-e <extrinsic_filename>]\n"
-         "[--no-display] [-o <disparity_image>] [-p <point_cloud_file>]\n"
-         "[--path outputPath] [--left left] [--right right]");
+    LOGE("\nUsage: stereo_match <left_image> <right_image> [--algorithm=bm|sgbm|hh|census|pyramid|stream|sad|zsad]\n"
+         "[--blocksize=<block_size>] [--max-disparity=<max_disparity>] [--scale=scale_factor>]\n"
+         "[-i <intrinsic_filename>] [-e <extrinsic_filename>] [--no-display] [--roi-only] [--pipeline]\n"
+         "[--jobs=N] [--threads=N] [--affinity] [--tiles=N] [--fixed-point] [--gray] [--trace=trace.json]\n"
+         "[--obstacle[=<mm>]] [--temporal[=<frames>]] [-o <disparity_image>] [-p <point_cloud_file>]\n"
+         "[--path outputPath] [--left left] [--right right]\n"
+         "[--left-source left_video|left_%03d.png] [--right-source right_video|right_%03d.png]\n"
+         "[--convert-disp disparity_file.tqcd -o <disparity_name> --path outputPath]");
 }
 
 bool CheckOption(stCmdOption option)
@@ -148,38 +270,43 @@ bool CheckOption(stCmdOption option)
     return true;
 }
 
+// --threads= counts the calling thread, the scheduler only adds the other workers.
+bool StartScheduler(const stCmdOption &option)
+{
+    if (option.nThreads == 1)
+    {
+        return true;
+    }
+
+    return TqcGetScheduler().Start(option.nThreads - 1, option.bAffinity);
+}
+
 bool GenerateMipmap(Mat img1, Mat img2, int width, int height, const char *filePreLeft, const char *filePreRight)
 {
-    int  k     = 1;
-    Mat  temp1 = img1;
-    Mat  temp2 = img2;
-    char buf[TQC_MAX_PATH];
+    int              nLevels = 1;
+    std::vector<Mat> pyramid1;
+    std::vector<Mat> pyramid2;
+    char             buf[TQC_MAX_PATH];
 
-    do
+    // One more level for every halving of width x height that stays above TQC_PYRAMID_MIN_SIZE.
+    for (width /= 2, height /= 2; width > TQC_PYRAMID_MIN_SIZE && height > TQC_PYRAMID_MIN_SIZE; width /= 2, height /= 2)
     {
-        Mat tmpScale1;
-        Mat tmpScale2;
-
-        width  /= 2;
-        height /= 2;
+        nLevels++;
+    }
 
-        resize(temp1, tmpScale1, Size(), 0.5f, 0.5f, INTER_LINEAR);
-        resize(temp2, tmpScale2, Size(), 0.5f, 0.5f, INTER_LINEAR);
+    StereoBuildPyramid(img1, nLevels, pyramid1);
+    StereoBuildPyramid(img2, nLevels, pyramid2);
 
+    for (size_t k = 0; k < pyramid1.size() && k < pyramid2.size(); k++)
+    {
         memset(buf, 0, 256);
-        sprintf(buf, "%s/%s_%d.jpg", g_option.strOutputPath, filePreLeft, 20 + k);
-        imwrite(buf, temp1);
+        sprintf(buf, "%s/%s_%d.jpg", g_option.strOutputPath, filePreLeft, 21 + (int)k);
+        imwrite(buf, pyramid1[k]);
 
         memset(buf, 0, 256);
-        sprintf(buf, "%s/%s_%d.jpg", g_option.strOutputPath, filePreRight, 20 + k);
-        imwrite(buf, temp2);
-
-        k++;
-
-        temp1 = tmpScale1;
-        temp2 = tmpScale2;
+        sprintf(buf, "%s/%s_%d.jpg", g_option.strOutputPath, filePreRight, 21 + (int)k);
+        imwrite(buf, pyramid2[k]);
     }
-    while (width > 32 && height > 32);
 
     return true;
 }
@@ -230,6 +357,19 @@ char* GetFileName(const char *fileName,
 {
     static char output[TQC_MAX_PATH];
 
+    return GetFileName(output, fileName, postfixName, extName, strOutputPath, strAlgorithmName, width, height);
+}
+
+// Reentrant version, output must hold TQC_MAX_PATH characters.
+char* GetFileName(char *output,
+                  const char *fileName,
+                  const char *postfixName,
+                  const char *extName,
+                  const char *strOutputPath,
+                  const char *strAlgorithmName,
+                  int width,
+                  int height)
+{
     memset(output, 0, TQC_MAX_PATH);
     sprintf(output, "%s/%s_%s_%dx%d_%s.%s", strOutputPath, fileName, strAlgorithmName, width, height, postfixName, extName);
 
@@ -238,17 +378,18 @@ char* GetFileName(const char *fileName,
 
 void SavePic(const char *postfixName, const char *strOutputPath, const char *strAlgorithmName, Mat &disp8)
 {
+    char buf[TQC_MAX_PATH];
     char *strFileName;
 
     // Save disparity picture
-    strFileName = GetFileName("disp", postfixName, "jpg", strOutputPath, strAlgorithmName, disp8.cols, disp8.rows);
+    strFileName = GetFileName(buf, "disp", postfixName, "jpg", strOutputPath, strAlgorithmName, disp8.cols, disp8.rows);
     imwrite(strFileName, disp8);
 
     // Save color picture
     CvMat *pColorMat = cvCreateMat(disp8.rows, disp8.cols, CV_8UC3);
     CvMat grayMat    = disp8;
     Gray2Color(&grayMat, pColorMat);
-    strFileName = GetFileName("color", postfixName, "jpg", strOutputPath, strAlgorithmName, disp8.cols, disp8.rows);
+    strFileName = GetFileName(buf, "color", postfixName, "jpg", strOutputPath, strAlgorithmName, disp8.cols, disp8.rows);
     Mat colorMat1 = Mat(pColorMat->rows, pColorMat->cols, CV_8UC3, pColorMat->data.ptr);
     imwrite(strFileName, colorMat1);
     cvReleaseMat(&pColorMat);
@@ -256,10 +397,10 @@ void SavePic(const char *postfixName, const char *strOutputPath, const char *str
 
 void SaveDispData(const char *filename, const char *postfixName, const char *strOutputPath, const char *strAlgorithmName, const Mat &mat)
 {
-    char *buf;
+    char buf[TQC_MAX_PATH];
     FILE *fp = NULL;
 
-    buf = GetFileName(filename, postfixName, "dat", strOutputPath, strAlgorithmName, mat.cols, mat.rows);
+    GetFileName(buf, filename, postfixName, "dat", strOutputPath, strAlgorithmName, mat.cols, mat.rows);
     fp = fopen(buf, "wt");
 
     fprintf(fp, "%02d\n", mat.rows);
@@ -283,10 +424,10 @@ void SaveXYZData(const char *filename, const char *postfixName, const char *strO
     const double max_z = 1.0e4;
 #endif
 
-    char *buf;
+    char buf[TQC_MAX_PATH];
     FILE *fp = NULL;
 
-    buf = GetFileName(filename, postfixName, "dat", strOutputPath, strAlgorithmName, mat.cols, mat.rows);
+    GetFileName(buf, filename, postfixName, "dat", strOutputPath, strAlgorithmName, mat.cols, mat.rows);
     fp = fopen(buf, "wt");
 
     for (int y = 0; y < mat.rows; y++)
@@ -308,16 +449,36 @@ void SaveXYZData(const char *filename, const char *postfixName, const char *strO
     fclose(fp);
 }
 
-void StereoReprojectPixelTo3D(const Mat disp, const Mat &Q, const Point2i &pixel, Point3d &point)
+void StereoReprojectPixelTo3D(const Mat &disp, const stDepthLut &lut, const Point2i &pixel, Point3d &point)
+{
+    double depth = StereoGetDepthFromLut(lut, disp.at<short>(pixel.y, pixel.x));
+
+    // x / w == (x + q03) * z / q23, so x and y follow from the depth lookup.
+    point.x = (pixel.x + lut.q03) * depth / lut.q23;
+    point.y = (pixel.y + lut.q13) * depth / lut.q23;
+    point.z = depth;
+}
+
+// Rounded to the nearest integer, ties away from zero.
+static int DivRound(int64 num, int64 den)
+{
+    return (int)((num + (num >= 0 ? den / 2 : -den / 2)) / den);
+}
+
+// Integer version in mm. z is the mm table entry, within 0.5 mm of the float z. x and y come from
+// it with the Q terms in fixed point, so they are within 0.5 mm plus 0.5 mm times the ray's slope
+// (|x| / z) of the float x and y: about 1 mm inside a 90 degree field of view.
+void StereoReprojectPixelTo3D(const Mat &disp, const stDepthLut &lut, const Point2i &pixel, Point3i &point)
 {
-    double q[4][4];
-    Mat    _Q(4, 4, CV_64F, q);
-    int    x = pixel.x;
-    int    y = pixel.y;
+    int z = StereoGetDepthMmFromLut(lut, disp.at<short>(pixel.y, pixel.x));
 
-    Q.convertTo(_Q, CV_64F);
+    if (z == 0 || lut.nQ23 <= 0)
+    {
+        point = Point3i(0, 0, 0);
+        return;
+    }
 
-    point.x = ((x + q[0][3]) / (q[3][2] * disp.at<short>(y, x) + q[3][3])) * 16;
-    point.y = ((y + q[1][3]) / (q[3][2] * disp.at<short>(y, x) + q[3][3])) * 16;
-    point.z = ((q[2][3]) / (q[3][2] * disp.at<short>(y, x) + q[3][3])) * 16;
+    point.x = DivRound(((int64)pixel.x * (1 << TQC_DEPTH_Q_BITS) + lut.nQ03) * z, lut.nQ23);
+    point.y = DivRound(((int64)pixel.y * (1 << TQC_DEPTH_Q_BITS) + lut.nQ13) * z, lut.nQ23);
+    point.z = z;
 }
\ No newline at end of file
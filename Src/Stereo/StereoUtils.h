@@ -10,11 +10,35 @@
 #define TQC_ALGORITHM_NAME_SGBM "sgbm"
 #define TQC_ALGORITHM_NAME_HH   "hh"
 #define TQC_ALGORITHM_NAME_VAR  "var"
+#define TQC_ALGORITHM_NAME_CENSUS "census"
+#define TQC_ALGORITHM_NAME_PYRAMID "pyramid"
+#define TQC_ALGORITHM_NAME_STREAM "stream"
+#define TQC_ALGORITHM_NAME_SAD  "sad"
+#define TQC_ALGORITHM_NAME_ZSAD "zsad"
 
 #define TQC_MAX_DISPARITY_OPTION "--max-disparity="
 #define TQC_BLOCK_SIZE_OPTION    "--blocksize="
 #define TQC_SCALE_OPTION         "--scale="
 #define TQC_NO_DISPLAY_OPTION    "--no-display"
+#define TQC_ROI_ONLY_OPTION      "--roi-only"
+#define TQC_PIPELINE_OPTION      "--pipeline"
+#define TQC_LEFT_SOURCE_OPTION   "--left-source"
+#define TQC_RIGHT_SOURCE_OPTION  "--right-source"
+#define TQC_JOBS_OPTION          "--jobs="
+#define TQC_THREADS_OPTION       "--threads="
+#define TQC_AFFINITY_OPTION      "--affinity"
+#define TQC_TILES_OPTION         "--tiles="
+#define TQC_FIXED_POINT_OPTION   "--fixed-point"
+#define TQC_GRAY_OPTION          "--gray"
+#define TQC_CONVERT_DISP_OPTION  "--convert-disp"
+#define TQC_TRACE_OPTION         "--trace="
+#define TQC_ITERATIONS_OPTION    "--iterations="
+#define TQC_WARMUP_OPTION        "--warmup="
+#define TQC_DATA_OPTION          "--data"
+#define TQC_SYNTHETIC_OPTION     "--synthetic"
+#define TQC_REPORT_OPTION        "--report="
+#define TQC_OBSTACLE_OPTION      "--obstacle="
+#define TQC_TEMPORAL_OPTION      "--temporal="
 
 typedef struct _stCmdOption
 {
@@ -24,6 +48,18 @@ typedef struct _stCmdOption
     int         nSADWindowSize;
     int         nNumDisparities;
     bool        bDisplay;
+    bool        bRoiOnly;
+    bool        bPipeline;
+    int         nJobs;
+    int         nThreads;            // Threads of the banded stages, caller included. 0: one per CPU.
+    bool        bAffinity;           // Pin the scheduler's workers to one CPU each.
+    int         nTiles;              // SGBM/HH strips matched in parallel, 1 matches the whole frame.
+    bool        bFixedPoint;         // Integer-only resize, depth and copter grid.
+    bool        bGrayRemap;          // SGBM/HH: rectify color input straight to gray, match one channel.
+    int         nIterations;         // StereoBench: timed passes over every data set.
+    int         nWarmup;             // StereoBench: untimed passes before them.
+    double      dObstacleDepth;      // Obstacle check threshold in mm, 0 disables it.
+    int         nTemporalRefresh;    // Temporal mode: frames per full match, 0 disables it.
 
     char *strIntrinsicFile = 0;
     char *strExtrinsicFile = 0;
@@ -36,10 +72,29 @@ typedef struct _stCmdOption
     FILE *depthFile;
     char *strLeftPrefix;
     char *strRightPrefix;
+    char *strLeftSource;     // Video file or image sequence replacing the left camera.
+    char *strRightSource;
+    char *strConvertFile;    // Binary disparity file to convert back to text.
+    char *strTraceFile;      // Chrome trace JSON written at exit.
+    char *strDataPath;       // StereoBench: root of the bundled Data directory.
+    char *strSynthPath;      // StereoBench: StereoSynth output used instead of the bundled data.
+    char *strReportFile;     // StereoBench: JSON report.
 
     _stCmdOption()
     {
         bDisplay         = true;
+        bRoiOnly         = false;
+        bPipeline        = false;
+        nJobs            = 1;
+        nThreads         = 0;
+        bAffinity        = false;
+        nTiles           = 1;
+        bFixedPoint      = TQC_FIXED_POINT != 0;
+        bGrayRemap       = false;
+        nIterations      = 10;
+        nWarmup          = 2;
+        dObstacleDepth   = 0;
+        nTemporalRefresh = 0;
         strAlgorithmName = NULL;
         strIntrinsicFile = NULL;
         strExtrinsicFile = NULL;
@@ -57,6 +112,13 @@ typedef struct _stCmdOption
         depthFile      = NULL;
         strLeftPrefix  = NULL;
         strRightPrefix = NULL;
+        strLeftSource  = NULL;
+        strRightSource = NULL;
+        strConvertFile = NULL;
+        strTraceFile   = NULL;
+        strDataPath    = NULL;
+        strSynthPath   = NULL;
+        strReportFile  = NULL;
     }
 } stCmdOption;
 
@@ -64,6 +126,7 @@ typedef struct _stCmdOption
 bool ParseCmd(int argc, char *argv[], stCmdOption &cmd);
 void PrintHelp();
 bool CheckOption(stCmdOption option);
+bool StartScheduler(const stCmdOption &option);
 bool GenerateMipmap(Mat img1, Mat img2, int width, int height, const char *filePreLeft, const char *filePreRight);
 void SavePic(const char *postfixName, const char *strOutputPath, const char *strAlgorithmName, Mat &disp8);
 void SaveDispData(const char *filename, const char *postfixName, const char *strOutputPath, const char *strAlgorithmName, const Mat &mat);
@@ -75,7 +138,16 @@ char* GetFileName(const char *fileName,
                   const char *strAlgorithmName,
                   int width,
                   int height);
-void StereoReprojectPixelTo3D(const Mat disp, const Mat &Q, const Point2i &pixel, Point3d &point);
+char* GetFileName(char *output,
+                  const char *fileName,
+                  const char *postfixName,
+                  const char *extName,
+                  const char *strOutputPath,
+                  const char *strAlgorithmName,
+                  int width,
+                  int height);
+void StereoReprojectPixelTo3D(const Mat &disp, const stDepthLut &lut, const Point2i &pixel, Point3d &point);
+void StereoReprojectPixelTo3D(const Mat &disp, const stDepthLut &lut, const Point2i &pixel, Point3i &point);
 
 // Global variables declaration
 extern stCmdOption g_option;
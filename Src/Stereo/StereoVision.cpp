@@ -19,11 +19,15 @@
 #include <opencv2/core/utility.hpp>
 
 #include "TqcLog.h"
+#include "TqcTrace.h"
 #include "Config.h"
 #include "StereoVision.h"
 #include "StereoCamera.h"
 #include "StereoMatchAlgorithm.h"
 #include "StereoUtils.h"
+#include "StereoPipeline.h"
+#include "StereoCapture.h"
+#include "StereoPointCloud.h"
 
 using namespace cv;
 
@@ -46,15 +50,142 @@ void OnMouse(int event, int x, int y, int, void*)
         return;
 }
 
+static void StereoDumpTrace()
+{
+    if (g_option.strTraceFile)
+    {
+        TqcTraceDump(g_option.strTraceFile);
+        TqcTraceSummary(NULL);
+    }
+}
+
+// Log the depth grid and show both frames plus the disparity. Returns false when ESC is pressed.
+static bool ShowFrame(const Mat &leftFrame, const Mat &rightFrame, const Mat &disp8, double d[3][3])
+{
+    TQC_TRACE_SCOPE("display");
+
+    Mat  displayFrame = Mat(Size(g_windowWidth, g_windowHeight), CV_8UC3);
+    Rect dstRC;
+    Mat  dstROI;
+
+    // Show depth value
+    LOGE("****************************************\n");
+    LOGE("* %08.3f * %08.3f * %08.3f *\n", d[0][0], d[0][1], d[0][2]);
+    LOGE("* %08.3f * %08.3f * %08.3f *\n", d[1][0], d[1][1], d[1][2]);
+    LOGE("* %08.3f * %08.3f * %08.3f *\n", d[2][0], d[2][1], d[2][2]);
+    LOGE("****************************************\n\n");
+
+    // Show left frame.
+    dstRC  = Rect(g_border, g_border, g_cameraWidth, g_cameraHeight);
+    dstROI = displayFrame(dstRC);
+    leftFrame.copyTo(dstROI);
+
+    // Show right frame.
+    dstRC  = Rect(g_cameraWidth + g_border * 2, g_border, g_cameraWidth, g_cameraHeight);
+    dstROI = displayFrame(dstRC);
+    rightFrame.copyTo(dstROI);
+
+    // Show disparities' image.
+    dstRC  = Rect(g_border, g_border * 2 + g_cameraHeight, disp8.cols, disp8.rows);
+    dstROI = displayFrame(dstRC);
+    Mat dispColor;
+    // disp8.convertTo(dispColor, displayFrame.type());
+    cvtColor(disp8, dispColor, CV_GRAY2BGR);
+    dispColor.copyTo(dstROI);
+
+    imshow(g_windowName, displayFrame);
+
+    // IMPORTANT: Wait for at least 20 milliseconds, so that the image can be displayed on the screen!
+    // Also checks if a key was pressed in the GUI window. Note that it should be a "char" to support Linux.
+    char keypress = waitKey(20);  // This is needed if you want to see anything!
+    if (keypress == VK_ESCAPE)
+    {
+        // Escape Key
+        // Quit the program!
+        return false;
+    }
+
+    return true;
+}
+
+// One line per frame: X for a hit cell with its nearest depth, . for a clear one.
+static void LogObstacle(const stObstacleGrid &grid, double dMaxDepth)
+{
+    char buf[TQC_VIRTUAL_COPTER_Y_SPLITE * TQC_VIRTUAL_COPTER_X_SPLITE * 16];
+    int  len = 0;
+
+    for (int j = 0; j < TQC_VIRTUAL_COPTER_Y_SPLITE; j++)
+    {
+        for (int i = 0; i < TQC_VIRTUAL_COPTER_X_SPLITE; i++)
+        {
+            len += grid.bHit[j][i] ? sprintf(buf + len, " X%5.0f", grid.d[j][i]) : sprintf(buf + len, "      .");
+        }
+        len += sprintf(buf + len, j + 1 < TQC_VIRTUAL_COPTER_Y_SPLITE ? " |" : "");
+    }
+
+    LOGE("obstacle < %.0fmm (d >= %d):%s", dMaxDepth, grid.nMinDisparity, buf);
+}
+
+// Capture, match and depth grid run on their own threads, this thread only displays.
+static int RunPipeline(CStereoCapture &capture, CStereoMatcher &matcher)
+{
+    CStereoPipeline pipeline;
+    stPipelineFrame frame;
+    int64           tLast = 0;
+
+    pipeline.SetKeepRectified(g_option.strPCLFile && TQC_PLY_WITH_COLOR);
+
+    if (!pipeline.Start(&capture, &matcher, g_option.fScale, g_option.bRoiOnly, g_option.dObstacleDepth))
+    {
+        return -1;
+    }
+
+    while (pipeline.Pop(frame))
+    {
+        int64  tNow = getTickCount();
+        double freq = getTickFrequency();
+
+        LOGE("#%d---Latency: match %fms, grid %fms, display %fms, interval %fms, skew %fms\n", frame.nIndex,
+             (frame.tMatched - frame.tCapture) * 1000 / freq,
+             (frame.tGrid - frame.tCapture) * 1000 / freq,
+             (tNow - frame.tCapture) * 1000 / freq,
+             tLast ? (tNow - tLast) * 1000 / freq : 0.0,
+             frame.dSkew);
+        tLast = tNow;
+
+        if (frame.bObstacle)
+        {
+            LogObstacle(frame.obstacle, g_option.dObstacleDepth);
+        }
+
+        // Same point cloud log as the serial loop.
+        if (g_option.strPCLFile)
+        {
+            TQC_TRACE_SCOPE("output");
+            char buf[TQC_MAX_PATH];
+
+            sprintf(buf, "%s/%s_%06d.ply", g_option.strOutputPath ? g_option.strOutputPath : ".", g_option.strPCLFile, frame.nIndex);
+            StereoSavePly(buf, frame.disp, g_CamParam.depthLut, frame.rectLeft, TQC_MAX_DEPTH);
+        }
+
+        if (!ShowFrame(frame.left, frame.right, frame.disp8, frame.d))
+        {
+            break;
+        }
+    }
+
+    pipeline.Stop();
+    StereoDumpTrace();
+
+    return 0;
+}
+
 int main(int argc, char *argv[])
 {
-    int          i = 0;
-    VideoCapture leftCam;
-    VideoCapture rightCam;
-    Mat          leftFrame;
-    Mat          rightFrame;
-    Rect         dstRC;
-    Mat          dstROI;
+    int            i = 0;
+    CStereoCapture capture;
+    CStereoMatcher matcher;
+    stStereoPair   pair;
 
     if (!ParseCmd(argc, argv, g_option))
     {
@@ -62,6 +193,13 @@ int main(int argc, char *argv[])
         return -1;
     }
 
+    TqcTraceEnable(g_option.strTraceFile != NULL);
+
+    if (!StartScheduler(g_option))
+    {
+        return -1;
+    }
+
     if (!StereoLoadCamParam(g_option.strIntrinsicFile,
                             g_option.strExtrinsicFile,
                             g_option.fScale,
@@ -74,7 +212,11 @@ int main(int argc, char *argv[])
         return -1;
     }
 
-    if (!StereoOpenCam(leftCam, rightCam, g_cameraWidth, g_cameraHeight))
+    // Replay files instead of the cameras when both sources are given.
+    bool bOpened = (g_option.strLeftSource && g_option.strRightSource) ?
+                   capture.Open(g_option.strLeftSource, g_option.strRightSource) :
+                   capture.Open(TQC_LOGICAL_CAM_LEFT_INDEX, TQC_LOGICAL_CAM_RIGHT_INDEX, g_cameraWidth, g_cameraHeight);
+    if (!bOpened || !capture.Start())
     {
         LOGE("%s(%d): cannot open stereo cameras.", __FUNCTION__, __LINE__);
         return -1;
@@ -87,86 +229,91 @@ int main(int argc, char *argv[])
     // Get OpenCV to automatically call my "onMouse()" function when the user clicks in the GUI window.
     setMouseCallback(g_windowName, OnMouse, 0);
 
-    if (!StereoGetFrame(leftCam, rightCam, leftFrame, rightFrame))
+    if (!capture.Read(pair))
+    {
+        return -1;
+    }
+
+    if (!matcher.Init(g_option.bGrayRemap ? 1 : pair.left.channels(),
+                      g_CamParam.roi1,
+                      g_CamParam.roi2,
+                      g_option.nNumDisparities,
+                      g_option.nSADWindowSize,
+                      g_imgSize.width,
+                      g_option.algorithm))
     {
         return -1;
     }
+    matcher.SetCamParam(g_CamParam);
+    matcher.SetTiles(g_option.nTiles);
+    matcher.SetFixedPoint(g_option.bFixedPoint);
 
-    if (!StereoInitAlgorithm(leftFrame.channels(),
-                             g_CamParam.roi1,
-                             g_CamParam.roi2,
-                             g_option.nNumDisparities,
-                             g_option.nSADWindowSize,
-                             g_imgSize.width,
-                             g_option.algorithm))
+    // Consecutive live frames are nearly identical, most of them only track the previous disparity.
+    if (!matcher.SetTemporal(g_option.nTemporalRefresh))
     {
         return -1;
     }
 
+    if (g_option.bPipeline)
+    {
+        return RunPipeline(capture, matcher);
+    }
+
     while (1)
     {
-        Mat    displayFrame = Mat(Size(g_windowWidth, g_windowHeight), CV_8UC3);
         Mat    disp;
         Mat    disp8;
         double d[3][3] = { 0.0f };
         int64  t       = getTickCount();
 
-        displayFrame.empty();
-
-        if (!StereoGetFrame(leftCam, rightCam, leftFrame, rightFrame))
+        if (!capture.Read(pair))
         {
             return -1;
         }
 
-        if (!StereoMatch(leftFrame, rightFrame, g_option.fScale, g_option.algorithm, g_CamParam, disp))
+        // The safety check only searches the near band, so it answers before the full match.
+        if (g_option.dObstacleDepth > 0)
+        {
+            stObstacleGrid grid;
+
+            if (matcher.CheckObstacle(pair.left, pair.right, g_option.fScale, g_option.dObstacleDepth, grid))
+            {
+                LogObstacle(grid, g_option.dObstacleDepth);
+            }
+        }
+
+        bool bMatched = g_option.bRoiOnly ?
+                        matcher.MatchRoi(pair.left, pair.right, g_option.fScale, disp) :
+                        matcher.Match(pair.left, pair.right, g_option.fScale, disp);
+        if (!bMatched)
         {
             LOGE("%s(%d): cannot match left and right images.", __FUNCTION__, __LINE__);
             return -1;
         }
 
-        disp8 = StereoGetDisp8FromDisp(disp, g_algorithmParam.selector, g_algorithmParam.nNumDisparities);
-        StereoCalcDepthOfVirtualCopter(disp, g_CamParam.Q, d);
+        disp8 = StereoGetDisp8FromDisp(disp, matcher.GetParam().selector, matcher.GetParam().nNumDisparities);
+        StereoCalcDepthOfVirtualCopter(disp, g_CamParam.depthLut, d, g_option.bFixedPoint);
 
         t = getTickCount() - t;
-        LOGE("#%d---Time elapsed: %fms\n", ++i, t * 1000 / getTickFrequency());
-
-        // Show depth value
-        LOGE("****************************************\n");
-        LOGE("* %08.3f * %08.3f * %08.3f *\n", d[0][0], d[0][1], d[0][2]);
-        LOGE("* %08.3f * %08.3f * %08.3f *\n", d[1][0], d[1][1], d[1][2]);
-        LOGE("* %08.3f * %08.3f * %08.3f *\n", d[2][0], d[2][1], d[2][2]);
-        LOGE("****************************************\n\n");
-
-        // Show left frame.
-        dstRC  = Rect(g_border, g_border, g_cameraWidth, g_cameraHeight);
-        dstROI = displayFrame(dstRC);
-        leftFrame.copyTo(dstROI);
-
-        // Show right frame.
-        dstRC  = Rect(g_cameraWidth + g_border * 2, g_border, g_cameraWidth, g_cameraHeight);
-        dstROI = displayFrame(dstRC);
-        rightFrame.copyTo(dstROI);
-
-        // Show disparities' image.
-        dstRC  = Rect(g_border, g_border * 2 + g_cameraHeight, disp8.cols, disp8.rows);
-        dstROI = displayFrame(dstRC);
-        Mat dispColor;
-        // disp8.convertTo(dispColor, displayFrame.type());
-        cvtColor(disp8, dispColor, CV_GRAY2BGR);
-        dispColor.copyTo(dstROI);
-
-        imshow(g_windowName, displayFrame);
-
-        // IMPORTANT: Wait for at least 20 milliseconds, so that the image can be displayed on the screen!
-        // Also checks if a key was pressed in the GUI window. Note that it should be a "char" to support Linux.
-        char keypress = waitKey(20);  // This is needed if you want to see anything!
-        if (keypress == VK_ESCAPE)
+        LOGE("#%d---Time elapsed: %fms, skew %fms\n", ++i, t * 1000 / getTickFrequency(), StereoGetPairSkew(pair));
+
+        // Log the point cloud of every frame, e.g. during test flights.
+        if (g_option.strPCLFile)
+        {
+            TQC_TRACE_SCOPE("output");
+            char buf[TQC_MAX_PATH];
+
+            sprintf(buf, "%s/%s_%06d.ply", g_option.strOutputPath ? g_option.strOutputPath : ".", g_option.strPCLFile, i);
+            StereoSavePly(buf, disp, g_CamParam.depthLut, TQC_PLY_WITH_COLOR ? matcher.GetRectifiedLeft() : Mat(), TQC_MAX_DEPTH);
+        }
+
+        if (!ShowFrame(pair.left, pair.right, disp8, d))
         {
-            // Escape Key
-            // Quit the program!
             break;
         }
     }
 
+    StereoDumpTrace();
+
     return 0;
 }
\ No newline at end of file